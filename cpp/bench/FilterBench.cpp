@@ -0,0 +1,159 @@
+#include <pcap/pcap.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include "Config.h"
+#include "PacketFilter.h"
+#include "PcapReader.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+// FilterBench
+//
+// Runs every packet of an uncompressed capture through the loader's BPF
+// filter and through the native filter for its link type, checking that the
+// two agree and reporting the time each takes per packet.
+//
+// Usage:
+//   ./filterbench <capture> [rounds]
+//
+
+#define READ_BATCH_SIZE 256
+
+inline double getTimeSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Returns how many packets pass, and whether each one did in passed
+size_t runBPF(const vector<PacketView>& views, int rounds,
+              vector<bool> *passed) {
+  pcap_t *pcap = pcap_open_dead(views[0].datalink, 65535);
+  struct bpf_program bpf;
+  if(pcap == NULL || pcap_compile(pcap, &bpf, CAPTURE_FILTER, 1, 0) < 0) {
+    fprintf(stderr, "Could not compile filter\n");
+    exit(1);
+  }
+
+  size_t numPassed = 0;
+  for(int round = 0; round < rounds; round++) {
+    numPassed = 0;
+    for(size_t i = 0; i < views.size(); i++) {
+      struct pcap_pkthdr header;
+      header.ts.tv_sec = views[i].time / 1000000000;
+      header.ts.tv_usec = (views[i].time % 1000000000) / 1000;
+      header.caplen = views[i].caplen;
+      header.len = views[i].len;
+
+      bool pass = views[i].datalink == views[0].datalink &&
+                  pcap_offline_filter(&bpf, &header, views[i].data);
+      (*passed)[i] = pass;
+      numPassed += pass;
+    }
+  }
+
+  pcap_freecode(&bpf);
+  pcap_close(pcap);
+  return numPassed;
+}
+
+template<typename Link>
+size_t runNative(const vector<PacketView>& views, int rounds,
+                 vector<bool> *passed) {
+  FilterRule rule = { FILTER_UDP, CAPTURE_PORT, CAPTURE_HOSTS,
+                      CAPTURE_NUM_HOSTS };
+  PacketFilter<Link> filter(rule);
+
+  size_t numPassed = 0;
+  uint32_t batch[READ_BATCH_SIZE];
+  for(int round = 0; round < rounds; round++) {
+    numPassed = 0;
+    for(size_t start = 0; start < views.size(); start += READ_BATCH_SIZE) {
+      size_t count = views.size() - start;
+      if(count > READ_BATCH_SIZE) {
+        count = READ_BATCH_SIZE;
+      }
+
+      size_t n = filter.filterBatch(&views[start], count, batch);
+      for(size_t i = 0; i < n; i++) {
+        (*passed)[start + batch[i]] = true;
+      }
+      numPassed += n;
+    }
+  }
+  return numPassed;
+}
+
+int main(int argc, char **argv) {
+  if(argc < 2) {
+    fprintf(stderr, "Usage: %s <capture> [rounds]\n", argv[0]);
+    exit(1);
+  }
+  int rounds = (argc >= 3) ? atoi(argv[2]) : 10;
+  if(rounds < 1) {
+    rounds = 1;
+  }
+
+  PcapReader reader;
+  if(!reader.open(argv[1])) {
+    fprintf(stderr, "Could not read '%s' - %s\n", argv[1], reader.error());
+    exit(1);
+  }
+
+  vector<PacketView> views;
+  PacketView batch[READ_BATCH_SIZE];
+  size_t n;
+  while((n = reader.nextBatch(batch, READ_BATCH_SIZE)) > 0) {
+    views.insert(views.end(), batch, batch + n);
+  }
+  if(reader.error() != NULL || views.empty()) {
+    fprintf(stderr, "Could not read '%s' - %s\n", argv[1],
+            reader.error() ? reader.error() : "no packets");
+    exit(1);
+  }
+
+  vector<bool> bpfPassed(views.size());
+  vector<bool> nativePassed(views.size());
+
+  double start = getTimeSeconds();
+  size_t bpfCount = runBPF(views, rounds, &bpfPassed);
+  double bpfTime = getTimeSeconds() - start;
+
+  start = getTimeSeconds();
+  size_t nativeCount;
+  switch(views[0].datalink) {
+    case DLT_EN10MB:
+      nativeCount = runNative<EthernetLink>(views, rounds, &nativePassed);
+      break;
+    case DLT_LINUX_SLL:
+      nativeCount = runNative<LinuxSllLink>(views, rounds, &nativePassed);
+      break;
+    case DLT_RAW:
+      nativeCount = runNative<RawLink>(views, rounds, &nativePassed);
+      break;
+    default:
+      fprintf(stderr, "No native filter for link type %d\n",
+              views[0].datalink);
+      exit(1);
+  }
+  double nativeTime = getTimeSeconds() - start;
+
+  size_t mismatches = 0;
+  for(size_t i = 0; i < views.size(); i++) {
+    mismatches += bpfPassed[i] != nativePassed[i];
+  }
+
+  double packets = (double)views.size() * rounds;
+  printf("%zu packets x %d rounds\n", views.size(), rounds);
+  printf("bpf:    %zu passed, %.2f ns/packet\n", bpfCount,
+         bpfTime * 1e9 / packets);
+  printf("native: %zu passed, %.2f ns/packet\n", nativeCount,
+         nativeTime * 1e9 / packets);
+  printf("mismatches: %zu\n", mismatches);
+  return mismatches ? 1 : 0;
+}
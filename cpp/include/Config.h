@@ -22,6 +22,16 @@
 #define NEW_ADDRESS_STR       "199.7.91.13"
 #define NEW_ADDRESS           IPV4_OCTETS(199,7,91,13)
 
+// Only UDP DNS traffic to or from the old/new server addresses is analyzed.
+// Mapped captures of common link types are filtered natively with the port and
+// hosts below; CAPTURE_FILTER is the same rule for libpcap.
+#define CAPTURE_PORT          53
+#define CAPTURE_HOSTS         { OLD_ADDRESS, NEW_ADDRESS }
+#define CAPTURE_NUM_HOSTS     2
+#define CAPTURE_FILTER        "udp port 53 and (dst host " OLD_ADDRESS_STR \
+                              " or dst host " NEW_ADDRESS_STR " or src host " \
+                              OLD_ADDRESS_STR " or src host " NEW_ADDRESS_STR ")"
+
 // Old server sent out its first response containing an A record for the new
 // IP address at exactly 09:53:01 on 01/03/2013 local time.
 #define TIME_OLD_ADVERT_NEW   TIME_S2US(1357224781)
@@ -36,9 +46,35 @@
 #define OBSOLETE_TYPES_VALID 1
 #define EXPERIMENTAL_TYPES_VALID 1
 
+// Sets of 8 parsed question names kept per worker, keyed on their wire bytes.
+// Each name takes about 2 KB.
+#define QNAME_CACHE_SETS 512
+
+////////////////////////////////////////////////////////////////////////////////
+// Configuration - Query/Response Matching
+
+// Queries still unanswered this long (in capture time) after they arrived are
+// released for analysis as unanswered
+#define QUERY_TIMEOUT         TIME_S2US(5)
+#define QUERY_TIMEOUT_TICK    1000  // Timer granularity in microseconds
+
+// Maximum number of queries held for matching at once. Should comfortably
+// exceed the query rate times QUERY_TIMEOUT; when full, the oldest query is
+// released early.
+#define QUERY_BUFFER_SIZE     200000
+
+// Initial size in bytes of the ring holding query/response payloads. It grows
+// as needed, so this only has to cover the common case.
+#define PAYLOAD_RING_SIZE     (1 << 22)
+
 ////////////////////////////////////////////////////////////////////////////////
 // Configuration - Analysis
 
+// Fields of each query the analysis reads (DNS_FIELD_* in ParseDNS.h). The
+// parser skips the work for the rest, so trim this to what the outputs in use
+// need; queries per second by type only need DNS_FIELD_QTYPE.
+#define ANALYSIS_FIELDS DNS_FIELD_ALL
+
 #define QPS_MAX_TYPES 10
 #define SCS_OLD_UNIQUE_THRESHOLD 3
 
@@ -0,0 +1,131 @@
+#ifndef DNS_RECORDS_H
+#define DNS_RECORDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// DNSRecordWalker
+//
+// Single pass over every record of a DNS message: the questions, then the
+// answer, authority and additional sections. Nothing is copied or allocated;
+// each record points back into the message, and every read is bounds checked
+// against its end. Owner names are only skipped, so a compression pointer ends
+// a name wherever it points; dnsParseName() (ParseDNS.h) follows pointers when
+// a name is needed as text.
+//
+// The walk stops at the first record that does not fit in the message, or
+// whose name is malformed, and error() is set. Records before it stay valid.
+//
+// The first OPT record of the additional section (RFC 6891) is decoded as the
+// walk passes it, and edns() holds its fields from then on.
+//
+// Usage:
+//   DNSRecordWalker walker(data, size);
+//   DNSRecord record;
+//   while(walker.next(&record)) {
+//     if(record.section == DNS_SECTION_ANSWER && record.type == T_A) {
+//       // record.rdata points at the 4 byte address
+//     }
+//   }
+//   bool dnssecOK = walker.edns().dnssecOK;
+//
+
+enum DNSSection {
+  DNS_SECTION_QUESTION = 0,
+  DNS_SECTION_ANSWER,
+  DNS_SECTION_AUTHORITY,
+  DNS_SECTION_ADDITIONAL
+};
+
+typedef struct {
+  DNSSection section;
+  const uint8_t *name;   // Owner name on the wire, ending in a root label or
+                         // a compression pointer
+  uint16_t type;
+  uint16_t rclass;
+  uint32_t ttl;          // Zero for questions
+  const uint8_t *rdata;  // NULL for questions
+  uint16_t rdlength;
+} DNSRecord;
+
+// Fields of an OPT record, all zero if the message has none
+typedef struct {
+  bool present;
+  uint16_t udpSize;        // Requestor's UDP payload size
+  uint8_t extRcode;        // Upper 8 bits of the 12 bit RCODE
+  uint8_t version;
+  bool dnssecOK;           // DO bit
+  const uint8_t *options;  // RDATA, as {code, length, data} options
+  uint16_t optionsSize;
+} DNSEdns;
+
+typedef struct {
+  uint16_t code;
+  uint16_t size;
+  const uint8_t *data;
+} DNSOption;
+
+class DNSRecordWalker {
+ public:
+  DNSRecordWalker(const uint8_t *data, uint32_t size);
+
+  // Moves to the next record, returning false once there are none left or the
+  // message turns out to be malformed
+  bool next(DNSRecord *record);
+
+  // Whether the walk stopped at a malformed record rather than the end
+  bool error() const {
+    return failed;
+  }
+
+  // OPT record, if the walk has passed it
+  const DNSEdns& edns() const {
+    return opt;
+  }
+
+  // Walks on until the OPT record has been passed or there are no records
+  // left, for callers that only want the EDNS fields
+  const DNSEdns& findEdns();
+
+  const uint8_t *message() const {
+    return start;
+  }
+
+  const uint8_t *messageEnd() const {
+    return end;
+  }
+
+ private:
+  const uint8_t *start;
+  const uint8_t *end;
+  const uint8_t *cur;
+  uint16_t counts[4];
+  int section;
+  uint16_t left;
+  bool failed;
+  DNSEdns opt;
+};
+
+// Steps through the options of an OPT record, starting from
+// *cur = edns.options. Returns false at the end of the options or at one that
+// runs past them.
+inline bool dnsNextOption(const uint8_t **cur, const uint8_t *end,
+                          DNSOption *option) {
+  if(*cur == NULL || end - *cur < 4) {
+    return false;
+  }
+
+  uint16_t size = ((*cur)[2] << 8) | (*cur)[3];
+  if(end - (*cur + 4) < size) {
+    return false;
+  }
+
+  option->code = ((*cur)[0] << 8) | (*cur)[1];
+  option->size = size;
+  option->data = *cur + 4;
+  *cur += 4 + size;
+  return true;
+}
+
+#endif // DNS_RECORDS_H
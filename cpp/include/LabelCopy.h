@@ -0,0 +1,33 @@
+#ifndef LABEL_COPY_H
+#define LABEL_COPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// LabelCopy
+//
+// Vectorized inner loop of DNS name parsing. Copies label bytes out of a packet
+// 16 or 32 at a time, lower casing 'A'-'Z' and looking for bytes that have to
+// be escaped (control characters and spaces, as iscntrl() and isspace() see
+// them in the C locale). Bytes from 0x80 up are copied as they are.
+//
+// The AVX2 or SSE2 version is picked when the program starts, depending on the
+// CPU, with a scalar version for other architectures.
+//
+// Usage:
+//   size_t i = labelCopyLower(out, label, size);
+//   if(i < size) {
+//     // label[i] needs escaping, and out holds the i bytes before it
+//   }
+//
+
+// Copies up to n bytes from src to dst, lower cased, stopping at the first
+// byte that needs escaping. Returns the index of that byte, or n if there is
+// none; only dst[0] to dst[n - 1] are written.
+size_t labelCopyLower(char *dst, const uint8_t *src, size_t n);
+
+// Name of the version in use, e.g. "avx2"
+const char *labelCopyVersion();
+
+#endif // LABEL_COPY_H
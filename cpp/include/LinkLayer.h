@@ -0,0 +1,78 @@
+#ifndef LINK_LAYER_H
+#define LINK_LAYER_H
+
+#include <pcap/pcap.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// LinkLayer
+//
+// Link layer policies for the templated packet path. Each names its DLT_*
+// value and the size of its header, which is where the network header starts.
+//
+
+// Network layer found by a link layer policy
+enum {
+  NETWORK_OTHER = 0,
+  NETWORK_IPV4 = 4,
+  NETWORK_IPV6 = 6
+};
+
+// Link layers with a native filter also say which network protocol a packet
+// carries, given at least HEADER_SIZE + 1 bytes.
+struct EthernetLink {
+  static const int DATALINK = DLT_EN10MB;
+  static const uint32_t HEADER_SIZE = 14;
+
+  static int network(const uint8_t *p) {
+    uint16_t type = (p[12] << 8) | p[13];
+    return (type == 0x0800) ? NETWORK_IPV4 :
+           (type == 0x86DD) ? NETWORK_IPV6 : NETWORK_OTHER;
+  }
+};
+
+struct LinuxSllLink {
+  static const int DATALINK = DLT_LINUX_SLL;
+  static const uint32_t HEADER_SIZE = 16;
+
+  static int network(const uint8_t *p) {
+    uint16_t type = (p[14] << 8) | p[15];
+    return (type == 0x0800) ? NETWORK_IPV4 :
+           (type == 0x86DD) ? NETWORK_IPV6 : NETWORK_OTHER;
+  }
+};
+
+struct RawLink {
+  static const int DATALINK = DLT_RAW;
+  static const uint32_t HEADER_SIZE = 0;
+
+  // Raw captures have no link header, so the IP version has to do. Callers
+  // check that the first byte is there.
+  static int network(const uint8_t *p) {
+    uint8_t version = p[0] >> 4;
+    return (version == 4) ? NETWORK_IPV4 :
+           (version == 6) ? NETWORK_IPV6 : NETWORK_OTHER;
+  }
+};
+
+struct NullLink {
+  static const int DATALINK = DLT_NULL;
+  static const uint32_t HEADER_SIZE = 4;
+};
+
+struct Ieee802Link {
+  static const int DATALINK = DLT_IEEE802;
+  static const uint32_t HEADER_SIZE = 22;
+};
+
+struct SlipLink {
+  static const int DATALINK = DLT_SLIP;
+  static const uint32_t HEADER_SIZE = 24;
+};
+
+struct PppLink {
+  static const int DATALINK = DLT_PPP;
+  static const uint32_t HEADER_SIZE = 24;
+};
+
+#endif // LINK_LAYER_H
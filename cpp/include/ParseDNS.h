@@ -1,9 +1,8 @@
 #ifndef PARSE_DNS_H
 #define PARSE_DNS_H
 
-#include <list>
+#include <arpa/inet.h>
 #include <stdint.h>
-#include <string>
 #include <string.h>
 
 #include "nameser.h"
@@ -14,14 +13,49 @@
 #define DNS_ERR_NAME_ERROR 3
 #define DNS_ERR_NOT_IMPLEMENTED 4
 #define DNS_ERR_REFUSED 5
+#define DNS_ERR_UNANSWERED -1
 
+// A parsed name takes at most MAXDNAME bytes on the wire, each of which is
+// written as up to 4 characters ("<1F>" for control characters), and every
+// label takes at least 2 of those bytes
+#define DNS_NAME_SIZE (4 * MAXDNAME)
+#define DNS_MAX_LABELS (MAXDNAME / 2)
+
+// Where a label sits in DNSQuestion::qname
+typedef struct {
+  uint16_t offset;
+  uint16_t size;
+} DNSLabel;
+
+// The question is parsed in place: qname is lower cased, dot terminated ("."
+// for the root) and NUL terminated, and qnameLabels points into it without the
+// dots. The root name has the single label ".".
 typedef struct {
-  std::string qname;
-  std::list<std::string> qnameParts;
+  char qname[DNS_NAME_SIZE + 1];
+  uint16_t qnameSize;
+  DNSLabel qnameLabels[DNS_MAX_LABELS];
+  int numLabels;
+  uint32_t qnameID;  // Name's ID in the name cache, 0 if it was not cached
   uint16_t qtype;
   uint16_t qclass;
 } DNSQuestion;
 
+// Returns label i of the question's name, setting size to its length
+inline const char *dnsLabel(const DNSQuestion *question, int i, size_t *size) {
+  *size = question->qnameLabels[i].size;
+  return question->qname + question->qnameLabels[i].offset;
+}
+
+// Fields the parser can be asked for. Work on anything that was not asked for
+// is skipped, and the matching members or columns are left as they were, so
+// pass only what is read downstream; e.g. counting queries by type only needs
+// DNS_FIELD_QTYPE.
+#define DNS_FIELD_HEADER 0x01  // ID, flags and section counts
+#define DNS_FIELD_QTYPE  0x02  // Question type and class
+#define DNS_FIELD_QNAME  0x04  // Question name and its labels
+#define DNS_FIELD_EDNS   0x08  // OPT record and its DNSSEC OK bit
+#define DNS_FIELD_ALL    0x0F
+
 typedef struct {
   int error;
   HEADER header;
@@ -30,13 +64,98 @@ typedef struct {
 } DNSQuery;
 
 void dnsParseInit();
-int dnsParseID(const uint8_t *data, uint32_t size);
+
+// Hits and misses of the question name cache (see QNameCache.h) since the
+// process started
+void dnsNameCacheStats(uint64_t *hits, uint64_t *misses);
+
+// Returns the query ID, or -1 if the payload is too short to hold one
+inline int dnsParseID(const uint8_t *data, uint32_t size) {
+  int id = -1;
+
+  if(size >= 2) {
+    id = ntohs(*((uint16_t *)data));
+  }
+
+  return id;
+}
+
+// Returns the response code, or DNS_ERR_FORMAT_ERROR if there is no header
 int dnsParseResponse(const uint8_t *data, uint32_t size); 
-int dnsParseQuery(DNSQuery *query, const uint8_t *data, uint32_t size); 
+// The header is always parsed, as the rest cannot be found without it. Returns
+// -1 if there is no header.
+int dnsParseQuery(DNSQuery *query, const uint8_t *data, uint32_t size,
+                  uint32_t fields);
+
+// Parses the name at dStart as the question's name is parsed, into a buffer of
+// DNS_NAME_SIZE + 1 bytes, following compression pointers back into the
+// message. Returns the number of bytes the name takes at dStart, or -1 if it
+// is malformed.
+int dnsParseName(char *name, uint16_t *nameSize, const uint8_t *message,
+                 const uint8_t *dStart, const uint8_t *dEnd);
+
+////////////////////////////////////////////////////////////////////////////////
+// Batch parsing
+//
+// dnsParseBatch() parses up to DNS_BATCH_SIZE packets into columns, so that
+// whatever consumes them can run down one field of the whole batch at a time.
+// Entry i of every column belongs to packets[i]. Header fields are in host
+// byte order; names are parsed as in DNSQuestion and stored back to back in
+// one arena, NUL terminated.
+//
+// DNSBatch is a few hundred KB, so allocate it once and reuse it.
+//
+
+#define DNS_BATCH_SIZE 256
+
+typedef struct {
+  const uint8_t *data;
+  uint32_t size;
+} DNSPacketRef;
+
+typedef struct {
+  size_t count;
+
+  // Header, zero for packets too short to hold one
+  uint16_t id[DNS_BATCH_SIZE];
+  uint16_t flags[DNS_BATCH_SIZE];     // QR, opcode, AA, TC, RD, RA, Z, RCODE
+  uint16_t qdcount[DNS_BATCH_SIZE];
+  uint16_t ancount[DNS_BATCH_SIZE];
+  uint16_t nscount[DNS_BATCH_SIZE];
+  uint16_t arcount[DNS_BATCH_SIZE];
+
+  // First question, valid if hasQuestion is set
+  bool hasQuestion[DNS_BATCH_SIZE];
+  uint16_t qtype[DNS_BATCH_SIZE];
+  uint16_t qclass[DNS_BATCH_SIZE];
+  uint32_t nameOffset[DNS_BATCH_SIZE];  // Into names
+  uint16_t nameSize[DNS_BATCH_SIZE];
+  uint32_t nameID[DNS_BATCH_SIZE];      // As in DNSQuestion
+
+  // Whether there is an OPT record, and its DNSSEC OK bit
+  bool hasEDNS[DNS_BATCH_SIZE];
+  bool dnssecOK[DNS_BATCH_SIZE];
+
+  char names[DNS_BATCH_SIZE * (DNS_NAME_SIZE + 1)];
+} DNSBatch;
+
+// Returns the number of packets parsed, min(n, DNS_BATCH_SIZE). Only the
+// columns of the given DNS_FIELD_* fields are filled, along with qdcount and
+// arcount, and hasQuestion if either question field is asked for.
+size_t dnsParseBatch(const DNSPacketRef *packets, size_t n, DNSBatch *out,
+                     uint32_t fields);
+
+// Returns the name of packet i in a batch
+inline const char *dnsBatchName(const DNSBatch *batch, size_t i) {
+  return batch->names + batch->nameOffset[i];
+}
 
 bool dnsIsValidType(uint16_t value);
 bool dnsIsValidClass(uint16_t value); 
+// TLDs are matched case insensitively
 bool dnsIsValidTLD(const char *name);
+bool dnsIsValidTLD(const char *name, size_t size);
+bool dnsHasValidTLD(const DNSQuestion *question);
 
 #endif // PARSE_DNS_H
 
@@ -0,0 +1,63 @@
+#ifndef PAYLOAD_RING_H
+#define PAYLOAD_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// PayloadRing
+//
+// Byte ring holding variable length packet payloads. Payloads are appended at
+// the head and freed in bulk from the tail, which fits the matcher since pairs
+// are released in arrival order. Each payload is stored contiguously and named
+// by a 64-bit logical offset that stays valid when the ring grows, so callers
+// keep offsets rather than pointers.
+//
+
+class PayloadRing {
+ public:
+  explicit PayloadRing(size_t capacity = (1 << 20));
+  ~PayloadRing();
+
+  // Copies size bytes into the ring, returning the offset they are stored at
+  uint64_t store(const uint8_t *data, size_t size);
+
+  const uint8_t *at(uint64_t offset) const {
+    return buffer + (offset & mask);
+  }
+
+  // Frees every payload stored before offset
+  void release(uint64_t offset) {
+    if(offset > tail) {
+      tail = offset;
+    }
+  }
+
+  // Offset the next payload will be stored at (or after)
+  uint64_t end() const {
+    return head;
+  }
+
+  void clear() {
+    head = 0;
+    tail = 0;
+  }
+
+  size_t capacity() const {
+    return mask + 1;
+  }
+
+ private:
+  void grow();
+
+  uint8_t *buffer;
+  size_t mask;
+  uint64_t head;
+  uint64_t tail;
+
+  // Not copyable
+  PayloadRing(const PayloadRing&);
+  PayloadRing& operator=(const PayloadRing&);
+};
+
+#endif // PAYLOAD_RING_H
@@ -0,0 +1,86 @@
+#ifndef PCAP_READER_H
+#define PCAP_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// PcapReader
+//
+// Reads uncompressed classic pcap and pcapng files by mapping them into memory
+// and handing out views of each packet in place, skipping the copy and
+// per-packet callback of pcap_loop. Both byte orders are handled, as are the
+// microsecond and nanosecond classic formats and any pcapng if_tsresol.
+//
+// Usage:
+//   PcapReader reader;
+//   if(reader.open(path)) {
+//     PacketView views[256];
+//     size_t n;
+//     while((n = reader.nextBatch(views, 256)) > 0) {
+//       ...
+//     }
+//   }
+//
+
+struct PacketView {
+  uint64_t time;        // Nanoseconds since the epoch
+  uint32_t caplen;      // Bytes available at data
+  uint32_t len;         // Bytes on the wire
+  int datalink;         // DLT_* value for the capturing interface
+  const uint8_t *data;
+};
+
+class PcapReader {
+ public:
+  PcapReader();
+  ~PcapReader();
+
+  // Maps the file and reads its header. Returns false, with error() set, if
+  // the file cannot be mapped or is not an uncompressed pcap/pcapng file.
+  bool open(const char *path);
+  void close();
+
+  // Fills up to max views with the next packets, returning how many were
+  // filled. Returns 0 at the end of the file, or on a malformed/truncated
+  // record, in which case error() is set.
+  size_t nextBatch(PacketView *views, size_t max);
+
+  const char *error() const {
+    return errorMsg;
+  }
+
+ private:
+  struct Interface {
+    int datalink;
+    uint64_t unitsPerSecond;  // Timestamp resolution
+    uint64_t offset;          // Seconds added to every timestamp
+  };
+
+  bool nextClassic(PacketView *view);
+  bool nextNG(PacketView *view);
+  bool readSectionHeader();
+  bool readInterface(const uint8_t *body, size_t size);
+
+  uint16_t get16(const uint8_t *p) const;
+  uint32_t get32(const uint8_t *p) const;
+
+  bool fail(const char *msg);
+
+  const uint8_t *map;
+  size_t mapSize;
+  const uint8_t *cur;
+  const uint8_t *end;
+
+  bool isNG;
+  bool swapped;
+  std::vector<Interface> interfaces;
+  const char *errorMsg;
+
+  // Not copyable
+  PcapReader(const PcapReader&);
+  PcapReader& operator=(const PcapReader&);
+};
+
+#endif // PCAP_READER_H
@@ -0,0 +1,180 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <pcap/pcap.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "LinkLayer.h"
+#include "ParseDNS.h"
+#include "PcapReader.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Pipeline
+//
+// The per-packet path of the loader as compile-time stages:
+//   Link    link layer policy (LinkLayer.h), fixing where the IP header is
+//   Filter  anything with filterBatch(views, n, passed), e.g. PacketFilter or
+//           BpfFilter
+//   Parser  turns the IP packet into a DNSPacket, or rejects it
+//   Sink    gets prefetch() for every packet of a batch that parses, then
+//           onTime() for every packet that passes the filter and onPacket()
+//           for the ones that parse
+// runPipeline() is instantiated once per combination, so every stage inlines
+// into a single loop and the link type is only looked at once per file.
+//
+// Usage:
+//   PacketFilter<EthernetLink> filter(rule);
+//   runPipeline<EthernetLink, UDPDNSParser>(reader, views, n, filter, sink);
+//
+
+#define PIPELINE_BATCH_SIZE 256
+
+// A filtered packet broken down far enough to pair queries with responses
+struct DNSPacket {
+  uint64_t time;        // Microseconds since the epoch
+  uint32_t sourceIP;    // Host byte order
+  uint32_t destIP;
+  uint16_t sourcePort;
+  uint16_t destPort;
+  int queryID;          // -1 if the payload is too short to hold one
+  const uint8_t *payload;
+  uint16_t size;
+};
+
+// Filter stage running the BPF program libpcap compiles for an expression,
+// for link types without a native filter
+template<typename Link>
+class BpfFilter {
+ public:
+  explicit BpfFilter(const char *expression) {
+    if((pcap = pcap_open_dead(Link::DATALINK, 65535)) == NULL) {
+      fprintf(stderr, "Could not create pcap handle for filtering\n");
+      exit(1);
+    }
+    if(pcap_compile(pcap, &bpf, expression, 1, 0) < 0) {
+      fprintf(stderr, "Could not compile filter - %s\n", pcap_geterr(pcap));
+      exit(1);
+    }
+  }
+
+  ~BpfFilter() {
+    pcap_freecode(&bpf);
+    pcap_close(pcap);
+  }
+
+  size_t filterBatch(const PacketView *views, size_t n,
+                     uint32_t *passed) const {
+    size_t numPassed = 0;
+    for(size_t i = 0; i < n; i++) {
+      struct pcap_pkthdr header;
+      header.ts.tv_sec = views[i].time / 1000000000;
+      header.ts.tv_usec = (views[i].time % 1000000000) / 1000;
+      header.caplen = views[i].caplen;
+      header.len = views[i].len;
+
+      if(views[i].datalink == Link::DATALINK &&
+         pcap_offline_filter(&bpf, &header, views[i].data)) {
+        passed[numPassed++] = i;
+      }
+    }
+    return numPassed;
+  }
+
+ private:
+  pcap_t *pcap;
+  struct bpf_program bpf;
+
+  // Not copyable
+  BpfFilter(const BpfFilter&);
+  BpfFilter& operator=(const BpfFilter&);
+};
+
+// Parser stage for DNS over UDP/IPv4, given the caplen bytes captured from the
+// IP header on. The filter can pass packets cut short anywhere after the UDP
+// source port, so the headers and payload are checked against caplen before
+// they are read.
+struct UDPDNSParser {
+  static bool parse(const uint8_t *packetIP, uint32_t caplen, uint64_t time,
+                    DNSPacket *out) {
+    const struct ip *headerIP = (const struct ip *)packetIP;
+    if(caplen < sizeof(struct ip) || headerIP->ip_v != 4) {
+      return false;
+    }
+
+    uint32_t headerLen = headerIP->ip_hl * 4;
+    if(headerLen < sizeof(struct ip) || headerLen + 8 > caplen) {
+      return false;
+    }
+
+    const uint8_t *payloadIP = packetIP + headerLen;
+    const struct udphdr *headerUDP = (const struct udphdr *)payloadIP;
+    uint16_t lengthUDP = ntohs(headerUDP->len);
+    if(lengthUDP < 8) {
+      return false;
+    }
+
+    // Check if UDP payload size agrees with remaining packet size, and holds
+    // at least a DNS header
+    uint16_t payloadUDPSize = lengthUDP - 8;
+    if(payloadUDPSize > caplen - headerLen - 8 ||
+       payloadUDPSize < sizeof(HEADER)) {
+      return false;
+    }
+    if(payloadUDPSize > 2048) {
+      fprintf(stderr, "Payload > 2048 bytes, skipping\n");
+      return false;
+    }
+
+    out->time = time;
+    out->sourceIP = ntohl(headerIP->ip_src.s_addr);
+    out->destIP = ntohl(headerIP->ip_dst.s_addr);
+    out->sourcePort = ntohs(headerUDP->source);
+    out->destPort = ntohs(headerUDP->dest);
+    out->payload = payloadIP + 8;
+    out->size = payloadUDPSize;
+    out->queryID = dnsParseID(out->payload, out->size);
+    return true;
+  }
+};
+
+// Runs the current batch of views and the rest of the reader's packets
+// through the stages. numViews must be at most PIPELINE_BATCH_SIZE.
+template<typename Link, typename Parser, typename Filter, typename Sink>
+void runPipeline(PcapReader& reader, PacketView *views, size_t numViews,
+                 const Filter& filter, Sink& sink) {
+  uint32_t passed[PIPELINE_BATCH_SIZE];
+  DNSPacket packets[PIPELINE_BATCH_SIZE];
+  bool parsed[PIPELINE_BATCH_SIZE];
+
+  do {
+    // The whole batch is parsed before any of it reaches the sink, so the
+    // sink's prefetches are all in flight by the time it handles the first
+    size_t numPassed = filter.filterBatch(views, numViews, passed);
+    for(size_t i = 0; i < numPassed; i++) {
+      const PacketView& view = views[passed[i]];
+      uint64_t time = view.time / 1000;
+      packets[i].time = time;
+      parsed[i] = view.caplen >= Link::HEADER_SIZE &&
+                  Parser::parse(view.data + Link::HEADER_SIZE,
+                                view.caplen - Link::HEADER_SIZE, time,
+                                &packets[i]);
+      if(parsed[i]) {
+        sink.prefetch(packets[i]);
+      }
+    }
+
+    for(size_t i = 0; i < numPassed; i++) {
+      sink.onTime(packets[i].time);
+      if(parsed[i]) {
+        sink.onPacket(packets[i]);
+      }
+    }
+  } while((numViews = reader.nextBatch(views, PIPELINE_BATCH_SIZE)) > 0);
+}
+
+#endif // PIPELINE_H
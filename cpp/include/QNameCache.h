@@ -0,0 +1,87 @@
+#ifndef QNAME_CACHE_H
+#define QNAME_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ParseDNS.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// QNameCache
+//
+// Fixed size cache of parsed question names, keyed on the name's wire bytes,
+// so that the few names that make up most of the traffic are lower cased and
+// split into labels once rather than per packet. Each name cached is given an
+// ID, which stays its own for as long as it is cached.
+//
+// The cache is set associative: a name's hash picks a set of QNAME_CACHE_WAYS
+// entries, whose tags and wire sizes share one cache line. Within a set, names
+// are evicted by CLOCK; every hit sets the entry's reference bit, and the hand
+// passes over (and clears) referenced entries to find a victim.
+//
+// Not thread safe. The workers are processes, so each has its own.
+//
+// Usage:
+//   bool found;
+//   QNameEntry *entry = cache.lookup(wire, wireSize, &found);
+//   if(!found) {
+//     // fill in entry->name, nameSize, labels and numLabels
+//   }
+//
+
+#define QNAME_CACHE_WAYS 8
+
+typedef struct {
+  uint32_t id;
+  uint16_t wireSize;
+  uint16_t nameSize;
+  int numLabels;
+  uint8_t wire[MAXDNAME];
+  char name[DNS_NAME_SIZE + 1];
+  DNSLabel labels[DNS_MAX_LABELS];
+} QNameEntry;
+
+typedef struct {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+} QNameCacheStats;
+
+class QNameCache {
+ public:
+  // numSets is rounded up to a power of two
+  explicit QNameCache(size_t numSets);
+  ~QNameCache();
+
+  // Returns the entry for the name of wireSize bytes at wire, setting found to
+  // whether it was cached. A new entry has its ID and key set and the rest
+  // left to the caller. Names longer than MAXDNAME are not cached, and give
+  // NULL.
+  QNameEntry *lookup(const uint8_t *wire, uint16_t wireSize, bool *found);
+
+  const QNameCacheStats& stats() const {
+    return counters;
+  }
+
+ private:
+  struct alignas(64) Set {
+    uint32_t tags[QNAME_CACHE_WAYS];       // Hash bits, 0 for empty ways
+    uint16_t wireSizes[QNAME_CACHE_WAYS];
+    uint8_t referenced;                    // CLOCK bits, one per way
+    uint8_t hand;                          // Way the clock looks at next
+  };
+
+  static_assert(sizeof(Set) == 64, "A set should fill one cache line");
+
+  Set *sets;
+  QNameEntry *entries;
+  size_t mask;
+  uint32_t nextID;
+  QNameCacheStats counters;
+
+  // Not copyable
+  QNameCache(const QNameCache&);
+  QNameCache& operator=(const QNameCache&);
+};
+
+#endif // QNAME_CACHE_H
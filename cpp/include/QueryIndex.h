@@ -0,0 +1,67 @@
+#ifndef QUERY_INDEX_H
+#define QUERY_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// QueryIndex
+//
+// Open-addressing hash index from a query's uniqueID (srcIP|port|queryID) to
+// its slot in the pending query/response buffer. Uses linear probing with
+// backward-shift deletion, so there are no tombstones and insert, lookup and
+// delete stay O(1) no matter how many queries are outstanding.
+//
+
+class QueryIndex {
+ public:
+  static const uint32_t NOT_FOUND = 0xFFFFFFFF;
+
+  explicit QueryIndex(size_t capacity = (1 << 16));
+  ~QueryIndex();
+
+  // Maps key to value, replacing any existing mapping for key
+  void insert(uint64_t key, uint32_t value);
+
+  // Returns the value mapped to key, or NOT_FOUND
+  uint32_t find(uint64_t key) const;
+
+  // Removes key, returning the value it was mapped to or NOT_FOUND
+  uint32_t erase(uint64_t key);
+
+  // Starts loading key's home slot, for callers that know their keys ahead
+  // of the lookups
+  void prefetch(uint64_t key) const {
+    __builtin_prefetch(&slots[home(key)]);
+  }
+
+  void clear();
+
+  size_t size() const {
+    return count;
+  }
+
+ private:
+  struct Slot {
+    uint64_t key;
+    uint32_t value;
+  };
+
+  size_t home(uint64_t key) const {
+    // Fibonacci hashing; the top bits of the product mix in every key bit
+    return (size_t)((key * 0x9E3779B97F4A7C15ull) >> shift);
+  }
+
+  void grow();
+
+  Slot *slots;
+  size_t mask;
+  size_t count;
+  int shift;
+
+  // Not copyable
+  QueryIndex(const QueryIndex&);
+  QueryIndex& operator=(const QueryIndex&);
+};
+
+#endif // QUERY_INDEX_H
@@ -1,26 +1,159 @@
 #ifndef STRINGHASH_H
 #define STRINGHASH_H
 
+#include <endian.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "SipHash.h"
 
+////////////////////////////////////////////////////////////////////////////////
+// StringHash
+//
+// Hash functor for tables keyed by C strings, with the hash function as a
+// policy:
+//   LaneHasher       fast, non-cryptographic hash built from 32x32->64 bit
+//                    multiplies, so that several names can be hashed at once
+//                    in SIMD lanes. Use for names we generated or trust.
+//   SipHasher<key>   SipHash-2-4 under a secret key, for tables filled from
+//                    packets, where someone could pick names that collide.
+// A policy gives hash(data, size) and hashBatch(names, sizes, n, out), and the
+// two always agree.
+//
+// Usage:
+//   StringHash<LaneHasher> hash;
+//   size_t h = hash(name, size);
+//   hash.hashBatch(names, sizes, n, hashes);
+//
+
+// Per word secrets of the lane hash, used in turn
+extern const uint64_t laneHashSecret[8];
+
+#define LANE_HASH_SEED 0x3EE5789041C98AC3ull
+#define LANE_HASH_PRIME 0x9E3779B97F4A7C15ull
+
+static inline uint64_t laneHashLoad64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return le64toh(v);
+}
+
+static inline uint64_t laneHashLoad32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return le32toh(v);
+}
+
+// Word i of the data, little endian and zero padded past the end, so the word
+// just past data a multiple of 8 long is 0. Only the last word can be partial;
+// it is put together from overlapping loads that stay within the data, rather
+// than byte by byte.
+inline uint64_t laneHashWord(const uint8_t *data, size_t size, size_t i) {
+  size_t offset = i * 8;
+  size_t left = size - offset;
+  if(left >= 8) {
+    return laneHashLoad64(data + offset);
+  } else if(left == 0) {
+    return 0;
+  } else if(size >= 8) {
+    return laneHashLoad64(data + size - 8) >> (64 - left * 8);
+  } else if(left >= 4) {
+    return laneHashLoad32(data) |
+           (laneHashLoad32(data + left - 4) << ((left - 4) * 8));
+  } else if(left > 0) {
+    return data[0] | ((uint64_t)data[left / 2] << (left / 2 * 8)) |
+           ((uint64_t)data[left - 1] << ((left - 1) * 8));
+  }
+  return 0;
+}
+
+inline uint64_t laneHashStart(size_t size, uint64_t seed) {
+  return seed ^ (size * LANE_HASH_PRIME);
+}
+
+// Folds in word i. Only a 32x32->64 bit multiply, a shift and adds, all of
+// which AVX2 has for 64 bit lanes.
+inline uint64_t laneHashRound(uint64_t acc, uint64_t word, size_t i) {
+  uint64_t keyed = word ^ laneHashSecret[i & 7];
+  acc += word + (keyed & 0xFFFFFFFF) * (keyed >> 32);
+  return acc ^ (acc >> 29);
+}
+
+// MurmurHash3's 64 bit finalizer
+inline uint64_t laneHashFinish(uint64_t acc) {
+  acc ^= acc >> 33;
+  acc *= 0xFF51AFD7ED558CCDull;
+  acc ^= acc >> 33;
+  acc *= 0xC4CEB9FE1A85EC53ull;
+  acc ^= acc >> 33;
+  return acc;
+}
+
+inline uint64_t laneHash(const uint8_t *data, size_t size, uint64_t seed) {
+  uint64_t acc = laneHashStart(size, seed);
+  size_t words = (size + 7) / 8;
+  for(size_t i = 0; i < words; i++) {
+    acc = laneHashRound(acc, laneHashWord(data, size, i), i);
+  }
+  return laneHashFinish(acc);
+}
+
+// Hashes n names at once, four at a time with AVX2 where the CPU has it
+void laneHashBatch(const char *const *names, const size_t *sizes, size_t n,
+                   uint64_t seed, uint64_t *out);
+
+struct LaneHasher {
+  static uint64_t hash(const char *data, size_t size) {
+    return laneHash((const uint8_t *)data, size, LANE_HASH_SEED);
+  }
+
+  static void hashBatch(const char *const *names, const size_t *sizes,
+                        size_t n, uint64_t *out) {
+    laneHashBatch(names, sizes, n, LANE_HASH_SEED, out);
+  }
+};
+
+// NOTE: key must have external linkage to be a template argument
+template<const uint8_t *key>
+struct SipHasher {
+  static uint64_t hash(const char *data, size_t size) {
+    return siphash_digest(key, (const uint8_t *)data, size);
+  }
+
+  static void hashBatch(const char *const *names, const size_t *sizes,
+                        size_t n, uint64_t *out) {
+    for(size_t i = 0; i < n; i++) {
+      out[i] = hash(names[i], sizes[i]);
+    }
+  }
+};
+
 struct StringEqual {
   bool operator()(const char *s1, const char *s2) const {
     return (s1 == s2) || (s1 && s2 && strcmp(s1, s2) == 0);
   }
 };
 
-template<const uint8_t *key>
+template<typename Hasher = LaneHasher>
 struct StringHash {
   size_t operator()(const char *s) const {
     if(s == NULL) {
       return 0;
     }
 
-    return siphash_digest(key, (const uint8_t *) s, strlen(s));
+    return Hasher::hash(s, strlen(s));
+  }
+
+  // For callers that already know the length, e.g. from label offsets
+  size_t operator()(const char *s, size_t size) const {
+    return Hasher::hash(s, size);
+  }
+
+  void hashBatch(const char *const *names, const size_t *sizes, size_t n,
+                 uint64_t *out) const {
+    Hasher::hashBatch(names, sizes, n, out);
   }
 };
 
 #endif // STRINGHASH_H
-
@@ -0,0 +1,43 @@
+#ifndef TLD_HASH_H
+#define TLD_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// TLDHash
+//
+// Case-insensitive minimal perfect hash over the valid TLDs. The tables live in
+// ValidTLDs.h, which tools/GenerateTLDHash.cpp writes at build time from
+// query/tools/validTLDs.txt; this is the half the generator and the lookup
+// share.
+//
+// A name's bucket is tldHash(name, 0) % TLD_BUCKETS, and its slot in the name
+// table is tldHash(name, tldSeeds[bucket]) % TLD_SLOTS. The generator picks
+// every bucket's seed so that no two TLDs share a slot, so a lookup is two
+// hashes and one comparison.
+//
+
+// ASCII only lower casing, so that lookups do not depend on the locale
+constexpr uint8_t tldLower(uint8_t c) {
+  return ((uint8_t)(c - 'A') < 26) ? (c | 0x20) : c;
+}
+
+// FNV-1a over the lower cased name, with MurmurHash3's finalizer to spread
+// short names over the whole word
+constexpr uint32_t tldHash(const char *name, size_t size, uint32_t seed) {
+  uint32_t h = 2166136261u ^ seed;
+  for(size_t i = 0; i < size; i++) {
+    h ^= tldLower(name[i]);
+    h *= 16777619u;
+  }
+
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+#endif // TLD_HASH_H
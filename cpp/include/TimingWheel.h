@@ -0,0 +1,105 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// TimingWheel
+//
+// Hierarchical timing wheel holding (expiry, id) timers. Time is whatever
+// clock the caller advances it with; the loader drives it from capture time.
+// Each of the WHEEL_LEVELS levels has WHEEL_SLOTS slots, and a timer lives in
+// the lowest level whose span covers its distance from the current tick, so
+// scheduling is O(1) and each timer is cascaded at most WHEEL_LEVELS - 1 times
+// before it fires.
+//
+// Timers cannot be cancelled. Callers that need to drop a timer should check
+// in the expiry callback whether the id is still live.
+//
+
+#define WHEEL_LEVELS 4
+#define WHEEL_SLOT_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_SLOT_BITS)
+
+class TimingWheel {
+ public:
+  // Timers fire at tick granularity, i.e. up to tickSize late
+  explicit TimingWheel(uint64_t tickSize);
+
+  // Starts the wheel at time now, dropping every pending timer
+  void reset(uint64_t now);
+
+  void schedule(uint64_t expiry, uint64_t id);
+
+  // Moves the wheel forward to time now, calling expire(id) for every timer
+  // that is due. Time never runs backwards; earlier values are ignored.
+  template<typename F>
+  void advance(uint64_t now, F& expire);
+
+  size_t size() const {
+    return count;
+  }
+
+ private:
+  struct Timer {
+    uint64_t tick;
+    uint64_t id;
+  };
+
+  void place(const Timer& timer);
+
+  template<typename F>
+  void step(F& expire);
+
+  std::vector<Timer> slots[WHEEL_LEVELS][WHEEL_SLOTS];
+  std::vector<Timer> cascade;
+  uint64_t tickSize;
+  uint64_t curTick;
+  size_t count;
+};
+
+template<typename F>
+void TimingWheel::advance(uint64_t now, F& expire) {
+  uint64_t target = now / tickSize;
+
+  while(curTick < target) {
+    // Nothing can fire in between, so skip straight to the target tick
+    if(count == 0) {
+      curTick = target;
+      break;
+    }
+    step(expire);
+  }
+}
+
+template<typename F>
+void TimingWheel::step(F& expire) {
+  curTick++;
+
+  // Whenever a level wraps around, pull the next slot of the level above down
+  // into the finer levels
+  for(int level = 1; level < WHEEL_LEVELS; level++) {
+    if((curTick & ((1ull << (level * WHEEL_SLOT_BITS)) - 1)) != 0) {
+      break;
+    }
+
+    size_t slot = (curTick >> (level * WHEEL_SLOT_BITS)) & (WHEEL_SLOTS - 1);
+    cascade.swap(slots[level][slot]);
+    for(size_t i = 0; i < cascade.size(); i++) {
+      place(cascade[i]);
+    }
+    cascade.clear();
+  }
+
+  std::vector<Timer>& due = slots[0][curTick & (WHEEL_SLOTS - 1)];
+  cascade.swap(due);
+  count -= cascade.size();
+  for(size_t i = 0; i < cascade.size(); i++) {
+    expire(cascade[i].id);
+  }
+  cascade.clear();
+}
+
+#endif // TIMING_WHEEL_H
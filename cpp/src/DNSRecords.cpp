@@ -0,0 +1,126 @@
+#include "DNSRecords.h"
+
+#include <string.h>
+
+#include "nameser.h"
+
+static inline uint16_t get16(const uint8_t *p) {
+  return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t get32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// Returns the number of bytes the name at dCur takes on the wire, up to and
+// including its root label or compression pointer, or -1 if it runs past dEnd,
+// is too long or uses a label type other than these two
+static int skipName(const uint8_t *dCur, const uint8_t *dEnd) {
+  const uint8_t *dStart = dCur;
+  while(dCur < dEnd) {
+    uint8_t size = *dCur;
+    if((size & INDIR_MASK) == INDIR_MASK) {
+      return (dEnd - dCur >= 2) ? (dCur + 2) - dStart : -1;
+    } else if(size & INDIR_MASK) {
+      return -1;
+    }
+
+    dCur += size + 1;
+    if(size == 0) {
+      return dCur - dStart;
+    } else if(dCur - dStart > MAXDNAME) {
+      return -1;
+    }
+  }
+  return -1;
+}
+
+DNSRecordWalker::DNSRecordWalker(const uint8_t *data, uint32_t size)
+  : start(data), end(data + size), cur(data + size),
+    section(DNS_SECTION_QUESTION), left(0), failed(false) {
+  memset(&opt, 0, sizeof(opt));
+
+  if(size < sizeof(HEADER)) {
+    memset(counts, 0, sizeof(counts));
+    failed = true;
+    return;
+  }
+
+  cur = data + sizeof(HEADER);
+  for(int i = 0; i < 4; i++) {
+    counts[i] = get16(data + 4 + i * 2);
+  }
+  left = counts[DNS_SECTION_QUESTION];
+}
+
+bool DNSRecordWalker::next(DNSRecord *record) {
+  if(failed) {
+    return false;
+  }
+
+  while(left == 0) {
+    if(section == DNS_SECTION_ADDITIONAL) {
+      return false;
+    }
+    left = counts[++section];
+  }
+
+  int nameSize = skipName(cur, end);
+  if(nameSize < 0) {
+    failed = true;
+    return false;
+  }
+
+  const uint8_t *dCur = cur + nameSize;
+  record->section = (DNSSection)section;
+  record->name = cur;
+  if(section == DNS_SECTION_QUESTION) {
+    if(end - dCur < QFIXEDSZ) {
+      failed = true;
+      return false;
+    }
+
+    record->type = get16(dCur);
+    record->rclass = get16(dCur + 2);
+    record->ttl = 0;
+    record->rdata = NULL;
+    record->rdlength = 0;
+    cur = dCur + QFIXEDSZ;
+  } else {
+    if(end - dCur < RRFIXEDSZ ||
+       end - (dCur + RRFIXEDSZ) < get16(dCur + 8)) {
+      failed = true;
+      return false;
+    }
+
+    record->type = get16(dCur);
+    record->rclass = get16(dCur + 2);
+    record->ttl = get32(dCur + 4);
+    record->rdlength = get16(dCur + 8);
+    record->rdata = dCur + RRFIXEDSZ;
+    cur = record->rdata + record->rdlength;
+
+    // The OPT record's class and TTL fields hold the EDNS fields, and its
+    // owner is the root
+    if(section == DNS_SECTION_ADDITIONAL && record->type == T_OPT &&
+       !opt.present && nameSize == 1) {
+      opt.present = true;
+      opt.udpSize = record->rclass;
+      opt.extRcode = dCur[4];
+      opt.version = dCur[5];
+      opt.dnssecOK = (dCur[6] & 0x80) != 0;
+      opt.options = record->rdata;
+      opt.optionsSize = record->rdlength;
+    }
+  }
+
+  left--;
+  return true;
+}
+
+const DNSEdns& DNSRecordWalker::findEdns() {
+  DNSRecord record;
+  while(!opt.present && next(&record)) {
+  }
+  return opt;
+}
@@ -0,0 +1,120 @@
+#include "LabelCopy.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LABEL_COPY_X86
+#endif
+
+typedef size_t (*LabelCopyFunction)(char *dst, const uint8_t *src, size_t n);
+
+#ifdef LABEL_COPY_X86
+
+// Lower cases 16 bytes from src into dst, and returns a bit mask of the ones
+// that need escaping. SSE2 has no unsigned byte compare, so a <= b is tested
+// as min(a, b) == a.
+static inline int lowerBlock16(char *dst, const uint8_t *src) {
+  __m128i v = _mm_loadu_si128((const __m128i *)src);
+
+  __m128i letter = _mm_sub_epi8(v, _mm_set1_epi8('A'));
+  __m128i upper = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(25)),
+                                 letter);
+  __m128i escape = _mm_or_si128(
+      _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(' ')), v),
+      _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7F)));
+
+  __m128i lower = _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+  _mm_storeu_si128((__m128i *)dst, lower);
+  return _mm_movemask_epi8(escape);
+}
+
+// Handles the last n < 16 bytes through a padded block, so that nothing past
+// the end of either buffer is touched
+static inline size_t lowerTail(char *dst, const uint8_t *src, size_t n) {
+  uint8_t in[16];
+  char out[16];
+  memset(in, 'a', sizeof(in));
+  memcpy(in, src, n);
+
+  int escape = lowerBlock16(out, in);
+  memcpy(dst, out, n);
+  return escape ? __builtin_ctz(escape) : n;
+}
+
+static size_t labelCopySSE2(char *dst, const uint8_t *src, size_t n) {
+  size_t i = 0;
+  for(; i + 16 <= n; i += 16) {
+    int escape = lowerBlock16(dst + i, src + i);
+    if(escape) {
+      return i + __builtin_ctz(escape);
+    }
+  }
+  return (i < n) ? i + lowerTail(dst + i, src + i, n - i) : n;
+}
+
+__attribute__((target("avx2")))
+static size_t labelCopyAVX2(char *dst, const uint8_t *src, size_t n) {
+  size_t i = 0;
+  for(; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+
+    __m256i letter = _mm256_sub_epi8(v, _mm256_set1_epi8('A'));
+    __m256i upper = _mm256_cmpeq_epi8(
+        _mm256_min_epu8(letter, _mm256_set1_epi8(25)), letter);
+    __m256i escape = _mm256_or_si256(
+        _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(' ')), v),
+        _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7F)));
+
+    __m256i lower = _mm256_or_si256(
+        v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+    _mm256_storeu_si256((__m256i *)(dst + i), lower);
+
+    uint32_t mask = _mm256_movemask_epi8(escape);
+    if(mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + labelCopySSE2(dst + i, src + i, n - i);
+}
+
+#else
+
+static size_t labelCopyScalar(char *dst, const uint8_t *src, size_t n) {
+  for(size_t i = 0; i < n; i++) {
+    uint8_t c = src[i];
+    if(c <= ' ' || c == 0x7F) {
+      return i;
+    }
+    dst[i] = ((uint8_t)(c - 'A') < 26) ? (c | 0x20) : c;
+  }
+  return n;
+}
+
+#endif // LABEL_COPY_X86
+
+static LabelCopyFunction selectLabelCopy(const char **version) {
+#ifdef LABEL_COPY_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) {
+    *version = "avx2";
+    return labelCopyAVX2;
+  }
+  *version = "sse2";
+  return labelCopySSE2;
+#else
+  *version = "scalar";
+  return labelCopyScalar;
+#endif
+}
+
+static const char *labelCopyName;
+static const LabelCopyFunction labelCopy = selectLabelCopy(&labelCopyName);
+
+size_t labelCopyLower(char *dst, const uint8_t *src, size_t n) {
+  return labelCopy(dst, src, n);
+}
+
+const char *labelCopyVersion() {
+  return labelCopyName;
+}
@@ -1,17 +1,25 @@
 #include <assert.h>
 #include <dirent.h>
+#include <inttypes.h>
 #include <netinet/udp.h>
 #include <pcap/pcap.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include "Config.h"
+#include "PacketFilter.h"
 #include "ParseDNS.h"
+#include "PayloadRing.h"
+#include "PcapReader.h"
+#include "Pipeline.h"
+#include "QueryIndex.h"
+#include "TimingWheel.h"
 
 using namespace std;
 
@@ -23,29 +31,45 @@ struct Packet {
   uint64_t overallCaptureTime;
   uint32_t sourceIP;
   uint32_t destIP;
-  uint8_t payload[2048];
+  uint64_t payload;  // Offset into payloads
   size_t size;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 // HandlePacket
 //
-// Called from pcap_loop, this function breaks down the packet into its parts
-// (IP, UDP, DNS) and calls all appropriate analysis functions with the
-// necessary information. The compiled pcap rule limits calls to this function
-// to UDP packets arriving/leaving on port 53 for the old/new IP addresses.
+// Called for every captured packet, this function breaks down the packet into
+// its parts (IP, UDP, DNS) and calls all appropriate analysis functions with
+// the necessary information. The compiled pcap rule limits calls to this
+// function to UDP packets arriving/leaving on port 53 for the old/new IP
+// addresses.
 //
 
 struct QRPacketPair {
   Packet query;
   Packet response;
   bool ready;
+  bool expired;
 };
 
-// Holding query+response pairs for future in-order processing
+// Holding query+response pairs for future in-order processing. Pairs are
+// numbered by arrival and live in a ring of QUERY_BUFFER_SIZE entries.
 QRPacketPair *packets;
-int packetProc = 0;
-int packetAdd = 0;
+uint64_t packetProc = 0;
+uint64_t packetAdd = 0;
+
+inline QRPacketPair *packetAt(uint64_t seq) {
+  return &packets[seq % QUERY_BUFFER_SIZE];
+}
+
+// Query and response payloads for the pairs above, stored back to back
+PayloadRing payloads(PAYLOAD_RING_SIZE);
+
+// Pending (unanswered) queries by uniqueID, pointing into packets[]
+QueryIndex pendingQueries;
+
+// Expiry timers for pending queries, in capture time
+TimingWheel queryTimeouts(QUERY_TIMEOUT_TICK);
 
 // Keeping track of the amount of captured time
 uint64_t totalCaptureTime = 0;
@@ -61,102 +85,170 @@ void processQueryResponse(QRPacketPair *pPair) {
   Packet *r = &pPair->response;
 
   // Parsing the DNS response for error conditions
-  query.error = dnsParseResponse(r->payload, r->size);
+  if(pPair->ready) {
+    query.error = dnsParseResponse(payloads.at(r->payload), r->size);
+  } else {
+    query.error = DNS_ERR_UNANSWERED;
+  }
 
   // Parsing the DNS query
-  if(dnsParseQuery(&query, q->payload, q->size) < 0) {
+  if(dnsParseQuery(&query, payloads.at(q->payload), q->size,
+                   ANALYSIS_FIELDS) < 0) {
     assert(false && "Failed to parse a successful DNS query");
   }
 
   // TODO(aliu1): Process the parsed DNS query here. 
 }
 
-void handlePacket(uint8_t *arg, const struct pcap_pkthdr *header,
-                  const uint8_t *packet) {
-  const int datalinkOffset = *((int *)arg);
-  uint64_t time = TIME_S2US(header->ts.tv_sec) + header->ts.tv_usec;
-
-  // Updating the capture time keeping
-  if(isFirstCapturePacket) {
-    captureStartTime = time;
-    captureLastTime = time;
-    isFirstCapturePacket = false;
+// Frees the payloads of every pair that has been processed. Responses are only
+// stored for pairs that are still pending, after their query, so everything
+// before the oldest pending query's payload is done with.
+void releasePayloads() {
+  if(packetProc < packetAdd) {
+    payloads.release(packetAt(packetProc)->query.payload);
+  } else {
+    payloads.release(payloads.end());
   }
-  captureLastTime = time;
+}
 
-  // Grabbing IP information, and applying any necessary rules
-  const struct ip *headerIP = (const struct ip *)(packet + datalinkOffset);
-  const uint8_t *payloadIP = (uint8_t *)headerIP + (headerIP->ip_hl * 4);
-  uint32_t destIP = ntohl(headerIP->ip_dst.s_addr);
-  uint32_t sourceIP = ntohl(headerIP->ip_src.s_addr);
+// Gives up on a query that is still waiting for its response. Timers are never
+// cancelled, so this is also called for queries that have since been answered
+// or released, which are left alone.
+void expireQuery(uint64_t seq) {
+  if(seq < packetProc) {
+    return;
+  }
 
-  if(headerIP->ip_v != 4) {
+  QRPacketPair *pPair = packetAt(seq);
+  if(pPair->ready || pPair->expired) {
     return;
   }
 
-  // Grabbing the UDP information, and applying any necessary rules
-  const struct udphdr *headerUDP = (const struct udphdr *)payloadIP;
-  const uint8_t *payloadUDP = (uint8_t *)headerUDP + 8;
-  const uint16_t payloadUDPSize = ntohs(headerUDP->len) - 8;
-  uint16_t sourcePort = ntohs(headerUDP->source);
-  uint16_t destPort = ntohs(headerUDP->dest);
+  pPair->expired = true;
+  if(pendingQueries.find(pPair->query.uniqueID) == seq % QUERY_BUFFER_SIZE) {
+    pendingQueries.erase(pPair->query.uniqueID);
+  }
+}
+
+// Sink stage of the pipeline (see Pipeline.h), pairing queries with their
+// responses and handing the pairs on in arrival order
+struct QueryResponseSink {
+  // Keeps the capture time and releases queries that have waited too long
+  void onTime(uint64_t time) {
+    if(isFirstCapturePacket) {
+      captureStartTime = time;
+      captureLastTime = time;
+      isFirstCapturePacket = false;
+      queryTimeouts.reset(time);
+    }
+    captureLastTime = time;
+
+    queryTimeouts.advance(time, expireQuery);
+  }
 
-  if(payloadUDPSize > 2048) {
-    fprintf(stderr, "Payload > 2048 bytes, skipping\n");
-    return;
+  // Starts loading the index slot a response will look its query up in, so
+  // the cache misses of a whole batch overlap
+  void prefetch(const DNSPacket& packet) const {
+    if(packet.queryID >= 0 && packet.destIP != OLD_ADDRESS &&
+       packet.destIP != NEW_ADDRESS) {
+      pendingQueries.prefetch(((uint64_t)packet.destIP << 32) |
+                              ((uint64_t)packet.destPort << 16) |
+                              packet.queryID);
+    }
   }
 
+  void onPacket(const DNSPacket& packet);
+};
+
+void QueryResponseSink::onPacket(const DNSPacket& packet) {
   // Grabbing just a tiny bit of DNS information, namely the query ID
   // in order to do query->response matching
-  int queryID = dnsParseID(payloadUDP, payloadUDPSize);
+  int queryID = packet.queryID;
   if(queryID >= 0) {
     // If this is a query, add it to the queue and packet info map so that  we
     // can later match it up with it's response
-    if(destIP == OLD_ADDRESS || destIP == NEW_ADDRESS) {
-      uint64_t uniqueID = ((uint64_t)sourceIP << 32) | ((uint64_t)sourcePort << 16) | queryID;
-
-      packets[packetAdd].query.uniqueID = uniqueID;
-      packets[packetAdd].query.time = time;
-      packets[packetAdd].query.curCaptureTime = captureLastTime - captureStartTime;
-      packets[packetAdd].query.lastCaptureTime = lastCaptureTime;
-      packets[packetAdd].query.overallCaptureTime = totalCaptureTime;
-      packets[packetAdd].query.sourceIP = sourceIP;
-      packets[packetAdd].query.destIP = destIP;
-      packets[packetAdd].query.size = payloadUDPSize;
-      memcpy(packets[packetAdd].query.payload, payloadUDP, payloadUDPSize);
-
-      packets[packetAdd].ready = false;
+    if(packet.destIP == OLD_ADDRESS || packet.destIP == NEW_ADDRESS) {
+      uint64_t uniqueID = ((uint64_t)packet.sourceIP << 32) |
+                          ((uint64_t)packet.sourcePort << 16) | queryID;
+
+      // Making room by releasing the oldest query if the buffer is full
+      if(packetAdd - packetProc == QUERY_BUFFER_SIZE) {
+        expireQuery(packetProc);
+        processQueryResponse(packetAt(packetProc));
+        packetProc++;
+        releasePayloads();
+      }
+
+      QRPacketPair *pPair = packetAt(packetAdd);
+      pPair->query.uniqueID = uniqueID;
+      pPair->query.time = packet.time;
+      pPair->query.curCaptureTime = captureLastTime - captureStartTime;
+      pPair->query.lastCaptureTime = lastCaptureTime;
+      pPair->query.overallCaptureTime = totalCaptureTime;
+      pPair->query.sourceIP = packet.sourceIP;
+      pPair->query.destIP = packet.destIP;
+      pPair->query.size = packet.size;
+      pPair->query.payload = payloads.store(packet.payload, packet.size);
+
+      pPair->ready = false;
+      pPair->expired = false;
+      pendingQueries.insert(uniqueID, packetAdd % QUERY_BUFFER_SIZE);
+      queryTimeouts.schedule(packet.time + QUERY_TIMEOUT, packetAdd);
       packetAdd++;
     } else {
       // Otherwise, this is a result so look for the query packet and pair them
-      uint64_t uniqueID = ((uint64_t)destIP << 32) | ((uint64_t)destPort << 16) | queryID;
-
-      for(int i = packetAdd - 1; i >= packetProc; i--) {
-        if(packets[i].query.uniqueID == uniqueID) {
-          packets[i].response.uniqueID = uniqueID;
-          packets[i].response.time = time;
-          packets[i].response.curCaptureTime = captureLastTime - captureStartTime;
-          packets[i].response.lastCaptureTime = lastCaptureTime;
-          packets[i].response.overallCaptureTime = totalCaptureTime;
-          packets[i].response.sourceIP = sourceIP;
-          packets[i].response.destIP = destIP;
-          packets[i].response.size = payloadUDPSize;
-          memcpy(packets[i].response.payload, payloadUDP, payloadUDPSize);
-          packets[i].ready = true;
-
-          break;
-        }
+      uint64_t uniqueID = ((uint64_t)packet.destIP << 32) |
+                          ((uint64_t)packet.destPort << 16) | queryID;
+
+      uint32_t i = pendingQueries.erase(uniqueID);
+      if(i != QueryIndex::NOT_FOUND) {
+        packets[i].response.uniqueID = uniqueID;
+        packets[i].response.time = packet.time;
+        packets[i].response.curCaptureTime = captureLastTime - captureStartTime;
+        packets[i].response.lastCaptureTime = lastCaptureTime;
+        packets[i].response.overallCaptureTime = totalCaptureTime;
+        packets[i].response.sourceIP = packet.sourceIP;
+        packets[i].response.destIP = packet.destIP;
+        packets[i].response.size = packet.size;
+        packets[i].response.payload = payloads.store(packet.payload,
+                                                     packet.size);
+        packets[i].ready = true;
       }
     }
   }
 
   // Going through the list to check if we can process any more packets. We want
   // to issue packets in the same order as they arrived, just in case analysis
-  // expects times to flow as such
-  while((packetProc < packetAdd) && packets[packetProc].ready) {
-    processQueryResponse(&packets[packetProc]);
+  // expects times to flow as such. Expired queries count as done, so a query
+  // that never gets a response only holds up the ones behind it until it times
+  // out.
+  while(packetProc < packetAdd) {
+    QRPacketPair *pPair = packetAt(packetProc);
+    if(!pPair->ready && !pPair->expired) {
+      break;
+    }
+    processQueryResponse(pPair);
     packetProc++;
   }
+  releasePayloads();
+}
+
+QueryResponseSink sink;
+
+// Called by pcap_loop for captures that libpcap reads for us, where the link
+// type is only known at runtime
+void handlePacket(uint8_t *arg, const struct pcap_pkthdr *header,
+                  const uint8_t *packet) {
+  const int datalinkOffset = *((int *)arg);
+  uint64_t time = TIME_S2US(header->ts.tv_sec) + header->ts.tv_usec;
+  sink.onTime(time);
+
+  DNSPacket parsed;
+  if(header->caplen >= (uint32_t)datalinkOffset &&
+     UDPDNSParser::parse(packet + datalinkOffset,
+                         header->caplen - datalinkOffset, time, &parsed)) {
+    sink.onPacket(parsed);
+  }
 }
 
 inline uint64_t getTimeMilliseconds() {
@@ -165,9 +257,225 @@ inline uint64_t getTimeMilliseconds() {
   return ((uint64_t)curTime.tv_sec * 1000) + (curTime.tv_nsec / 1000000);
 }
 
+int getDatalinkOffset(int datalinkType) {
+  switch(datalinkType) {
+    case DLT_LINUX_SLL:
+      return 16;
+    case DLT_EN10MB:
+      return 14;
+    case DLT_IEEE802:
+      return 22;
+    case DLT_NULL:
+      return 4;
+    case DLT_SLIP:
+    case DLT_PPP:
+      return 24;
+    case DLT_RAW:
+      return 0;
+    default:
+      fprintf(stderr, "Unknown datalink type %d\n", datalinkType);
+      exit(1);
+  }
+}
+
+void compileFilter(pcap_t *pcap, struct bpf_program *bpf) {
+  if(pcap_compile(pcap, bpf, CAPTURE_FILTER, 1, 0) < 0) {
+    fprintf(stderr, "Could not compile filter - %s\n", pcap_geterr(pcap));
+    exit(1);
+  }
+}
+
+// Reads a capture that libpcap has to decode for us, e.g. one the mapped
+// reader does not understand
+void readWithPcap(const char *filePath) {
+  char pcapErrorMsg[PCAP_ERRBUF_SIZE] = { 0 };
+  pcap_t *pcap = pcap_open_offline(filePath, pcapErrorMsg);
+  if(pcap == NULL) {
+    fprintf(stderr, "Could not open '%s' with pcap - %s\n", filePath,
+            pcapErrorMsg);
+    exit(1);
+  }
+
+  struct bpf_program bpf;
+  compileFilter(pcap, &bpf);
+  if(pcap_setfilter(pcap, &bpf) < 0) {
+    fprintf(stderr, "Could not set filter - %s\n", pcap_geterr(pcap));
+    exit(1);
+  }
+  pcap_freecode(&bpf);
+
+  int datalinkOffset = getDatalinkOffset(pcap_datalink(pcap));
+
+  if(pcap_loop(pcap, -1, handlePacket, (uint8_t *)&datalinkOffset) < 0) {
+    fprintf(stderr, "Call to pcap_loop() failed - %s\n", pcap_geterr(pcap));
+    exit(1);
+  }
+
+  pcap_close(pcap);
+}
+
+// Runs a mapped capture through the pipeline for its link type, with the
+// native filter where there is one
+template<typename Link>
+void readMappedNative(PcapReader& reader, PacketView *views, size_t numViews) {
+  FilterRule rule = { FILTER_UDP, CAPTURE_PORT, CAPTURE_HOSTS,
+                      CAPTURE_NUM_HOSTS };
+  PacketFilter<Link> filter(rule);
+  runPipeline<Link, UDPDNSParser>(reader, views, numViews, filter, sink);
+}
+
+template<typename Link>
+void readMappedBPF(PcapReader& reader, PacketView *views, size_t numViews) {
+  BpfFilter<Link> filter(CAPTURE_FILTER);
+  runPipeline<Link, UDPDNSParser>(reader, views, numViews, filter, sink);
+}
+
+// Reads an uncompressed capture in place through the mapped reader. The
+// pipeline is picked once per file from the first packet's link type, since
+// pcapng files only name their link types as interfaces are described;
+// packets of any other link type are skipped.
+void readMapped(PcapReader& reader, const char *filePath) {
+  PacketView views[PIPELINE_BATCH_SIZE];
+  size_t numViews = reader.nextBatch(views, PIPELINE_BATCH_SIZE);
+  if(numViews > 0) {
+    switch(views[0].datalink) {
+      case DLT_EN10MB:
+        readMappedNative<EthernetLink>(reader, views, numViews);
+        break;
+      case DLT_LINUX_SLL:
+        readMappedNative<LinuxSllLink>(reader, views, numViews);
+        break;
+      case DLT_RAW:
+        readMappedNative<RawLink>(reader, views, numViews);
+        break;
+      case DLT_NULL:
+        readMappedBPF<NullLink>(reader, views, numViews);
+        break;
+      case DLT_IEEE802:
+        readMappedBPF<Ieee802Link>(reader, views, numViews);
+        break;
+      case DLT_SLIP:
+        readMappedBPF<SlipLink>(reader, views, numViews);
+        break;
+      case DLT_PPP:
+        readMappedBPF<PppLink>(reader, views, numViews);
+        break;
+      default:
+        fprintf(stderr, "Unknown datalink type %d\n", views[0].datalink);
+        exit(1);
+    }
+  }
+
+  if(reader.error() != NULL) {
+    fprintf(stderr, "Could not read '%s' - %s\n", filePath, reader.error());
+    exit(1);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ProcessFile
+//
+// Runs a single capture file through handlePacket, releases whatever is still
+// pending at the end, and updates the capture time keeping. Returns the length
+// of the capture in microseconds.
+//
+
+uint64_t processFile(const char *filePath) {
+  isFirstCapturePacket = true;
+
+  // Uncompressed pcap/pcapng files are mapped and read in place; anything else
+  // is left to libpcap
+  PcapReader reader;
+  if(reader.open(filePath)) {
+    readMapped(reader, filePath);
+  } else {
+    readWithPcap(filePath);
+  }
+  reader.close();
+
+  // Nothing left to pair, so releasing everything still pending in
+  // order, with unanswered queries reported as such
+  while(packetProc < packetAdd) {
+    processQueryResponse(packetAt(packetProc));
+    packetProc++;
+  }
+  packetAdd = 0;
+  packetProc = 0;
+  pendingQueries.clear();
+  payloads.clear();
+
+  // Keeping track of captured time. A worker only sees the files it was
+  // handed, so these totals cover that worker's share of the capture.
+  isFirstCapture = false;
+  lastCaptureTime = (captureLastTime - captureStartTime);
+  totalCaptureTime += lastCaptureTime;
+
+  return lastCaptureTime;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Worker Pool
+//
+// A fixed number of forked workers pull directory entries off a shared
+// counter until none are left. Per-file results are written back into shared
+// memory so the parent can report on the whole run once the workers exit.
+//
+
+struct FileStats {
+  uint64_t procTime;     // Milliseconds spent processing the file
+  uint64_t captureTime;  // Microseconds of traffic in the file
+  uint64_t nameHits;     // Question name cache hits and misses
+  uint64_t nameMisses;
+  bool done;
+};
+
+struct WorkQueue {
+  int next;              // Next directory entry to hand out
+  int filesDone;
+  uint64_t totalProcTime;
+  FileStats files[1];    // One per directory entry
+};
+
+void runWorker(WorkQueue *queue, struct dirent **entries, const char *dir,
+               int eStart, int eEnd) {
+  int e;
+  while((e = __sync_fetch_and_add(&queue->next, 1)) < eEnd) {
+    if(entries[e]->d_type != DT_REG) {
+      continue;
+    }
+
+    uint64_t startProcTime = getTimeMilliseconds();
+
+    char filePath[512];
+    sprintf(filePath, "%s/%s", dir, entries[e]->d_name);
+
+    int filesDone = queue->filesDone;
+    double perFileProcTime = filesDone ?
+        ((double)queue->totalProcTime / filesDone) : 0;
+    printf("\rProcessing file %s [%04d/%04d] (Avg Proc Time = %lf ms)\n",
+           filePath, (e - eStart), (eEnd - eStart), perFileProcTime);
+    fflush(stdout);
+
+    uint64_t nameHits, nameMisses;
+    dnsNameCacheStats(&nameHits, &nameMisses);
+
+    FileStats *stats = &queue->files[e];
+    stats->captureTime = processFile(filePath);
+    stats->procTime = getTimeMilliseconds() - startProcTime;
+    dnsNameCacheStats(&stats->nameHits, &stats->nameMisses);
+    stats->nameHits -= nameHits;
+    stats->nameMisses -= nameMisses;
+    stats->done = true;
+
+    __sync_fetch_and_add(&queue->totalProcTime, stats->procTime);
+    __sync_fetch_and_add(&queue->filesDone, 1);
+  }
+}
+
 int main(int argc, char **argv) {
   if(argc < 3) {
-    fprintf(stderr, "Usage: %s <capture dir> <output dir> [start file #] [end file #]\n", argv[0]);
+    fprintf(stderr, "Usage: %s <capture dir> <output dir> [start file #] "
+            "[end file #] [worker count]\n", argv[0]);
     exit(1);
   }
 
@@ -185,130 +493,91 @@ int main(int argc, char **argv) {
     exit(1);
   }
 
-  packets = new QRPacketPair[200000];
+  packets = new QRPacketPair[QUERY_BUFFER_SIZE];
 
-  // Using this file to record the capture length (in time) for each file
-  char filePath[512];
-  sprintf(filePath, "%s/%s", outputDir, "capturelen.log");
+  int eStart = (argc >= 4) ? atoi(argv[3]) : 0;
+  int eEnd = (argc >= 5) ? atoi(argv[4]) : numEntries;
+  if(eEnd > numEntries) {
+    eEnd = numEntries;
+  }
 
-  int numEntriesParsed = 0;
+  // Defaulting to one worker per online CPU
+  int numWorkers = (argc >= 6) ? atoi(argv[5]) : 0;
+  if(numWorkers < 1) {
+    numWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if(numWorkers > eEnd - eStart) {
+    numWorkers = eEnd - eStart;
+  }
 
-  int eStart = (argc >= 4) ? atoi(argv[3]) : 0;
-  int eEnd = (argc == 5) ? atoi(argv[4]) : numEntries;
+  size_t queueSize = sizeof(WorkQueue) + numEntries * sizeof(FileStats);
+  WorkQueue *queue = (WorkQueue *)mmap(NULL, queueSize,
+                                       PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if(queue == MAP_FAILED) {
+    fprintf(stderr, "Could not map the work queue\n");
+    exit(1);
+  }
+  queue->next = eStart;
 
-  int child_processes = 0;
-  for(int e = eStart; e < eEnd; e++) {
-    if(entries[e]->d_type == DT_REG) {
-      pid_t child_pid;
-      if ((child_pid = fork()) < 0) {
-        fprintf(stderr, "Failed to fork\n");
-        exit(1);
-      }
-      if (child_pid) {
-        child_processes++;
-      } else {
-        uint64_t startProcTime = getTimeMilliseconds();
-
-        char filePath[512];
-        sprintf(filePath, "%s/%s", argv[1], entries[e]->d_name);
-
-        static double totalProcTime = 0;
-        double perFileProcTime = (e > eStart) ? (totalProcTime / (e - eStart)) : 0;
-        printf("\rProcessing file %s [%04d/%04d] (Avg Proc Time = %lf ms)\n",
-               filePath, (e - eStart), (eEnd - eStart), perFileProcTime);
-        fflush(stdout);
-
-        char pcapErrorMsg[PCAP_ERRBUF_SIZE] = { 0 };
-        pcap_t *pcap = pcap_open_offline(filePath, pcapErrorMsg);
-        if(pcap == NULL) {
-          fprintf(stderr, "Could not open '%s' with pcap - %s\n", filePath,
-                  pcapErrorMsg);
-          exit(1);
-        }
-
-        struct bpf_program bpf;
-        if(pcap_compile(pcap, &bpf, "udp port 53 and (dst host " OLD_ADDRESS_STR
-                        " or dst host " NEW_ADDRESS_STR " or src host "
-                       OLD_ADDRESS_STR " or src host " NEW_ADDRESS_STR ")",
-                       1, 0) < 0) {
-          fprintf(stderr, "Could not compile filter - %s\n", pcap_geterr(pcap));
-          exit(1);
-        }
-        if(pcap_setfilter(pcap, &bpf) < 0) {
-          fprintf(stderr, "Could not set filter - %s\n", pcap_geterr(pcap));
-          exit(1);
-        }
-        pcap_freecode(&bpf);
-
-        int datalinkType = pcap_datalink(pcap);
-
-        int datalinkOffset;
-        switch(datalinkType) {
-          case DLT_LINUX_SLL:
-            datalinkOffset = 16;
-            break;
-          case DLT_EN10MB:
-            datalinkOffset = 14;
-            break;
-          case DLT_IEEE802:
-            datalinkOffset = 22;
-            break;
-          case DLT_NULL:
-            datalinkOffset = 4;
-            break;
-          case DLT_SLIP:
-          case DLT_PPP:
-            datalinkOffset = 24;
-            break;
-          case DLT_RAW:
-            datalinkOffset = 0;
-            break;
-          default:
-            fprintf(stderr, "Unknown datalink type %d\n", datalinkType);
-            exit(1);
-        }
-
-        isFirstCapturePacket = true;
-
-        if(pcap_loop(pcap, -1, handlePacket, (uint8_t *)&datalinkOffset) < 0) {
-          fprintf(stderr, "Call to pcap_loop() failed - %s\n", pcap_geterr(pcap));
-          exit(1);
-        }
-
-        // Going through the list to check if we can process any more packets, with
-        // the relaxed ordering constraint now that we have no more to add/pair
-        while(packetProc < packetAdd) {
-          if(packets[packetProc].ready) {
-            processQueryResponse(&packets[packetProc]);
-          }
-          packetProc++;
-        }
-        packetAdd = 0;
-        packetProc = 0;
-
-        // Keeping track of captured time
-        isFirstCapture = false;
-        lastCaptureTime = (captureLastTime - captureStartTime);
-        totalCaptureTime += lastCaptureTime;
-
-        uint64_t endProcTime = getTimeMilliseconds();
-        totalProcTime += (endProcTime - startProcTime);
-
-        numEntriesParsed++;
-        pcap_close(pcap);
-
-        // Terminate child process.
-        exit(0);
-      }
+  for(int i = 0; i < numWorkers; i++) {
+    pid_t child_pid;
+    if((child_pid = fork()) < 0) {
+      fprintf(stderr, "Failed to fork\n");
+      exit(1);
+    }
+    if(child_pid == 0) {
+      runWorker(queue, entries, argv[1], eStart, eEnd);
+      exit(0);
     }
-    free(entries[e]);
   }
 
   // Reap all child processes.
-  for (int i = 0; i < child_processes; i++) {
-    wait(NULL);
+  for(int i = 0; i < numWorkers; i++) {
+    int status;
+    if(wait(&status) > 0 && !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+      fprintf(stderr, "A worker exited abnormally, results are incomplete\n");
+    }
   }
 
+  // Using this file to record the capture length (in time) for each file
+  char filePath[512];
+  if(snprintf(filePath, sizeof(filePath), "%s/%s", outputDir,
+              "capturelen.log") >= (int)sizeof(filePath)) {
+    fprintf(stderr, "Output path too long in '%s'\n", outputDir);
+    exit(1);
+  }
+  FILE *captureLog = fopen(filePath, "w");
+  if(captureLog == NULL) {
+    fprintf(stderr, "Could not open '%s'\n", filePath);
+    exit(1);
+  }
+
+  uint64_t totalCapture = 0;
+  uint64_t nameHits = 0;
+  uint64_t nameLookups = 0;
+  for(int e = eStart; e < eEnd; e++) {
+    if(queue->files[e].done) {
+      fprintf(captureLog, "%s %" PRIu64 "\n", entries[e]->d_name,
+              queue->files[e].captureTime);
+      totalCapture += queue->files[e].captureTime;
+      nameHits += queue->files[e].nameHits;
+      nameLookups += queue->files[e].nameHits + queue->files[e].nameMisses;
+    }
+  }
+  fclose(captureLog);
+
+  double perFileProcTime = queue->filesDone ?
+      ((double)queue->totalProcTime / queue->filesDone) : 0;
+  printf("Processed %d file(s) with %d worker(s), %lf s of capture "
+         "(Avg Proc Time = %lf ms)\n", queue->filesDone, numWorkers,
+         TIME_US2S(totalCapture), perFileProcTime);
+  printf("Question name cache hit rate %.1lf%% (%" PRIu64 " lookups)\n",
+         nameLookups ? (100.0 * nameHits / nameLookups) : 0.0, nameLookups);
+
+  munmap(queue, queueSize);
+  for(int e = 0; e < numEntries; e++) {
+    free(entries[e]);
+  }
   free(entries);
 }
-
@@ -0,0 +1,69 @@
+#include "PayloadRing.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+PayloadRing::PayloadRing(size_t capacity) : buffer(NULL), mask(0), head(0),
+                                            tail(0) {
+  size_t size = 4096;
+  while(size < capacity) {
+    size <<= 1;
+  }
+
+  buffer = (uint8_t *)malloc(size);
+  assert(buffer != NULL);
+  mask = size - 1;
+}
+
+PayloadRing::~PayloadRing() {
+  free(buffer);
+}
+
+uint64_t PayloadRing::store(const uint8_t *data, size_t size) {
+  for(;;) {
+    // Skipping to the start of the buffer rather than splitting a payload
+    // across the wrap point
+    uint64_t offset = head;
+    if((offset & mask) + size > mask + 1) {
+      offset = (offset | mask) + 1;
+    }
+
+    if(offset + size - tail <= mask + 1) {
+      memcpy(buffer + (offset & mask), data, size);
+      head = offset + size;
+      return offset;
+    }
+
+    grow();
+  }
+}
+
+void PayloadRing::grow() {
+  size_t oldMask = mask;
+  size_t newMask = (mask << 1) | 1;
+  uint8_t *oldBuffer = buffer;
+
+  buffer = (uint8_t *)malloc(newMask + 1);
+  assert(buffer != NULL);
+  mask = newMask;
+
+  // Moving the live bytes to where their logical offsets now point. Doubling
+  // the size keeps every payload that was contiguous contiguous.
+  for(uint64_t offset = tail; offset < head; ) {
+    size_t oldIndex = offset & oldMask;
+    size_t newIndex = offset & newMask;
+    size_t count = head - offset;
+    if(count > oldMask + 1 - oldIndex) {
+      count = oldMask + 1 - oldIndex;
+    }
+    if(count > newMask + 1 - newIndex) {
+      count = newMask + 1 - newIndex;
+    }
+
+    memcpy(buffer + newIndex, oldBuffer + oldIndex, count);
+    offset += count;
+  }
+
+  free(oldBuffer);
+}
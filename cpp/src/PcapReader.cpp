@@ -0,0 +1,364 @@
+#include "PcapReader.h"
+
+#include <fcntl.h>
+#include <pcap/pcap.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PCAP_MAGIC_US         0xA1B2C3D4
+#define PCAP_MAGIC_US_SWAPPED 0xD4C3B2A1
+#define PCAP_MAGIC_NS         0xA1B23C4D
+#define PCAP_MAGIC_NS_SWAPPED 0x4D3CB2A1
+#define PCAP_HEADER_SIZE      24
+#define PCAP_RECORD_SIZE      16
+
+#define PCAPNG_SHB            0x0A0D0D0A
+#define PCAPNG_IDB            0x00000001
+#define PCAPNG_PB             0x00000002
+#define PCAPNG_SPB            0x00000003
+#define PCAPNG_EPB            0x00000006
+#define PCAPNG_BYTE_ORDER     0x1A2B3C4D
+
+#define PCAPNG_OPT_END        0
+#define PCAPNG_OPT_TSRESOL    9
+#define PCAPNG_OPT_TSOFFSET   14
+
+#define LINKTYPE_RAW          101
+
+#define NS_PER_SECOND         1000000000ull
+
+// Link types in files are LINKTYPE_* values, which only differ from the DLT_*
+// values libpcap hands out for a few historical types
+static int linktypeToDatalink(uint32_t linktype) {
+  linktype &= 0xFFFF;
+  return (linktype == LINKTYPE_RAW) ? DLT_RAW : (int)linktype;
+}
+
+static uint64_t toNanoseconds(uint64_t ts, uint64_t unitsPerSecond,
+                              uint64_t offset) {
+  uint64_t seconds = (ts / unitsPerSecond) + offset;
+  uint64_t fraction = ts % unitsPerSecond;
+  if(unitsPerSecond == 1000000) {
+    return (seconds * NS_PER_SECOND) + (fraction * 1000);
+  } else if(unitsPerSecond == NS_PER_SECOND) {
+    return (seconds * NS_PER_SECOND) + fraction;
+  }
+  return (seconds * NS_PER_SECOND) +
+         (uint64_t)(((unsigned __int128)fraction * NS_PER_SECOND) /
+                    unitsPerSecond);
+}
+
+PcapReader::PcapReader() : map(NULL), mapSize(0), cur(NULL), end(NULL),
+                           isNG(false), swapped(false), errorMsg(NULL) {
+}
+
+PcapReader::~PcapReader() {
+  close();
+}
+
+bool PcapReader::fail(const char *msg) {
+  errorMsg = msg;
+  cur = end;
+  return false;
+}
+
+uint16_t PcapReader::get16(const uint8_t *p) const {
+  uint16_t value;
+  memcpy(&value, p, sizeof(value));
+  return swapped ? __builtin_bswap16(value) : value;
+}
+
+uint32_t PcapReader::get32(const uint8_t *p) const {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return swapped ? __builtin_bswap32(value) : value;
+}
+
+bool PcapReader::open(const char *path) {
+  close();
+
+  int fd = ::open(path, O_RDONLY);
+  if(fd < 0) {
+    return fail("could not open file");
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) < 0 || st.st_size < 4) {
+    ::close(fd);
+    return fail("file is empty or unreadable");
+  }
+
+  void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if(addr == MAP_FAILED) {
+    return fail("could not map file");
+  }
+  madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+  map = (const uint8_t *)addr;
+  mapSize = st.st_size;
+  cur = map;
+  end = map + mapSize;
+
+  uint32_t magic;
+  memcpy(&magic, map, sizeof(magic));
+
+  if(magic == PCAPNG_SHB) {
+    isNG = true;
+    return readSectionHeader();
+  }
+
+  isNG = false;
+  uint64_t unitsPerSecond;
+  switch(magic) {
+    case PCAP_MAGIC_US:
+      swapped = false;
+      unitsPerSecond = 1000000;
+      break;
+    case PCAP_MAGIC_US_SWAPPED:
+      swapped = true;
+      unitsPerSecond = 1000000;
+      break;
+    case PCAP_MAGIC_NS:
+      swapped = false;
+      unitsPerSecond = NS_PER_SECOND;
+      break;
+    case PCAP_MAGIC_NS_SWAPPED:
+      swapped = true;
+      unitsPerSecond = NS_PER_SECOND;
+      break;
+    default:
+      close();
+      return fail("not an uncompressed pcap or pcapng file");
+  }
+
+  if(mapSize < PCAP_HEADER_SIZE) {
+    close();
+    return fail("truncated pcap header");
+  }
+
+  Interface iface;
+  iface.datalink = linktypeToDatalink(get32(map + 20));
+  iface.unitsPerSecond = unitsPerSecond;
+  iface.offset = 0;
+  interfaces.push_back(iface);
+
+  cur = map + PCAP_HEADER_SIZE;
+  return true;
+}
+
+void PcapReader::close() {
+  if(map != NULL) {
+    munmap((void *)map, mapSize);
+  }
+  map = NULL;
+  mapSize = 0;
+  cur = NULL;
+  end = NULL;
+  isNG = false;
+  swapped = false;
+  interfaces.clear();
+  errorMsg = NULL;
+}
+
+size_t PcapReader::nextBatch(PacketView *views, size_t max) {
+  size_t n = 0;
+  if(isNG) {
+    while(n < max && nextNG(&views[n])) {
+      n++;
+    }
+  } else {
+    while(n < max && nextClassic(&views[n])) {
+      n++;
+    }
+  }
+  return n;
+}
+
+bool PcapReader::nextClassic(PacketView *view) {
+  if(cur >= end) {
+    return false;
+  }
+  if((size_t)(end - cur) < PCAP_RECORD_SIZE) {
+    return fail("truncated record header");
+  }
+
+  uint32_t caplen = get32(cur + 8);
+  if(caplen > (size_t)(end - cur) - PCAP_RECORD_SIZE) {
+    return fail("truncated record");
+  }
+
+  const Interface& iface = interfaces[0];
+  view->time = toNanoseconds(((uint64_t)get32(cur) * iface.unitsPerSecond) +
+                             get32(cur + 4), iface.unitsPerSecond, 0);
+  view->caplen = caplen;
+  view->len = get32(cur + 12);
+  view->datalink = iface.datalink;
+  view->data = cur + PCAP_RECORD_SIZE;
+
+  cur += PCAP_RECORD_SIZE + caplen;
+  return true;
+}
+
+bool PcapReader::readSectionHeader() {
+  // The byte order magic decides how everything else in the section is read,
+  // including this block's own length
+  if((size_t)(end - cur) < 28) {
+    return fail("truncated section header");
+  }
+
+  uint32_t byteOrder;
+  memcpy(&byteOrder, cur + 8, sizeof(byteOrder));
+  if(byteOrder == PCAPNG_BYTE_ORDER) {
+    swapped = false;
+  } else if(byteOrder == __builtin_bswap32(PCAPNG_BYTE_ORDER)) {
+    swapped = true;
+  } else {
+    return fail("bad section byte order magic");
+  }
+
+  uint32_t blockLen = get32(cur + 4);
+  if(blockLen < 28 || (blockLen % 4) != 0 ||
+     blockLen > (size_t)(end - cur)) {
+    return fail("bad section header length");
+  }
+
+  // Interface ids are per section
+  interfaces.clear();
+  cur += blockLen;
+  return true;
+}
+
+bool PcapReader::readInterface(const uint8_t *body, size_t size) {
+  if(size < 8) {
+    return fail("truncated interface description");
+  }
+
+  Interface iface;
+  iface.datalink = linktypeToDatalink(get16(body));
+  iface.unitsPerSecond = 1000000;
+  iface.offset = 0;
+
+  const uint8_t *opt = body + 8;
+  const uint8_t *optEnd = body + size;
+  while(opt + 4 <= optEnd) {
+    uint16_t code = get16(opt);
+    uint16_t len = get16(opt + 2);
+    const uint8_t *value = opt + 4;
+    if(code == PCAPNG_OPT_END || value + len > optEnd) {
+      break;
+    }
+
+    if(code == PCAPNG_OPT_TSRESOL && len >= 1) {
+      uint8_t resol = value[0];
+      uint64_t units = 1;
+      if(resol & 0x80) {
+        if((resol & 0x7F) > 63) {
+          return fail("bad timestamp resolution");
+        }
+        units = 1ull << (resol & 0x7F);
+      } else {
+        if(resol > 19) {
+          return fail("bad timestamp resolution");
+        }
+        for(int i = 0; i < resol; i++) {
+          units *= 10;
+        }
+      }
+      iface.unitsPerSecond = units;
+    } else if(code == PCAPNG_OPT_TSOFFSET && len >= 8) {
+      uint64_t offset;
+      memcpy(&offset, value, sizeof(offset));
+      iface.offset = swapped ? __builtin_bswap64(offset) : offset;
+    }
+
+    opt = value + ((len + 3) & ~3);
+  }
+
+  interfaces.push_back(iface);
+  return true;
+}
+
+bool PcapReader::nextNG(PacketView *view) {
+  while(cur < end) {
+    if((size_t)(end - cur) < 12) {
+      return fail("truncated block header");
+    }
+
+    uint32_t type;
+    memcpy(&type, cur, sizeof(type));
+    if(type == PCAPNG_SHB) {
+      if(!readSectionHeader()) {
+        return false;
+      }
+      continue;
+    }
+
+    type = get32(cur);
+    uint32_t blockLen = get32(cur + 4);
+    if(blockLen < 12 || (blockLen % 4) != 0 ||
+       blockLen > (size_t)(end - cur)) {
+      return fail("bad block length");
+    }
+
+    const uint8_t *body = cur + 8;
+    size_t bodyLen = blockLen - 12;
+    cur += blockLen;
+
+    switch(type) {
+      case PCAPNG_IDB:
+        if(!readInterface(body, bodyLen)) {
+          return false;
+        }
+        break;
+
+      case PCAPNG_EPB:
+      case PCAPNG_PB: {
+        if(bodyLen < 20) {
+          return fail("truncated packet block");
+        }
+
+        uint32_t ifaceId = (type == PCAPNG_EPB) ? get32(body) : get16(body);
+        uint32_t caplen = get32(body + 12);
+        if(ifaceId >= interfaces.size()) {
+          return fail("packet for unknown interface");
+        }
+        if(caplen > bodyLen - 20) {
+          return fail("truncated packet data");
+        }
+
+        const Interface& iface = interfaces[ifaceId];
+        uint64_t ts = ((uint64_t)get32(body + 4) << 32) | get32(body + 8);
+        view->time = toNanoseconds(ts, iface.unitsPerSecond, iface.offset);
+        view->caplen = caplen;
+        view->len = get32(body + 16);
+        view->datalink = iface.datalink;
+        view->data = body + 20;
+        return true;
+      }
+
+      case PCAPNG_SPB: {
+        if(bodyLen < 4 || interfaces.empty()) {
+          return fail("bad simple packet block");
+        }
+
+        // Simple packet blocks carry no timestamp or captured length
+        uint32_t len = get32(body);
+        view->time = 0;
+        view->caplen = (len < bodyLen - 4) ? len : (uint32_t)(bodyLen - 4);
+        view->len = len;
+        view->datalink = interfaces[0].datalink;
+        view->data = body + 4;
+        return true;
+      }
+
+      default:
+        // Statistics, name resolution, custom blocks, ...
+        break;
+    }
+  }
+
+  return false;
+}
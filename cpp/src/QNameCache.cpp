@@ -0,0 +1,82 @@
+#include "QNameCache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "StringHash.h"
+
+QNameCache::QNameCache(size_t numSets)
+  : nextID(1) {
+  size_t size = 1;
+  while(size < numSets) {
+    size <<= 1;
+  }
+  mask = size - 1;
+
+  // Entries are only touched once they are filled, so they can stay unmapped
+  // until then
+  sets = (Set *)aligned_alloc(64, size * sizeof(Set));
+  entries = (QNameEntry *)malloc(size * QNAME_CACHE_WAYS *
+                                 sizeof(QNameEntry));
+  if(sets == NULL || entries == NULL) {
+    fprintf(stderr, "Could not allocate the question name cache\n");
+    exit(1);
+  }
+  memset(sets, 0, size * sizeof(Set));
+  memset(&counters, 0, sizeof(counters));
+}
+
+QNameCache::~QNameCache() {
+  free(sets);
+  free(entries);
+}
+
+QNameEntry *QNameCache::lookup(const uint8_t *wire, uint16_t wireSize,
+                               bool *found) {
+  *found = false;
+  if(wireSize > MAXDNAME) {
+    return NULL;
+  }
+
+  uint64_t hash = laneHash(wire, wireSize, LANE_HASH_SEED);
+  size_t index = hash & mask;
+  uint32_t tag = (uint32_t)(hash >> 32) | 1;
+  Set *set = &sets[index];
+  QNameEntry *ways = &entries[index * QNAME_CACHE_WAYS];
+
+  for(int w = 0; w < QNAME_CACHE_WAYS; w++) {
+    if(set->tags[w] == tag && set->wireSizes[w] == wireSize &&
+       memcmp(ways[w].wire, wire, wireSize) == 0) {
+      set->referenced |= 1 << w;
+      counters.hits++;
+      *found = true;
+      return &ways[w];
+    }
+  }
+
+  // Clock sweep, taking the first way whose reference bit is clear. Empty
+  // ways never have it set.
+  while(set->referenced & (1 << set->hand)) {
+    set->referenced &= ~(1 << set->hand);
+    set->hand = (set->hand + 1) % QNAME_CACHE_WAYS;
+  }
+  int w = set->hand;
+  set->hand = (set->hand + 1) % QNAME_CACHE_WAYS;
+
+  counters.misses++;
+  if(set->tags[w] != 0) {
+    counters.evictions++;
+  }
+
+  set->tags[w] = tag;
+  set->wireSizes[w] = wireSize;
+  QNameEntry *entry = &ways[w];
+  entry->id = nextID++;
+  if(nextID == 0) {
+    nextID = 1;
+  }
+  entry->wireSize = wireSize;
+  memcpy(entry->wire, wire, wireSize);
+  return entry;
+}
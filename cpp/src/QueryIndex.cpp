@@ -0,0 +1,124 @@
+#include "QueryIndex.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Keeping the table at most half full keeps probe sequences to a slot or two
+#define MAX_LOAD_NUM 1
+#define MAX_LOAD_DEN 2
+
+static size_t roundUpPow2(size_t value) {
+  size_t result = 1;
+  while(result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+static int log2Pow2(size_t value) {
+  int bits = 0;
+  while(((size_t)1 << bits) < value) {
+    bits++;
+  }
+  return bits;
+}
+
+QueryIndex::QueryIndex(size_t capacity) : slots(NULL), mask(0), count(0),
+                                          shift(0) {
+  capacity = roundUpPow2(capacity < 16 ? 16 : capacity);
+
+  slots = (Slot *)malloc(capacity * sizeof(Slot));
+  assert(slots != NULL);
+  mask = capacity - 1;
+  shift = 64 - log2Pow2(capacity);
+  clear();
+}
+
+QueryIndex::~QueryIndex() {
+  free(slots);
+}
+
+void QueryIndex::clear() {
+  // An all-ones value marks an empty slot
+  memset(slots, 0xFF, (mask + 1) * sizeof(Slot));
+  count = 0;
+}
+
+void QueryIndex::insert(uint64_t key, uint32_t value) {
+  assert(value != NOT_FOUND);
+
+  if((count + 1) * MAX_LOAD_DEN > (mask + 1) * MAX_LOAD_NUM) {
+    grow();
+  }
+
+  for(size_t i = home(key); ; i = (i + 1) & mask) {
+    if(slots[i].value == NOT_FOUND) {
+      slots[i].key = key;
+      slots[i].value = value;
+      count++;
+      return;
+    }
+    if(slots[i].key == key) {
+      slots[i].value = value;
+      return;
+    }
+  }
+}
+
+uint32_t QueryIndex::find(uint64_t key) const {
+  for(size_t i = home(key); slots[i].value != NOT_FOUND; i = (i + 1) & mask) {
+    if(slots[i].key == key) {
+      return slots[i].value;
+    }
+  }
+  return NOT_FOUND;
+}
+
+uint32_t QueryIndex::erase(uint64_t key) {
+  size_t i = home(key);
+  for(; slots[i].value != NOT_FOUND; i = (i + 1) & mask) {
+    if(slots[i].key == key) {
+      break;
+    }
+  }
+
+  uint32_t value = slots[i].value;
+  if(value == NOT_FOUND) {
+    return NOT_FOUND;
+  }
+
+  // Backward-shift deletion: pull later entries of the probe run into the hole
+  // unless that would move them in front of their home slot
+  for(size_t j = (i + 1) & mask; slots[j].value != NOT_FOUND;
+      j = (j + 1) & mask) {
+    size_t h = home(slots[j].key);
+    if(((j - h) & mask) >= ((j - i) & mask)) {
+      slots[i] = slots[j];
+      i = j;
+    }
+  }
+  slots[i].value = NOT_FOUND;
+  count--;
+
+  return value;
+}
+
+void QueryIndex::grow() {
+  Slot *oldSlots = slots;
+  size_t oldCapacity = mask + 1;
+  size_t capacity = oldCapacity * 2;
+
+  slots = (Slot *)malloc(capacity * sizeof(Slot));
+  assert(slots != NULL);
+  mask = capacity - 1;
+  shift = 64 - log2Pow2(capacity);
+  clear();
+
+  for(size_t i = 0; i < oldCapacity; i++) {
+    if(oldSlots[i].value != NOT_FOUND) {
+      insert(oldSlots[i].key, oldSlots[i].value);
+    }
+  }
+  free(oldSlots);
+}
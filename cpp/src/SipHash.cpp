@@ -1,5 +1,8 @@
 #include "SipHash.h"
 
+#include <endian.h>
+#include <string.h>
+
 static inline uint64_t rotl64(uint64_t u, int s) {
   return (u << s) | (u >> (64 - s));
 }
@@ -33,35 +36,23 @@ static inline void sipcompress2(uint64_t *v0, uint64_t *v1, uint64_t *v2, uint64
   *v0 ^= m;
 }
 
+// Single unaligned load, which compilers turn into one mov
 static inline uint64_t get64le(void const *data, size_t ix) {
-  uint8_t const *p = (uint8_t const*)data + ix * 8;
-  uint64_t ret = 0;
-
-  for(size_t i = 0; i < 8; ++i) {
-    ret |= (uint64_t)p[i] << (i * 8);
-  }
-
-  return ret;
+  uint64_t ret;
+  memcpy(&ret, (uint8_t const *)data + ix * 8, sizeof(ret));
+  return le64toh(ret);
 }
 
 static inline void put64le(uint64_t v, void *out) {
-  uint8_t *p = (uint8_t *)out;
-
-  for(size_t i = 0; i < 8; ++i) {
-    p[i] = (uint8_t)(v >> (i * 8));
-  }
-}
-
-static inline uint8_t get8(void const *data, size_t ix) {
-  return *((uint8_t const *)data + ix);
+  v = htole64(v);
+  memcpy(out, &v, sizeof(v));
 }
 
 static inline uint64_t siplast(void const *data, size_t size) {
   uint64_t last = 0;
 
-  for(size_t i = 0; i < size % 8; ++i) {
-    last |= (uint64_t)get8(data, size / 8 * 8 + i) << (i * 8);
-  }
+  memcpy(&last, (uint8_t const *)data + size / 8 * 8, size % 8);
+  last = le64toh(last);
   last |= (uint64_t)(size % 256) << (7 * 8);
 
   return last;
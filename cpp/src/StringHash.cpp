@@ -0,0 +1,116 @@
+#include "StringHash.h"
+
+#include <endian.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LANE_HASH_X86
+#endif
+
+typedef void (*LaneHashBatchFunction)(const char *const *names,
+                                      const size_t *sizes, size_t n,
+                                      uint64_t seed, uint64_t *out);
+
+const uint64_t laneHashSecret[8] = {
+  0xE220A8397B1DCDAFull, 0x6E789E6AA1B965F5ull,
+  0x06C45D188009454Full, 0xF88BB8A8724C81EDull,
+  0x1B39896A51A8749Bull, 0x53CB9F0C747EA2EBull,
+  0x2C829ABE1F4532E1ull, 0xC584133AC916AB3Dull
+};
+
+static void laneHashBatchScalar(const char *const *names, const size_t *sizes,
+                                size_t n, uint64_t seed, uint64_t *out) {
+  for(size_t i = 0; i < n; i++) {
+    out[i] = laneHash((const uint8_t *)names[i], sizes[i], seed);
+  }
+}
+
+#ifdef LANE_HASH_X86
+
+// Runs laneHashRound in four lanes, one name each. Names shorter than the
+// longest of the four keep their state once their words run out.
+__attribute__((target("avx2")))
+static void laneHashBatchAVX2(const char *const *names, const size_t *sizes,
+                              size_t n, uint64_t seed, uint64_t *out) {
+  const __m256i low32 = _mm256_set1_epi64x(0xFFFFFFFF);
+
+  size_t i = 0;
+  for(; i + 4 <= n; i += 4) {
+    const uint8_t *data[4];
+    size_t full[4];
+    uint64_t tail[4];
+    uint64_t start[4];
+    size_t words[4];
+    size_t maxWords = 0;
+    for(int lane = 0; lane < 4; lane++) {
+      size_t size = sizes[i + lane];
+      data[lane] = (const uint8_t *)names[i + lane];
+      words[lane] = (size + 7) / 8;
+      full[lane] = size / 8;
+      tail[lane] = htole64(laneHashWord(data[lane], size, full[lane]));
+      start[lane] = laneHashStart(size, seed);
+      if(words[lane] > maxWords) {
+        maxWords = words[lane];
+      }
+    }
+
+    __m256i acc = _mm256_loadu_si256((const __m256i *)start);
+    __m256i remaining = _mm256_set_epi64x(words[3], words[2], words[1],
+                                          words[0]);
+    for(size_t w = 0; w < maxWords; w++) {
+      // Whole words are loaded in place, and everything from the partial
+      // word on comes from tail, which the blend below throws away for lanes
+      // that have run out. Picking the address rather than the value keeps
+      // the lengths from turning into branches.
+      uint64_t lanes[4];
+      for(int lane = 0; lane < 4; lane++) {
+        const uint8_t *word = (w < full[lane]) ? data[lane] + w * 8 :
+                              (const uint8_t *)&tail[lane];
+        lanes[lane] = laneHashLoad64(word);
+      }
+
+      // Built from registers, as a store and reload would stall on
+      // forwarding
+      __m256i word = _mm256_set_epi64x(lanes[3], lanes[2], lanes[1],
+                                       lanes[0]);
+      __m256i keyed = _mm256_xor_si256(word,
+          _mm256_set1_epi64x(laneHashSecret[w & 7]));
+      __m256i product = _mm256_mul_epu32(_mm256_and_si256(keyed, low32),
+                                         _mm256_srli_epi64(keyed, 32));
+      __m256i next = _mm256_add_epi64(acc, _mm256_add_epi64(word, product));
+      next = _mm256_xor_si256(next, _mm256_srli_epi64(next, 29));
+
+      // Lanes with words left are those where remaining > w
+      __m256i active = _mm256_cmpgt_epi64(remaining,
+                                          _mm256_set1_epi64x(w));
+      acc = _mm256_blendv_epi8(acc, next, active);
+    }
+
+    uint64_t result[4];
+    _mm256_storeu_si256((__m256i *)result, acc);
+    for(int lane = 0; lane < 4; lane++) {
+      out[i + lane] = laneHashFinish(result[lane]);
+    }
+  }
+
+  laneHashBatchScalar(names + i, sizes + i, n - i, seed, out + i);
+}
+
+#endif // LANE_HASH_X86
+
+static LaneHashBatchFunction selectLaneHashBatch() {
+#ifdef LANE_HASH_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) {
+    return laneHashBatchAVX2;
+  }
+#endif
+  return laneHashBatchScalar;
+}
+
+static const LaneHashBatchFunction laneHashBatchImpl = selectLaneHashBatch();
+
+void laneHashBatch(const char *const *names, const size_t *sizes, size_t n,
+                   uint64_t seed, uint64_t *out) {
+  laneHashBatchImpl(names, sizes, n, seed, out);
+}
@@ -0,0 +1,48 @@
+#include "TimingWheel.h"
+
+TimingWheel::TimingWheel(uint64_t tickSize) : tickSize(tickSize ? tickSize : 1),
+                                              curTick(0), count(0) {
+}
+
+void TimingWheel::reset(uint64_t now) {
+  for(int level = 0; level < WHEEL_LEVELS; level++) {
+    for(int slot = 0; slot < WHEEL_SLOTS; slot++) {
+      slots[level][slot].clear();
+    }
+  }
+  curTick = now / tickSize;
+  count = 0;
+}
+
+void TimingWheel::schedule(uint64_t expiry, uint64_t id) {
+  // Rounding up so that a timer never fires before its expiry time
+  Timer timer;
+  timer.tick = (expiry / tickSize) + ((expiry % tickSize) ? 1 : 0);
+  timer.id = id;
+
+  if(timer.tick <= curTick) {
+    timer.tick = curTick + 1;
+  }
+
+  place(timer);
+  count++;
+}
+
+void TimingWheel::place(const Timer& timer) {
+  uint64_t tick = (timer.tick < curTick) ? curTick : timer.tick;
+  uint64_t delta = tick - curTick;
+
+  for(int level = 0; level < WHEEL_LEVELS; level++) {
+    if(delta < (1ull << ((level + 1) * WHEEL_SLOT_BITS))) {
+      size_t slot = (tick >> (level * WHEEL_SLOT_BITS)) & (WHEEL_SLOTS - 1);
+      slots[level][slot].push_back(timer);
+      return;
+    }
+  }
+
+  // Beyond the span of the wheel, so park the timer in the top level slot that
+  // will be cascaded last and let it be placed again from there
+  const int top = WHEEL_LEVELS - 1;
+  size_t slot = ((curTick >> (top * WHEEL_SLOT_BITS)) - 1) & (WHEEL_SLOTS - 1);
+  slots[top][slot].push_back(timer);
+}
@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "TLDHash.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+// GenerateTLDHash
+//
+// Build step writing ValidTLDs.h, the tables for TLDHash.h, from the TLD list
+// the query tools use. Each line of the list names a TLD as the first quoted
+// string on it, e.g. validTLDs.insert("ac"); validTLDs.insert("AC");
+//
+// Usage:
+//   ./generatetldhash <validTLDs.txt> <ValidTLDs.h>
+//
+
+// Average number of TLDs per bucket to start with
+#define TLDS_PER_BUCKET 4
+
+// Largest seed tried for a bucket before starting over with more buckets
+#define MAX_SEED 0xFFFF
+
+static vector<string> readTLDs(const char *path) {
+  FILE *file = fopen(path, "r");
+  if(file == NULL) {
+    fprintf(stderr, "Could not open '%s'\n", path);
+    exit(1);
+  }
+
+  vector<string> tlds;
+  char line[1024];
+  while(fgets(line, sizeof(line), file) != NULL) {
+    char *start = strchr(line, '"');
+    char *end = start ? strchr(start + 1, '"') : NULL;
+    if(end == NULL || end == start + 1) {
+      continue;
+    }
+
+    string tld;
+    for(char *c = start + 1; c < end; c++) {
+      tld += tldLower(*c);
+    }
+    tlds.push_back(tld);
+  }
+  fclose(file);
+
+  sort(tlds.begin(), tlds.end());
+  tlds.erase(unique(tlds.begin(), tlds.end()), tlds.end());
+  return tlds;
+}
+
+static uint32_t hashTLD(const string& tld, uint32_t seed) {
+  return tldHash(tld.data(), tld.size(), seed);
+}
+
+// Finds a seed for every bucket such that the TLDs land in distinct slots.
+// Buckets are placed largest first, while there is the most room. Returns
+// false if some bucket has no seed up to MAX_SEED.
+static bool placeBuckets(const vector<string>& tlds, uint32_t numBuckets,
+                         vector<uint16_t> *seeds, vector<int> *slots) {
+  uint32_t numSlots = tlds.size();
+  vector<vector<int> > buckets(numBuckets);
+  for(size_t i = 0; i < tlds.size(); i++) {
+    buckets[hashTLD(tlds[i], 0) % numBuckets].push_back(i);
+  }
+
+  vector<uint32_t> order(numBuckets);
+  for(uint32_t b = 0; b < numBuckets; b++) {
+    order[b] = b;
+  }
+  stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return buckets[a].size() > buckets[b].size();
+  });
+
+  seeds->assign(numBuckets, 0);
+  slots->assign(numSlots, -1);
+  for(uint32_t b : order) {
+    const vector<int>& bucket = buckets[b];
+    if(bucket.empty()) {
+      break;
+    }
+
+    uint32_t seed;
+    vector<uint32_t> taken;
+    for(seed = 1; seed <= MAX_SEED; seed++) {
+      taken.clear();
+      for(int tld : bucket) {
+        uint32_t slot = hashTLD(tlds[tld], seed) % numSlots;
+        if((*slots)[slot] != -1 ||
+           find(taken.begin(), taken.end(), slot) != taken.end()) {
+          break;
+        }
+        taken.push_back(slot);
+      }
+      if(taken.size() == bucket.size()) {
+        break;
+      }
+    }
+    if(seed > MAX_SEED) {
+      return false;
+    }
+
+    (*seeds)[b] = seed;
+    for(size_t i = 0; i < bucket.size(); i++) {
+      (*slots)[taken[i]] = bucket[i];
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if(argc != 3) {
+    fprintf(stderr, "Usage: %s <validTLDs.txt> <ValidTLDs.h>\n", argv[0]);
+    exit(1);
+  }
+
+  vector<string> tlds = readTLDs(argv[1]);
+  if(tlds.empty()) {
+    fprintf(stderr, "No TLDs in '%s'\n", argv[1]);
+    exit(1);
+  }
+
+  uint32_t numBuckets = (tlds.size() + TLDS_PER_BUCKET - 1) / TLDS_PER_BUCKET;
+  vector<uint16_t> seeds;
+  vector<int> slots;
+  while(!placeBuckets(tlds, numBuckets, &seeds, &slots)) {
+    numBuckets += numBuckets / 4 + 1;
+  }
+
+  FILE *out = fopen(argv[2], "w");
+  if(out == NULL) {
+    fprintf(stderr, "Could not create '%s'\n", argv[2]);
+    exit(1);
+  }
+
+  fprintf(out, "// Generated by GenerateTLDHash from %zu TLDs - do not edit\n",
+          tlds.size());
+  fprintf(out, "#ifndef VALID_TLDS_H\n#define VALID_TLDS_H\n\n");
+  fprintf(out, "#include \"TLDHash.h\"\n\n");
+  fprintf(out, "constexpr uint32_t TLD_BUCKETS = %u;\n", numBuckets);
+  fprintf(out, "constexpr uint32_t TLD_SLOTS = %zu;\n\n", tlds.size());
+
+  fprintf(out, "constexpr uint16_t tldSeeds[TLD_BUCKETS] = {");
+  for(uint32_t b = 0; b < numBuckets; b++) {
+    fprintf(out, "%s%u", (b == 0) ? "\n  " : (b % 12) ? ", " : ",\n  ",
+            seeds[b]);
+  }
+  fprintf(out, "\n};\n\n");
+
+  fprintf(out, "constexpr uint8_t tldSizes[TLD_SLOTS] = {");
+  for(size_t s = 0; s < slots.size(); s++) {
+    fprintf(out, "%s%zu", (s == 0) ? "\n  " : (s % 16) ? ", " : ",\n  ",
+            tlds[slots[s]].size());
+  }
+  fprintf(out, "\n};\n\n");
+
+  fprintf(out, "constexpr const char *tldNames[TLD_SLOTS] = {\n");
+  for(size_t s = 0; s < slots.size(); s++) {
+    fprintf(out, "  \"%s\",\n", tlds[slots[s]].c_str());
+  }
+  fprintf(out, "};\n\n#endif // VALID_TLDS_H\n");
+
+  if(fclose(out) != 0) {
+    fprintf(stderr, "Could not write '%s'\n", argv[2]);
+    exit(1);
+  }
+  return 0;
+}
@@ -5,10 +5,66 @@
 #define MONGODB_URL "mongodb://localhost:27017"
 #define MONGODB_DB_NAME "ctest"
 #define MONGODB_COLLECTION "test"
+// Documents in the first bulk insert of each worker. Later ones are sized to
+// take about MONGODB_TARGET_LATENCY seconds to send, from how long the ones
+// before took, within MONGODB_INSERT_MIN and MONGODB_INSERT_MAX documents.
 #define MONGODB_INSERT_CACHE 10000
+#define MONGODB_INSERT_MIN 1000
+#define MONGODB_INSERT_MAX 100000
+#define MONGODB_TARGET_LATENCY 0.25
+// Parsed fields stored with each packet's time and addresses (DNS_FIELD_* in
+// dns.h). Anything left out is not parsed at all, e.g. DNS_FIELD_QTYPE alone
+// is enough for queries per second by type.
+#define MONGODB_FIELDS DNS_FIELD_ALL
 
 /* set this value to zero to avoid saving to the database */
 #define USE_MONGODB 1
 
+// Run the workers as threads of one process, sharing a pool of database
+// clients, rather than as forked processes with a client each
+#define WORKER_THREADS 1
+/* most database connections the worker threads share, or zero for one per
+ * writer */
+#define MONGODB_POOL_SIZE 4
+// Parsed packets each worker hands to its encode thread at a time
+#define PIPELINE_BATCH_SIZE 1024
+// Batches that can wait to be encoded, and bulk inserts that can wait for
+// each writer. Past these the stage before waits, so a slow database holds
+// parsing back.
+#define PIPELINE_ENCODE_DEPTH 8
+#define PIPELINE_WRITE_DEPTH 2
+// Threads per worker sending bulk inserts, and so the most it has in flight
+#define PIPELINE_WRITERS 2
+
+// Sets of 8 question names each worker caches, keyed on their wire bytes.
+// Each name takes about 520 bytes.
+#define NAME_CACHE_SETS 1024
+// Bytes at a time the per-worker arena for parsed packets grows by. It is
+// reset whenever a batch of PIPELINE_BATCH_SIZE packets is handed on.
+#define ARENA_BLOCK_SIZE (1 << 20)
+
+// Per-replica bytes per second of earlier runs, which captures are ordered by
+// to run the longest first. Relative to the working directory.
+#define SCHEDULE_HISTORY_FILE ".multiC_history"
+
+// Gzipped captures at least this large are decoded on several threads
+#define PARALLEL_GZIP_MIN_SIZE (256 << 20)
+/* threads decoding a large capture, or zero for the worker's share of the
+ * online CPUs. Each worker can be decoding one, so a fixed count here runs up
+ * to that many times the worker count. */
+#define PARALLEL_GZIP_THREADS 0
+// Compressed bytes each thread decodes at a time
+#define PARALLEL_GZIP_CHUNK_SIZE (4 << 20)
+
+/* threads parsing a single capture, or zero for the worker's share of the
+ * online CPUs, as for PARALLEL_GZIP_THREADS */
+#define PARALLEL_PARSE_THREADS 0
+// Uncompressed captures at least this large are split up between the threads
+#define PARALLEL_PARSE_MIN_SIZE (64 << 20)
+// Bytes of an uncompressed capture each thread parses at a time
+#define PARALLEL_PARSE_CHUNK_SIZE (8 << 20)
+// Uncompressed bytes per frame written by pcapRecompress
+#define SEEKABLE_FRAME_SIZE (4 << 20)
+
 #endif
 
@@ -0,0 +1,64 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "util.h"
+
+/*
+ * Bump allocator for data that lives until a known point, such as parse
+ * results that are only needed until the database batch holding them is
+ * flushed. Allocations are carved out of large blocks and never freed one at a
+ * time; arenaReset() takes them all back at once. Blocks are kept across
+ * resets, so once an arena has grown to its working size it stops calling
+ * malloc altogether.
+ *
+ * Allocations are aligned to ARENA_ALIGN bytes. Not thread safe.
+ */
+
+#define ARENA_ALIGN 8
+
+typedef struct arena_block {
+  struct arena_block *next;
+  size_t size;
+  size_t used;
+  uint8_t data[];
+} arena_block_t;
+
+typedef struct {
+  arena_block_t *first;
+  arena_block_t *current;   /* block allocations come from, or NULL */
+  size_t blockSize;
+  size_t used;              /* bytes handed out since the last reset */
+  size_t reserved;          /* bytes held in blocks */
+} arena_t;
+
+/*
+ * Sets up an empty arena that grows blockSize bytes at a time. Nothing is
+ * allocated until the first arenaAlloc().
+ */
+void arenaInit(arena_t *arena, size_t blockSize);
+
+/*
+ * Returns size bytes from the arena, or NULL if out of memory. Allocations
+ * larger than the block size get a block of their own.
+ */
+void *arenaAlloc(arena_t *arena, size_t size);
+
+/*
+ * Returns zeroed memory, as calloc does.
+ */
+void *arenaCalloc(arena_t *arena, size_t count, size_t size);
+
+/*
+ * Frees everything allocated since the last reset, keeping the blocks.
+ */
+void arenaReset(arena_t *arena);
+
+/*
+ * Frees the blocks as well.
+ */
+void arenaFree(arena_t *arena);
+
+#endif
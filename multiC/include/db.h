@@ -1,20 +1,49 @@
 #ifndef DB_H
 #define DB_H
 
+#include "arena.h"
 #include "dns.h"
 
+/*
+ * Sets up the pool of database clients the process's workers share, holding
+ * at most poolSize connections. Called once per process, before any worker
+ * connects. Without enabled nothing is sent, and the workers only parse.
+ */
+void dbInit(int poolSize, bool enabled);
+
+/*
+ * Closes the pool, once every worker has disconnected.
+ */
+void dbCleanup();
+
 /* 
- * Sets up the connection to the database
+ * Starts the calling worker's insert pipeline: a thread encoding its parsed
+ * packets into bulk inserts, and PIPELINE_WRITERS threads sending those with
+ * clients taken from the pool. The bulk inserts are sized by how long the
+ * last ones took to send.
  */
 void connectToDB();
 
 /*
- * Cache the inserts and then bulk insert when a treshold's met
+ * Fields of the parsed DNS data that insertIntoDB stores, for parseDNSFields
+ */
+uint32_t dbFields();
+
+/*
+ * Arena the calling worker's parsed packets are allocated from. It is reset whenever the cached
+ * inserts are sent, since they no longer need the packets' data then.
+ */
+void dbSetArena(arena_t *arena);
+
+/*
+ * Cache the inserts and then bulk insert when a treshold's met. The packet is
+ * copied into a batch for the encode thread, waiting if the pipeline is full.
  */
 void insertIntoDB(dns_t *dns);
 
 /*
- * Disconnect from the DB, insert any still cached inserts
+ * Disconnect from the DB, insert any still cached inserts, and print how busy
+ * each stage of the pipeline was and how the bulk inserts went
  */
 void disconnectDB();
 
@@ -0,0 +1,89 @@
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "util.h"
+
+// Size of the deflate history window.
+#define DEFLATE_WINDOW_SIZE 32768
+
+// Marked output values from here up stand for byte (value - DEFLATE_MARKER)
+// of the unknown window that preceded the decoded data.
+#define DEFLATE_MARKER 32768
+
+typedef struct deflate_decoder deflate_decoder_t;
+
+// The end of a gzip member within a chunk's output.
+typedef struct {
+  size_t offset;            /* into the marked output followed by the bytes */
+  uint32_t crc;             /* CRC-32 and length from the member trailer */
+  uint32_t size;
+} deflate_member_end_t;
+
+/*
+ * The output of decoding a run of deflate blocks. When decoding starts without
+ * knowing the window, output is "marked" (16 bits per byte) until it no longer
+ * depends on the window, and plain bytes after that.
+ */
+typedef struct {
+  uint64_t startBit;        /* bit offset of the first block */
+  uint64_t endBit;          /* bit offset decoding stopped at */
+  bool streamEnd;           /* the last gzip member ended */
+
+  const uint16_t *marked;   /* values < 256 are bytes, the rest markers */
+  size_t markedLen;
+  const uint8_t *bytes;     /* output following the marked part */
+  size_t bytesLen;
+  deflate_member_end_t *memberEnds;
+  size_t numMemberEnds;
+
+  // Buffers behind the output, kept between decodes of the same chunk.
+  uint16_t *markedBuf;
+  size_t markedCap;
+  uint8_t *byteBuf;
+  size_t byteCap;
+  size_t memberEndsCap;
+} deflate_chunk_t;
+
+deflate_decoder_t *deflateDecoderNew(void);
+
+void deflateDecoderFree(deflate_decoder_t *decoder);
+
+/*
+ * Decodes the deflate stream in data from bit offset startBit, which must be
+ * the start of a block. Decoding carries on through the ends of gzip members
+ * into any member that follows, and stops at the first dynamic, non-final
+ * block starting at or after stopBit, or when the stream ends. window holds
+ * the windowLen (at most DEFLATE_WINDOW_SIZE) bytes that precede startBit; if
+ * it is NULL, they are unknown and references to them are marked.
+ *
+ * Returns 0 on success, or -1 if the data is not a valid deflate stream.
+ */
+int deflateDecode(deflate_decoder_t *decoder, deflate_chunk_t *chunk,
+    const uint8_t *data, size_t size, uint64_t startBit, uint64_t stopBit,
+    const uint8_t *window, size_t windowLen);
+
+/*
+ * Looks for the first bit offset in [fromBit, toBit) where a dynamic,
+ * non-final block starts, by trying to decode from every candidate up to
+ * stopBit with an unknown window. Returns 0 with chunk holding the output of
+ * the first candidate that decodes cleanly, or -1 if there is none.
+ */
+int deflateFindBlock(deflate_decoder_t *decoder, deflate_chunk_t *chunk,
+    const uint8_t *data, size_t size, uint64_t fromBit, uint64_t toBit,
+    uint64_t stopBit);
+
+/*
+ * Frees the chunk's output buffers.
+ */
+void deflateChunkFree(deflate_chunk_t *chunk);
+
+/*
+ * Returns the length of the gzip member header at the start of data, or 0 if
+ * there is no valid, complete header there.
+ */
+size_t gzipHeaderSize(const uint8_t *data, size_t size);
+
+#endif
@@ -6,6 +6,8 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 
+#include "arena.h"
+#include "nameCache.h"
 #include "util.h"
 
 typedef struct {
@@ -41,10 +43,21 @@ typedef struct {
   dns_header header;
   // For now, we only support one question record.
   dns_record question;
+  uint32_t questionID;  /* name cache ID of the question name, or 0 */
   bool isDNSSEC;
   char *replica;
 } dns_t;
 
+/*
+ * Fields parseDNSFields can be asked for. Members of the fields that are not
+ * asked for are left as they were, and the work for them skipped.
+ */
+#define DNS_FIELD_HEADER 0x01   /* header flags and counts */
+#define DNS_FIELD_QTYPE 0x02    /* question type and class */
+#define DNS_FIELD_QNAME 0x04    /* question name, which is allocated */
+#define DNS_FIELD_EDNS 0x08     /* isDNSSEC */
+#define DNS_FIELD_ALL 0x0F
+
 /*
  * Takes a DNS query packet and parses out the data. This function only parses
  * DNS responses and ignores queries, since the DNS response will have all the
@@ -52,5 +65,28 @@ typedef struct {
  */
 int parseDNS(dns_t *out, const uint8_t *packet, const uint16_t size);
 
+/*
+ * Takes question names from the cache from now on, or allocates them again
+ * given NULL. Applies to the calling thread only. Cached names belong to the
+ * cache and are only valid until the next packet is parsed, so they must not
+ * be freed.
+ */
+void dnsUseNameCache(name_cache_t *cache);
+
+/*
+ * Allocates question names that are not taken from the cache out of the arena
+ * from now on, or with calloc again given NULL, on the calling thread. Names
+ * from the arena belong to it and are only valid until it is reset, so they
+ * must not be freed either.
+ */
+void dnsUseArena(arena_t *arena);
+
+/*
+ * Same as parseDNS, but only parses the given DNS_FIELD_* fields. Whether a
+ * packet is accepted does not depend on the fields.
+ */
+int parseDNSFields(dns_t *out, const uint8_t *packet, const uint16_t size,
+    uint32_t fields);
+
 #endif
 
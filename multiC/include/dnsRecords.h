@@ -0,0 +1,96 @@
+#ifndef DNS_RECORDS_H
+#define DNS_RECORDS_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "util.h"
+
+/*
+ * Single pass over every resource record of a DNS message: the questions, then
+ * the answer, authority and additional sections. Nothing is copied or
+ * allocated; records point back into the message, and every read is checked
+ * against its end. Owner names are only skipped, so a compression pointer ends
+ * a name wherever it points; dnsExpandName() follows the pointers.
+ *
+ * The walk stops at the first record that does not fit in the message, or
+ * whose name is malformed, and sets error. The first OPT record of the
+ * additional section (RFC 6891) is decoded into edns as the walk passes it.
+ */
+
+#define DNS_SECTION_QUESTION 0
+#define DNS_SECTION_ANSWER 1
+#define DNS_SECTION_AUTHORITY 2
+#define DNS_SECTION_ADDITIONAL 3
+
+#define DNS_TYPE_OPT 41
+
+typedef struct {
+  uint8_t section;          /* DNS_SECTION_* */
+  const uint8_t *name;      /* owner name, ending in a root label or pointer */
+  uint16_t type;
+  uint16_t class;
+  uint32_t ttl;             /* zero for questions */
+  uint16_t rdlength;
+  const uint8_t *rdata;     /* NULL for questions */
+} dns_rr_t;
+
+typedef struct {
+  bool present;
+  uint16_t udpSize;         /* requestor's UDP payload size */
+  uint8_t extRcode;         /* upper 8 bits of the 12 bit RCODE */
+  uint8_t version;
+  bool dnssecOK;            /* DO bit */
+  uint16_t optionsLength;
+  const uint8_t *options;   /* {code, length, data} options */
+} dns_edns_t;
+
+typedef struct {
+  const uint8_t *packet;
+  const uint8_t *end;
+  const uint8_t *cur;
+  uint16_t counts[4];
+  int section;
+  uint16_t left;
+  bool error;
+  dns_edns_t edns;
+} dns_walker_t;
+
+/*
+ * Starts a walk over the message. Messages too short for a header have no
+ * records and set error.
+ */
+void dnsWalkerInit(dns_walker_t *walker, const uint8_t *packet,
+    uint16_t size);
+
+/*
+ * Moves to the next record. Returns false once there are none left or the
+ * message turns out to be malformed.
+ */
+bool dnsWalkerNext(dns_walker_t *walker, dns_rr_t *rr);
+
+/*
+ * Walks on until the OPT record has been passed or there are no records left,
+ * for callers that only want the EDNS fields.
+ */
+const dns_edns_t *dnsWalkerEDNS(dns_walker_t *walker);
+
+/*
+ * Steps through the options of an OPT record, starting from
+ * *cur = edns->options. Returns false at the end of the options or at one that
+ * runs past them.
+ */
+bool dnsNextOption(const dns_edns_t *edns, const uint8_t **cur,
+    uint16_t *code, uint16_t *length, const uint8_t **data);
+
+/*
+ * Writes the name at name, e.g. a record's owner or a name in its RDATA, to out
+ * as dot terminated text ("." for the root), following compression pointers.
+ * Pointers may only point back to before the labels they end, so they cannot
+ * loop. Returns the length written, or -1 if the name is malformed or does not
+ * fit in outSize bytes with its NUL.
+ */
+int dnsExpandName(const dns_walker_t *walker, const uint8_t *name, char *out,
+    size_t outSize);
+
+#endif
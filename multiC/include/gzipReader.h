@@ -0,0 +1,58 @@
+#ifndef GZIP_READER_H
+#define GZIP_READER_H
+
+#include <inttypes.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#include "parallelGzip.h"
+#include "util.h"
+
+// Size of the buffer compressed data is read into.
+#define GZIP_READER_INPUT_SIZE (1 << 20)
+
+/*
+ * Streaming gzip decoder reading straight from a file descriptor. Files made
+ * of several concatenated gzip members are decoded as one stream, like zcat
+ * does. Files of at least PARALLEL_GZIP_MIN_SIZE bytes are mapped instead and
+ * decoded on several threads.
+ */
+typedef struct {
+  int fd;
+  const uint8_t *map;
+  size_t mapSize;
+  parallel_gzip_t *parallel;
+  z_stream strm;
+  uint8_t *in;
+  bool eof;            /* no more compressed input */
+  bool inMember;       /* part way through a gzip member */
+  bool done;           /* no more decompressed output */
+  double inflateTime;  /* seconds spent reading and inflating */
+  const char *error;
+} gzip_reader_t;
+
+/*
+ * Sets how many threads large files are decoded on when PARALLEL_GZIP_THREADS
+ * is zero. Until it is called, they get one per online CPU.
+ */
+void gzipReaderSetThreads(int threads);
+
+/*
+ * Opens the file for decoding. Returns 0 on success, or -1 with reader->error
+ * set.
+ */
+int gzipReaderOpen(gzip_reader_t *reader, const char *filePath);
+
+/*
+ * Decompresses up to len bytes into out. Returns the number of bytes written,
+ * which is only 0 once the stream has ended, or -1 with reader->error set if
+ * the data is corrupt or cannot be read.
+ */
+ssize_t gzipReaderRead(gzip_reader_t *reader, uint8_t *out, size_t len);
+
+/*
+ * Closes the file and frees the decoder.
+ */
+void gzipReaderClose(gzip_reader_t *reader);
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef JOB_QUEUE_H
+#define JOB_QUEUE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "util.h"
+
+/*
+ * Queue of the captures to process, shared between the parent and the worker
+ * processes it forks. Every job is known before the workers start, so the
+ * parent lays the whole queue out in one shared mapping up front: a descriptor
+ * per job with its path and size, and a deque of job indices per worker, dealt
+ * out round robin in the order the jobs are to run. Handing out a job is then
+ * one or two atomic operations rather than a round trip over a pipe.
+ *
+ * Workers take jobs from the bottom of their own deque and, once it is empty,
+ * steal single jobs from the top of the others', as in the Chase-Lev deque.
+ * No job is ever pushed after the workers start, so the deques never grow.
+ *
+ * Workers record which of them ran each job, how long it took and how many
+ * packets it had, and keep counts of their own, which the parent reads once
+ * they are done.
+ */
+
+#define JOB_QUEUED 0
+#define JOB_RUNNING 1
+#define JOB_DONE 2
+
+typedef struct {
+  uint64_t size;          /* bytes in the file, from stat */
+  uint64_t packets;       /* packets read, once done */
+  double seconds;         /* time taken, once done */
+  uint32_t pathOffset;    /* into the queue's path bytes */
+  int32_t worker;         /* worker that took it, or -1 */
+  uint32_t state;         /* JOB_QUEUED, JOB_RUNNING or JOB_DONE */
+} job_t;
+
+typedef struct {
+  int64_t top;            /* next index thieves take */
+  int64_t bottom;         /* one past the next index the owner takes */
+  uint32_t start;         /* first of the deque's slots */
+  uint32_t jobsDone;
+  uint32_t jobsStolen;    /* of those done, taken from other deques */
+  uint64_t bytesDone;
+  uint64_t packetsDone;
+  double busySeconds;
+} __attribute__((aligned(64))) job_deque_t;
+
+typedef struct {
+  void *map;
+  size_t mapSize;
+  int numWorkers;
+  uint32_t numJobs;
+  job_deque_t *deques;
+  job_t *jobs;
+  uint32_t *slots;        /* job indices, in deque order */
+  char *paths;
+} job_queue_t;
+
+/*
+ * Lays out a queue of the regular files among the numPaths paths for
+ * numWorkers workers, skipping anything else, to run in the order given. It
+ * has to be set up before the workers are forked. Returns 0, or -1 with errno
+ * set if the shared mapping could not be made.
+ */
+int jobQueueInit(job_queue_t *queue, char **paths, int numPaths,
+    int numWorkers);
+
+void jobQueueFree(job_queue_t *queue);
+
+/*
+ * Deals the jobs out again to run in the given order, a permutation of the job
+ * indices. Only valid before the workers are forked.
+ */
+void jobQueueOrder(job_queue_t *queue, const uint32_t *order);
+
+/*
+ * Takes the next job for the worker, from its own deque or else stolen from
+ * another. Returns the job's index, or -1 once every deque is empty.
+ */
+int64_t jobQueueTake(job_queue_t *queue, int worker);
+
+/*
+ * Path of the job, which lives in the shared mapping.
+ */
+const char *jobQueuePath(const job_queue_t *queue, uint32_t job);
+
+/*
+ * Marks a job taken by the worker as done, with the packets it had and the
+ * seconds it took.
+ */
+void jobQueueFinish(job_queue_t *queue, int worker, uint32_t job,
+    uint64_t packets, double seconds);
+
+#endif
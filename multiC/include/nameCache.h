@@ -0,0 +1,74 @@
+#ifndef NAME_CACHE_H
+#define NAME_CACHE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "util.h"
+
+/*
+ * Fixed size cache of question names, keyed on their wire bytes, so that the
+ * few names making up most of the traffic are converted once rather than
+ * allocated and copied for every packet. Each name cached is given an ID that
+ * stays its own for as long as it is cached.
+ *
+ * A name's hash picks a set of NAME_CACHE_WAYS entries, whose tags and wire
+ * lengths fill one cache line. Names in a set are evicted by CLOCK: hits set a
+ * reference bit, and the hand clears referenced entries as it passes over them
+ * looking for a victim.
+ *
+ * Not thread safe; each worker process has its own.
+ */
+
+#define NAME_CACHE_WAYS 8
+
+// Longest wire name cached, the limit RFC 1035 puts on names.
+#define NAME_CACHE_MAX_WIRE 255
+
+typedef struct {
+  uint32_t id;
+  uint16_t wireLength;
+  uint16_t nameLength;
+  uint8_t wire[NAME_CACHE_MAX_WIRE];
+  char name[NAME_CACHE_MAX_WIRE + 1];   /* as parseDNS writes it */
+} name_cache_entry_t;
+
+typedef struct {
+  uint32_t tags[NAME_CACHE_WAYS];       /* hash bits, 0 for empty ways */
+  uint16_t wireLengths[NAME_CACHE_WAYS];
+  uint8_t referenced;                   /* CLOCK bits, one per way */
+  uint8_t hand;                         /* way the clock looks at next */
+} __attribute__((aligned(64))) name_cache_set_t;
+
+typedef struct {
+  name_cache_set_t *sets;
+  name_cache_entry_t *entries;
+  uint32_t mask;
+  uint32_t nextID;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+} name_cache_t;
+
+/*
+ * Allocates a cache of numSets sets, rounded up to a power of two. Returns 0,
+ * or -1 if out of memory.
+ */
+int nameCacheInit(name_cache_t *cache, uint32_t numSets);
+
+void nameCacheFree(name_cache_t *cache);
+
+/*
+ * Returns the entry for the name taking wireLength bytes at wire, root label
+ * included, converting and caching it on a miss. The entry is only valid until
+ * the next lookup. Names longer than NAME_CACHE_MAX_WIRE give NULL.
+ */
+const name_cache_entry_t *nameCacheLookup(name_cache_t *cache,
+    const uint8_t *wire, uint16_t wireLength);
+
+/*
+ * Fraction of lookups that were hits, or 0 before the first.
+ */
+double nameCacheHitRate(const name_cache_t *cache);
+
+#endif
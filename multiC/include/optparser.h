@@ -1,6 +1,13 @@
 #ifndef OPTPARSER_H
 #define OPTPARSER_H
 
-void optparser(int argc, char *argv[], int *workers, char **inputFiles[], int *inputFilesLength);
+#include "util.h"
+
+/*
+ * Parses the input files, the worker count given with -w, -r to interleave
+ * the replicas' captures, and -n to only parse them without the database.
+ */
+void optparser(int argc, char *argv[], int *workers, bool *interleave,
+    bool *noDB, char **inputFiles[], int *inputFilesLength);
 
 #endif
@@ -3,6 +3,10 @@
 
 #include <pcap/pcap.h>
 
+#include "pcapReader.h"
+#include "seekable.h"
+#include "util.h"
+
 #define FILEPATH_REGEX "pcap.(....).[0-9]{10}"
 
 #define REPLICA_MAX_LEN 4
@@ -13,12 +17,53 @@
 void handlePacketCB(uint8_t *arg, const struct pcap_pkthdr *header,
     const uint8_t *packet);
 
+/*
+ * Parses an uncompressed PCAP file that has been mapped by the reader, calling
+ * the callback for every packet that passes the DNS filter.
+ */
+void parsePCAPMapped(pcap_reader_t *reader, char *filePath,
+    void (*cb)(uint8_t *, const struct pcap_pkthdr *, const uint8_t *));
+
+/*
+ * Parses a gzipped PCAP file, inflating it in process and feeding the reader
+ * one buffer at a time. Returns the seconds spent reading and inflating.
+ */
+double parsePCAPGzip(char *filePath,
+    void (*cb)(uint8_t *, const struct pcap_pkthdr *, const uint8_t *));
+
+/*
+ * Parses a seekable zstd or lz4 PCAP file, decoding and filtering its frames on
+ * several threads and calling the callback in capture order. Returns the
+ * seconds spent waiting on the threads.
+ */
+double parsePCAPSeekable(seekable_file_t *file, char *filePath,
+    void (*cb)(uint8_t *, const struct pcap_pkthdr *, const uint8_t *));
+
+/*
+ * Copies the replica a capture came from, as named in its path, into replica,
+ * which holds REPLICA_MAX_LEN + 1 bytes. Returns false, with replica empty, if
+ * the path does not match FILEPATH_REGEX.
+ */
+bool pcapReplica(const char *filePath, char *replica);
+
 /*
  * Analyze the PCAP file. The parameters are the PCAP file, and the callback
- * to handle each packet.
+ * to handle each packet. Returns the number of packets handled.
  */
-void analyzePCAP(char *filePath,
+int analyzePCAP(char *filePath,
     void (*cb)(uint8_t *, const struct pcap_pkthdr *, const uint8_t *));
 
+/*
+ * Shares the online CPUs between the process's workers, which is how many
+ * threads each of them splits a large capture over unless config.h fixes the
+ * counts. Called once, before any worker starts.
+ */
+void analyzeInit(int workers);
+
+/*
+ * Frees the caches analyzePCAP set up for the calling worker.
+ */
+void analyzeCleanup();
+
 #endif
 
@@ -0,0 +1,39 @@
+#ifndef PARALLEL_GZIP_H
+#define PARALLEL_GZIP_H
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#include "util.h"
+
+typedef struct parallel_gzip parallel_gzip_t;
+
+/*
+ * Starts decoding a mapped gzip file on numThreads threads. The file is cut
+ * into fixed size chunks of compressed data; each thread finds the first
+ * deflate block in its chunk by trial decoding and decodes the chunk without
+ * knowing the window that precedes it, marking the bytes that refer back into
+ * it. The reader then resolves the markers with the previous chunk's output
+ * and hands the data out in order. Chunks whose guessed start turns out wrong
+ * are decoded again from the right place.
+ *
+ * Returns NULL if the file does not start with a gzip header or the threads
+ * cannot be started.
+ */
+parallel_gzip_t *parallelGzipOpen(const uint8_t *data, size_t size,
+    int numThreads, size_t chunkSize);
+
+/*
+ * Copies up to len bytes of decompressed data into out, in order. Returns the
+ * number of bytes copied, which is only 0 at the end of the stream, or -1 if
+ * the data is corrupt; *error is then set.
+ */
+ssize_t parallelGzipRead(parallel_gzip_t *gzip, uint8_t *out, size_t len,
+    const char **error);
+
+/*
+ * Stops the threads and frees everything. The mapping stays with the caller.
+ */
+void parallelGzipClose(parallel_gzip_t *gzip);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef PARALLEL_PARSE_H
+#define PARALLEL_PARSE_H
+
+#include <pcap/pcap.h>
+#include <stdint.h>
+
+#include "util.h"
+
+/*
+ * A packet that passed the filter on a parsing thread, waiting to be handed
+ * to the callback.
+ */
+typedef struct {
+  struct pcap_pkthdr header;
+  const uint8_t *data;
+  int datalinkOffset;
+} parsed_packet_t;
+
+// Passed as the start of a unit that has to find its own first record.
+#define PARSE_START_UNKNOWN SIZE_MAX
+
+/*
+ * One independently parsable piece of a capture, e.g. a compressed frame or a
+ * byte range of a mapped file.
+ */
+typedef struct {
+  parsed_packet_t *packets;
+  size_t numPackets;
+  size_t packetsCap;
+  void *buffer;             /* what the packets point into, freed with them */
+  size_t start;             /* input offsets of the first record parsed */
+  size_t end;               /* and of the record the next unit starts at */
+  const char *error;
+} parse_unit_t;
+
+/*
+ * Parses a unit on whichever thread picks it up, from input offset start or,
+ * given PARSE_START_UNKNOWN, from wherever the unit finds the first record.
+ * Returns 0, or -1 with unit->error set.
+ */
+typedef int (*unit_parser_t)(void *ctx, int index, size_t start,
+    parse_unit_t *unit);
+
+/*
+ * Appends a packet to the unit. Returns false if out of memory.
+ */
+bool parseUnitAdd(parse_unit_t *unit, const struct pcap_pkthdr *header,
+    const uint8_t *data, int datalinkOffset);
+
+/*
+ * Parses numUnits units on numThreads threads, at most numThreads + 1 units
+ * ahead of the callback, and calls cb for every packet of every unit on the
+ * calling thread, in unit order. A unit whose start does not match the end of
+ * the one before it guessed wrong, and is parsed again from that end on the
+ * calling thread before it is delivered. *waitTime is set to the seconds spent
+ * waiting on the threads. Returns 0, or -1 with *error set by the first unit
+ * that failed, once the packets it parsed before failing are delivered.
+ */
+int parallelParse(int numUnits, int numThreads, unit_parser_t parseUnit,
+    void *ctx, void (*cb)(uint8_t *, const struct pcap_pkthdr *,
+      const uint8_t *), double *waitTime, const char **error);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef PCAP_READER_H
+#define PCAP_READER_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "util.h"
+
+#define PCAP_READER_MAX_IFACES 16
+
+// Sizes of the classic pcap file header and of each record's header.
+#define PCAP_HEADER_SIZE 24
+#define PCAP_RECORD_SIZE 16
+
+/*
+ * A single packet, pointing into the reader's buffer. The view is only valid
+ * until the buffer changes (or the reader is closed).
+ */
+typedef struct {
+  uint64_t time;        /* nanoseconds since the epoch */
+  uint32_t caplen;      /* bytes available at data */
+  uint32_t len;         /* bytes on the wire */
+  int datalink;         /* DLT_* value of the capturing interface */
+  const uint8_t *data;
+} pcap_view_t;
+
+typedef struct {
+  int datalink;
+  uint64_t unitsPerSecond;  /* timestamp resolution */
+  uint64_t offset;          /* seconds added to every timestamp */
+} pcap_iface_t;
+
+typedef struct {
+  const uint8_t *map;       /* file mapping, if the reader made one */
+  size_t mapSize;
+  const uint8_t *cur;
+  const uint8_t *end;
+  bool final;               /* no data follows end */
+  bool started;             /* file header has been read */
+  bool isNG;
+  bool swapped;
+  pcap_iface_t ifaces[PCAP_READER_MAX_IFACES];
+  int numIfaces;
+  uint32_t snaplen;         /* of a classic file */
+  const char *error;
+} pcap_reader_t;
+
+/*
+ * Maps an uncompressed classic pcap or pcapng file and reads its header.
+ * Returns 0 on success, or -1 with reader->error set if the file cannot be
+ * mapped or is not in either format (e.g. it is still compressed).
+ */
+int pcapReaderOpen(pcap_reader_t *reader, const char *filePath);
+
+/*
+ * Points the reader at the next buffer of a streamed capture, for readers that
+ * are not opened on a file (start from a zeroed reader). Anything left unread
+ * in the previous buffer, i.e. a partial record, must be at the start of the
+ * new one; reader->cur shows where that is. Set final once nothing follows.
+ */
+void pcapReaderFeed(pcap_reader_t *reader, const uint8_t *data, size_t size,
+    bool final);
+
+/*
+ * Fills up to max views with the next packets and returns how many were
+ * filled. Returns 0 at the end of the data, or on a malformed or truncated
+ * record, in which case reader->error is set. A streamed reader also returns 0
+ * without an error when it needs another buffer to finish the next record.
+ */
+size_t pcapReaderNextBatch(pcap_reader_t *reader, pcap_view_t *views,
+    size_t max);
+
+/*
+ * Finds the first classic pcap record at or after from, for starting to read
+ * part way into a file, by checking that it begins a run of plausible record
+ * headers. The reader must be past the file header. Returns reader->end if
+ * there is none.
+ */
+const uint8_t *pcapReaderResync(const pcap_reader_t *reader,
+    const uint8_t *from);
+
+/*
+ * Unmaps the file, if any, and resets the reader.
+ */
+void pcapReaderClose(pcap_reader_t *reader);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "pcapReader.h"
+#include "util.h"
+
+/*
+ * Native stand-in for "udp port 53"-style BPF filters on the link types
+ * captures actually use (Ethernet, Linux cooked and raw IP). A packet passes
+ * exactly when libpcap's code would pass it: an IPv4 packet that is not a
+ * trailing fragment, or an IPv6 packet whose next header is the protocol, with
+ * the port as source or destination. Short packets are rejected at the first
+ * field BPF could not load.
+ */
+
+#define PREFILTER_UDP 0x01
+#define PREFILTER_TCP 0x02
+
+typedef struct {
+  uint8_t protocols;        /* PREFILTER_UDP and/or PREFILTER_TCP */
+  uint16_t port;
+} prefilter_rule_t;
+
+/*
+ * Returns whether the link type has a native filter.
+ */
+bool prefilterSupports(int datalink);
+
+/*
+ * Writes the indices of the views that pass the rule to passed, and returns
+ * how many did. Views of any other link type than datalink, which has to be
+ * supported, fail.
+ */
+size_t prefilterBatch(const prefilter_rule_t *rule, int datalink,
+    const pcap_view_t *views, size_t numViews, uint32_t *passed);
+
+#endif
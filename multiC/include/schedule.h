@@ -0,0 +1,70 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "util.h"
+
+/*
+ * Orders capture files so that the ones expected to take longest run first,
+ * which keeps a large file seen late from becoming the tail of the whole run.
+ * A file's expected time is its size over the bytes per second its replica
+ * managed in earlier runs, kept in a small history file.
+ */
+
+typedef struct {
+  char *replica;
+  double bytesPerSecond;  /* 0 until the first run is committed */
+  uint64_t runBytes;      /* of the current run, not yet committed */
+  double runSeconds;
+} replica_rate_t;
+
+typedef struct {
+  replica_rate_t *rates;
+  int numRates;
+} schedule_history_t;
+
+/*
+ * Reads the history from path. A missing or unreadable file gives an empty
+ * history.
+ */
+void scheduleHistoryLoad(schedule_history_t *history, const char *path);
+
+/*
+ * Writes the history to path. Returns 0, or -1 with errno set.
+ */
+int scheduleHistorySave(const schedule_history_t *history, const char *path);
+
+void scheduleHistoryFree(schedule_history_t *history);
+
+/*
+ * Adds a file of the replica's that took seconds to the current run.
+ */
+void scheduleHistoryAdd(schedule_history_t *history, const char *replica,
+    uint64_t bytes, double seconds);
+
+/*
+ * Folds each replica's rate over the current run into its history, averaging
+ * with what was there before, and starts a new run.
+ */
+void scheduleHistoryCommit(schedule_history_t *history);
+
+/*
+ * Expected seconds for size bytes of the replica. Replicas without a history
+ * are taken to run at the average rate of the others, or one byte per second
+ * if there are none, which still orders files by size.
+ */
+double scheduleEstimate(const schedule_history_t *history,
+    const char *replica, uint64_t size);
+
+/*
+ * Fills order with the indices of the n jobs, longest estimate first. With
+ * interleave set, consecutive jobs come from different replicas as far as
+ * possible, taking each replica's jobs longest first, to spread the reads over
+ * their disks.
+ */
+void scheduleOrder(uint32_t *order, const double *estimates,
+    const char **replicas, uint32_t n, bool interleave);
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef SEEKABLE_H
+#define SEEKABLE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "util.h"
+
+/*
+ * Seekable captures are a series of independent zstd or lz4 frames followed
+ * by a seek table, laid out as in the zstd seekable format: a skippable frame
+ * holding one (compressed size, decompressed size) entry per frame and a
+ * footer with the frame count and SEEKABLE_MAGIC. Both zstd and lz4 skip the
+ * table, so the files still decompress with the stock tools.
+ *
+ * Frames always end on a record boundary, and only the first frame holds the
+ * pcap file header, so every frame can be parsed on its own given the header.
+ */
+
+#define SEEKABLE_MAGIC            0x8F92EAB1
+#define SEEKABLE_SKIPPABLE_MAGIC  0x184D2A5E
+#define SEEKABLE_FOOTER_SIZE      9
+#define SEEKABLE_ENTRY_SIZE       8
+
+typedef enum {
+  SEEKABLE_ZSTD,
+  SEEKABLE_LZ4
+} seekable_codec_t;
+
+typedef struct {
+  size_t offset;            /* of the compressed frame in the file */
+  uint32_t compressedSize;
+  uint32_t size;
+} seekable_frame_t;
+
+typedef struct {
+  const uint8_t *map;
+  size_t mapSize;
+  seekable_codec_t codec;
+  seekable_frame_t *frames;
+  int numFrames;
+  const char *error;
+} seekable_file_t;
+
+/*
+ * Maps the file and reads its seek table. Returns 0 on success, or -1 with
+ * file->error set if it is not a seekable zstd or lz4 file.
+ */
+int seekableOpen(seekable_file_t *file, const char *filePath);
+
+/*
+ * Decompresses the first len bytes of a frame into out, which is all of it
+ * if len is the frame's size. Safe to call from several threads at once.
+ * Returns 0 on success, or -1 if the frame is corrupt.
+ */
+int seekableDecodeFrame(const seekable_file_t *file, int index, uint8_t *out,
+    size_t len);
+
+/*
+ * Unmaps the file and frees the seek table.
+ */
+void seekableClose(seekable_file_t *file);
+
+/*
+ * Writes frames to a seekable file as they are added, and the seek table at
+ * the end.
+ */
+typedef struct {
+  FILE *out;
+  seekable_codec_t codec;
+  int level;
+  uint32_t *entries;        /* compressed and decompressed size per frame */
+  int numFrames;
+  int framesCap;
+  void *buffer;
+  size_t bufferCap;
+} seekable_writer_t;
+
+void seekableWriterOpen(seekable_writer_t *writer, FILE *out,
+    seekable_codec_t codec, int level);
+
+/*
+ * Compresses data as one frame and writes it. Returns 0 on success, or -1 on
+ * a compression or write error.
+ */
+int seekableWriteFrame(seekable_writer_t *writer, const uint8_t *data,
+    size_t size);
+
+/*
+ * Writes the seek table and frees the writer. The file is left open. Returns
+ * 0 on success, or -1 on a write error.
+ */
+int seekableWriterClose(seekable_writer_t *writer);
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "util.h"
+
+/*
+ * Bounded ring of pointers between one producer thread and one consumer
+ * thread, for handing batches from one pipeline stage to the next. Pushing and
+ * popping are lock free while the ring is neither full nor empty. A side that
+ * has to wait spins briefly and then sleeps on a condition variable, which the
+ * other side only signals when it knows someone is asleep. A full ring holds
+ * its producer back, so a slow stage slows down the stages before it.
+ *
+ * The ring keeps counts of how full it was at each push and how long each side
+ * spent waiting, to show which stage holds the pipeline up.
+ */
+
+typedef struct {
+  uint64_t pushes;
+  uint64_t occupancySum;    /* items already waiting at each push */
+  double pushWaitSeconds;   /* producer waiting on a full ring */
+  double popWaitSeconds;    /* consumer waiting on an empty ring */
+} spsc_ring_stats_t;
+
+typedef struct {
+  void **slots;
+  uint32_t capacity;
+  uint32_t mask;
+  pthread_mutex_t lock;
+  pthread_cond_t notEmpty;
+  pthread_cond_t notFull;
+
+  // Written by the consumer.
+  uint64_t head __attribute__((aligned(64)));
+  bool consumerWaiting;
+  double popWaitSeconds;
+
+  // Written by the producer.
+  uint64_t tail __attribute__((aligned(64)));
+  bool producerWaiting;
+  bool closed;
+  uint64_t pushes;
+  uint64_t occupancySum;
+  double pushWaitSeconds;
+} spsc_ring_t;
+
+/*
+ * Sets up an empty ring of capacity slots, rounded up to a power of two.
+ * Returns 0, or -1 if out of memory.
+ */
+int spscRingInit(spsc_ring_t *ring, uint32_t capacity);
+
+void spscRingFree(spsc_ring_t *ring);
+
+/*
+ * Adds an item, waiting while the ring is full.
+ */
+void spscRingPush(spsc_ring_t *ring, void *item);
+
+/*
+ * Takes the oldest item, waiting while the ring is empty. Returns NULL once
+ * the ring is closed and every item pushed has been taken.
+ */
+void *spscRingPop(spsc_ring_t *ring);
+
+/*
+ * Marks the end of the producer's items.
+ */
+void spscRingClose(spsc_ring_t *ring);
+
+/*
+ * Items waiting in the ring. Only a snapshot when read from outside the
+ * consumer, as it may take one at any time.
+ */
+uint32_t spscRingSize(spsc_ring_t *ring);
+
+/*
+ * Copies out the ring's counts. Only exact once both sides are done with it.
+ */
+void spscRingStats(const spsc_ring_t *ring, spsc_ring_stats_t *stats);
+
+#endif
@@ -2,8 +2,16 @@
 #define UTIL_H
 
 #include <stdbool.h>
+#include <time.h>
 
 #define UNUSED(x) ((void)(x))
 
+// Monotonic wall clock time in seconds, for timing stages of the processing.
+static inline double getTimeSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 #endif
 
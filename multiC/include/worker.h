@@ -2,15 +2,26 @@
 #define WORKER_H
 
 #include <pthread.h>
+#include <sys/types.h>
+
+#include "jobQueue.h"
 
 typedef struct {
-  int parent_to_worker_fd[2];
-  int worker_to_parent_fd[2];
+  job_queue_t *queue;
   int index;
-  pid_t pid;
+  pid_t pid;          /* when run as a process */
+  pthread_t thread;   /* when run as a thread */
 } worker_t;
 
+/*
+ * Runs jobs from the queue until there are none left, then flushes the
+ * database inserts and returns.
+ */
 void worker_job(worker_t *worker);
 
-#endif
+/*
+ * worker_job for pthread_create.
+ */
+void *worker_thread(void *worker);
 
+#endif
@@ -0,0 +1,75 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void arenaInit(arena_t *arena, size_t blockSize) {
+  memset(arena, 0, sizeof(*arena));
+  arena->blockSize = blockSize;
+}
+
+void *arenaAlloc(arena_t *arena, size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+  arena_block_t *block = arena->current;
+  if (!block || block->size - block->used < size) {
+    // Move on to the next block kept from before the last reset, or add one
+    // after the current block if that is too small.
+    arena_block_t *next = block ? block->next : arena->first;
+    if (!next || next->size < size) {
+      size_t blockSize = size > arena->blockSize ? size : arena->blockSize;
+      arena_block_t *added = malloc(sizeof(arena_block_t) + blockSize);
+      if (!added) {
+        return NULL;
+      }
+
+      added->size = blockSize;
+      added->used = 0;
+      added->next = next;
+      if (block) {
+        block->next = added;
+      } else {
+        arena->first = added;
+      }
+      arena->reserved += blockSize;
+      next = added;
+    }
+
+    arena->current = block = next;
+  }
+
+  void *p = block->data + block->used;
+  block->used += size;
+  arena->used += size;
+  return p;
+}
+
+void *arenaCalloc(arena_t *arena, size_t count, size_t size) {
+  if (size && count > SIZE_MAX / size) {
+    return NULL;
+  }
+
+  void *p = arenaAlloc(arena, count * size);
+  if (p) {
+    memset(p, 0, count * size);
+  }
+  return p;
+}
+
+void arenaReset(arena_t *arena) {
+  for (arena_block_t *block = arena->first; block; block = block->next) {
+    block->used = 0;
+  }
+  arena->current = arena->first;
+  arena->used = 0;
+}
+
+void arenaFree(arena_t *arena) {
+  arena_block_t *block = arena->first;
+  while (block) {
+    arena_block_t *next = block->next;
+    free(block);
+    block = next;
+  }
+  arenaInit(arena, arena->blockSize);
+}
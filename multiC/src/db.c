@@ -1,108 +1,468 @@
 #include <bson.h>
 #include <bcon.h>
 #include <mongoc.h>
+#include <pthread.h>
+#include <string.h>
 
 #include "config.h"
+#include "spscRing.h"
 #include "util.h"
 #include "db.h"
 
-mongoc_client_t      *client;
-mongoc_database_t    *database;
-mongoc_collection_t  *collection;
-mongoc_bulk_operation_t *bulk;
-uint32_t currentDocIndex;
+// Shared by every worker in the process. Workers only take a client to send a
+// batch, so the pool can hold fewer connections than there are workers.
+static mongoc_uri_t *uri;
+static mongoc_client_pool_t *pool;
 
-char *replica;
+// Whether packets are sent at all, or only parsed.
+static bool dbEnabled = false;
 
-void connectToDB() {
+// Packets on their way from the parse stage to the encode stage. Their
+// strings are copied into the batch, since the parser's are reused once the
+// batch is handed on.
+typedef struct {
+  uint32_t count;
+  arena_t strings;
+  dns_t records[PIPELINE_BATCH_SIZE];
+} record_batch_t;
+
+// A bulk operation on its way from the encode stage to a writer.
+typedef struct {
+  mongoc_bulk_operation_t *bulk;
+  uint32_t numDocs;
+} pending_bulk_t;
+
+// A thread sending bulk operations, each with a client from the pool.
+typedef struct {
+  spsc_ring_t toWrite;        /* bulk operations, encode to write */
+  pthread_t thread;
+  uint32_t *bulkSize;         /* the pipeline's, resized after each send */
+  uint64_t numBulks;
+  double sendSeconds;
+} db_writer_t;
+
+// Each worker's inserts go through a pipeline of stages on their own threads:
+// the worker parses packets into batches, an encode thread turns them into
+// bulk operations, and PIPELINE_WRITERS writers send those, so that many can
+// be in flight while the next are encoded.
+typedef struct {
+  spsc_ring_t toEncode;       /* full batches, parse to encode */
+  spsc_ring_t freeBatches;    /* encoded batches, encode back to parse */
+  db_writer_t writers[PIPELINE_WRITERS];
+  int nextWriter;             /* first one looked at for the next bulk */
+  uint32_t bulkSize;          /* documents per bulk operation */
+  record_batch_t *batches;
+  uint32_t numBatches;
+  uint32_t batchesUsed;       /* of those, handed out at least once */
+  record_batch_t *current;    /* batch being filled by the parser */
+  pthread_t encodeThread;
+} db_pipeline_t;
+
+static __thread db_pipeline_t *pipeline = NULL;
+
+// Per-packet allocations, which are done with once their batch is handed on.
+static __thread arena_t *packetArena = NULL;
+
+void dbInit(int poolSize, bool enabled) {
 #if USE_MONGODB == 1
+  dbEnabled = enabled;
+  if (!dbEnabled) {
+    return;
+  }
+
   // required to init libmongoc's internals
   mongoc_init();
 
-  // create new client instance
-  client = mongoc_client_new(MONGODB_URL);
+  uri = mongoc_uri_new(MONGODB_URL);
+  if (!uri) {
+    fprintf(stderr, "[Error] Invalid MongoDB URL %s\n", MONGODB_URL);
+    exit(1);
+  }
+  pool = mongoc_client_pool_new(uri);
+  mongoc_client_pool_max_size(pool, poolSize);
+#else
+  UNUSED(poolSize);
+  UNUSED(enabled);
+#endif
+}
 
-  // get a handle on the database and collection
-  database = mongoc_client_get_database(client, MONGODB_DB_NAME);
-  collection = mongoc_client_get_collection(client, MONGODB_DB_NAME, MONGODB_COLLECTION);
-  bulk = mongoc_collection_create_bulk_operation(collection, true, NULL);
-  currentDocIndex = 0;
+void dbCleanup() {
+#if USE_MONGODB == 1
+  if (!dbEnabled) {
+    return;
+  }
+  mongoc_client_pool_destroy(pool);
+  mongoc_uri_destroy(uri);
+  mongoc_cleanup();
 #endif
 }
 
-void insertIntoDB(dns_t *dns) {
 #if USE_MONGODB == 1
+// Builds the document for one packet in doc.
+static void encodeDocument(bson_t *doc, const dns_t *dns) {
   uint64_t packetTime = (dns->packetTime.tv_sec * (uint64_t)1000) + (dns->packetTime.tv_usec / 1000);
 
-  bson_t *doc, reply;
-  bson_error_t error;
-  bool retval;
-
   char reqIP[16] = {0};
   char resIP[16] = {0};
 
   inet_ntop(AF_INET, &dns->reqIP, reqIP, 16);
   inet_ntop(AF_INET, &dns->resIP, resIP, 16);
 
-  if (dns->question.name == NULL) {
-    dns->question.name = "";
-  }
-
-  doc = BCON_NEW(
+  bson_reinit(doc);
+  BCON_APPEND(doc,
           "node", BCON_UTF8(dns->replica),
           "time", BCON_DATE_TIME(packetTime),
           "reqIP", BCON_UTF8(reqIP),
-          "resIP", BCON_UTF8(resIP),
+          "resIP", BCON_UTF8(resIP)
+      );
+
+  if (MONGODB_FIELDS & DNS_FIELD_HEADER) {
+    BCON_APPEND(doc,
           "aa", BCON_BOOL(dns->header.aa),
           "tc", BCON_BOOL(dns->header.tc),
           "rd", BCON_BOOL(dns->header.rd),
           "ra", BCON_BOOL(dns->header.ra),
-          "rc", BCON_INT32(dns->header.rc),
-          "question", "[",
-            "{",
-              "name", BCON_UTF8(dns->question.name),
-              "type", BCON_INT32(dns->question.type),
-              "class", BCON_INT32(dns->question.class),
-            "}",
-          "]",
-          "DNSSEC", BCON_BOOL(dns->isDNSSEC),
+          "rc", BCON_INT32(dns->header.rc)
+      );
+  }
+
+  if (MONGODB_FIELDS & (DNS_FIELD_QNAME | DNS_FIELD_QTYPE)) {
+    bson_t questions, question;
+    BSON_APPEND_ARRAY_BEGIN(doc, "question", &questions);
+    BSON_APPEND_DOCUMENT_BEGIN(&questions, "0", &question);
+    if (MONGODB_FIELDS & DNS_FIELD_QNAME) {
+      BSON_APPEND_UTF8(&question, "name", dns->question.name);
+    }
+    if (MONGODB_FIELDS & DNS_FIELD_QTYPE) {
+      BSON_APPEND_INT32(&question, "type", dns->question.type);
+      BSON_APPEND_INT32(&question, "class", dns->question.class);
+    }
+    bson_append_document_end(&questions, &question);
+    bson_append_array_end(doc, &questions);
+  }
+
+  if (MONGODB_FIELDS & DNS_FIELD_EDNS) {
+    BSON_APPEND_BOOL(doc, "DNSSEC", dns->isDNSSEC);
+  }
+
+  if (MONGODB_FIELDS & DNS_FIELD_HEADER) {
+    BCON_APPEND(doc,
           "questionCount", BCON_INT32(dns->header.qdcount),
           "answerCount", BCON_INT32(dns->header.ancount),
           "authorityCount", BCON_INT32(dns->header.nscount),
           "additionalCount", BCON_INT32(dns->header.arcount)
       );
+  }
+}
+
+// Sends one bulk operation with a client from the pool.
+static void executeBulk(mongoc_bulk_operation_t *bulk) {
+  bson_t reply;
+  bson_error_t error;
+
+  mongoc_client_t *client = mongoc_client_pool_pop(pool);
+  mongoc_bulk_operation_set_client(bulk, client);
+  mongoc_bulk_operation_set_database(bulk, MONGODB_DB_NAME);
+  mongoc_bulk_operation_set_collection(bulk, MONGODB_COLLECTION);
+  if (!mongoc_bulk_operation_execute(bulk, &reply, &error)) {
+    fprintf(stderr, "[Error] MongoDB bulk operation: %s\n", error.message);
+  }
+  bson_destroy(&reply);
+  mongoc_bulk_operation_destroy(bulk);
+  mongoc_client_pool_push(pool, client);
+}
+
+// Sizes the bulk operations to come to take about MONGODB_TARGET_LATENCY
+// seconds to send, at the rate the last one went. They are moved halfway there
+// each time, so that one slow send does not swing the size too far.
+static void resizeBulks(uint32_t *bulkSize, uint32_t numDocs, double seconds) {
+  if (seconds <= 0) {
+    return;
+  }
+
+  double target = numDocs * MONGODB_TARGET_LATENCY / seconds;
+  double size = (__atomic_load_n(bulkSize, __ATOMIC_RELAXED) + target) / 2;
+  if (size < MONGODB_INSERT_MIN) {
+    size = MONGODB_INSERT_MIN;
+  } else if (size > MONGODB_INSERT_MAX) {
+    size = MONGODB_INSERT_MAX;
+  }
+  __atomic_store_n(bulkSize, (uint32_t)size, __ATOMIC_RELAXED);
+}
+
+static void *writeStage(void *arg) {
+  db_writer_t *writer = arg;
+  pending_bulk_t *pending;
+  while ((pending = spscRingPop(&writer->toWrite))) {
+    double startTime = getTimeSeconds();
+    executeBulk(pending->bulk);
+    double seconds = getTimeSeconds() - startTime;
 
-  mongoc_bulk_operation_insert(bulk, doc);
-  currentDocIndex++;
+    writer->numBulks++;
+    writer->sendSeconds += seconds;
+    resizeBulks(writer->bulkSize, pending->numDocs, seconds);
+    free(pending);
+  }
+  return NULL;
+}
+
+// Hands a bulk operation to the writer with the fewest waiting, looking from
+// a different one each time so that idle writers take turns.
+static void writeBulk(db_pipeline_t *stages, mongoc_bulk_operation_t *bulk,
+    uint32_t numDocs) {
+  pending_bulk_t *pending = malloc(sizeof(pending_bulk_t));
+  if (!pending) {
+    fprintf(stderr, "Could not allocate a bulk insert\n");
+    exit(1);
+  }
+  pending->bulk = bulk;
+  pending->numDocs = numDocs;
 
-  if (currentDocIndex == MONGODB_INSERT_CACHE) {
-    // execute the bulk operation
-    retval = mongoc_bulk_operation_execute(bulk, &reply, &error);
-    if (!retval) {
-      fprintf(stderr, "[Error] MongoDB bulk operation: %s\n", error.message);
+  db_writer_t *writer = &stages->writers[stages->nextWriter];
+  for (int i = 1; i < PIPELINE_WRITERS; i++) {
+    db_writer_t *other =
+        &stages->writers[(stages->nextWriter + i) % PIPELINE_WRITERS];
+    if (spscRingSize(&other->toWrite) < spscRingSize(&writer->toWrite)) {
+      writer = other;
     }
-    // reset bulk operation once done
-    mongoc_bulk_operation_destroy(bulk);
-    bulk = mongoc_collection_create_bulk_operation(collection, true, NULL);
-    currentDocIndex = 0;
+  }
+  stages->nextWriter = (stages->nextWriter + 1) % PIPELINE_WRITERS;
+  spscRingPush(&writer->toWrite, pending);
+}
+
+static void *encodeStage(void *arg) {
+  db_pipeline_t *stages = arg;
+
+  // Document each insert is built in. Its buffer is kept from one insert to
+  // the next, as the bulk operation takes a copy.
+  bson_t doc;
+  bson_init(&doc);
+
+  mongoc_bulk_operation_t *bulk = NULL;
+  uint32_t numDocs = 0;
+  uint32_t bulkSize = 0;
+  record_batch_t *batch;
+  while ((batch = spscRingPop(&stages->toEncode))) {
+    for (uint32_t i = 0; i < batch->count; i++) {
+      if (!bulk) {
+        bulk = mongoc_bulk_operation_new(true);
+        bulkSize = __atomic_load_n(&stages->bulkSize, __ATOMIC_RELAXED);
+      }
+      encodeDocument(&doc, &batch->records[i]);
+      mongoc_bulk_operation_insert(bulk, &doc);
+      if (++numDocs == bulkSize) {
+        writeBulk(stages, bulk, numDocs);
+        bulk = NULL;
+        numDocs = 0;
+      }
+    }
+
+    batch->count = 0;
+    arenaReset(&batch->strings);
+    spscRingPush(&stages->freeBatches, batch);
+  }
+
+  if (bulk) {
+    writeBulk(stages, bulk, numDocs);
+  }
+  for (int i = 0; i < PIPELINE_WRITERS; i++) {
+    spscRingClose(&stages->writers[i].toWrite);
+  }
+  bson_destroy(&doc);
+  return NULL;
+}
+
+// Hands the batch being filled to the encode stage.
+static void handOnBatch() {
+  spscRingPush(&pipeline->toEncode, pipeline->current);
+  pipeline->current = NULL;
+
+  // Nothing handed on refers to the packets' allocations any more.
+  if (packetArena) {
+    arenaReset(packetArena);
+  }
+}
+
+// Copies a string into the batch's arena.
+static char *copyString(record_batch_t *batch, const char *string) {
+  size_t length = strlen(string) + 1;
+  char *copy = arenaAlloc(&batch->strings, length);
+  if (!copy) {
+    fprintf(stderr, "Could not allocate a pipeline batch\n");
+    exit(1);
+  }
+  memcpy(copy, string, length);
+  return copy;
+}
+#endif
+
+void connectToDB() {
+#if USE_MONGODB == 1
+  if (!dbEnabled) {
+    return;
+  }
+
+  pipeline = calloc(1, sizeof(db_pipeline_t));
+  pipeline->numBatches = PIPELINE_ENCODE_DEPTH + 2;
+  pipeline->batches = calloc(pipeline->numBatches, sizeof(record_batch_t));
+  pipeline->bulkSize = MONGODB_INSERT_CACHE;
+  if (!pipeline->batches ||
+      spscRingInit(&pipeline->toEncode, pipeline->numBatches) < 0 ||
+      spscRingInit(&pipeline->freeBatches, pipeline->numBatches) < 0) {
+    fprintf(stderr, "Could not allocate the insert pipeline\n");
+    exit(1);
+  }
+  for (uint32_t i = 0; i < pipeline->numBatches; i++) {
+    arenaInit(&pipeline->batches[i].strings, PIPELINE_BATCH_SIZE * 32);
+  }
+
+  for (int i = 0; i < PIPELINE_WRITERS; i++) {
+    db_writer_t *writer = &pipeline->writers[i];
+    writer->bulkSize = &pipeline->bulkSize;
+    if (spscRingInit(&writer->toWrite, PIPELINE_WRITE_DEPTH) < 0) {
+      fprintf(stderr, "Could not allocate the insert pipeline\n");
+      exit(1);
+    }
+    if (pthread_create(&writer->thread, NULL, writeStage, writer) != 0) {
+      fprintf(stderr, "pthread_create() failed\n");
+      exit(1);
+    }
+  }
+  if (pthread_create(&pipeline->encodeThread, NULL, encodeStage,
+        pipeline) != 0) {
+    fprintf(stderr, "pthread_create() failed\n");
+    exit(1);
   }
 #endif
 }
 
+void dbSetArena(arena_t *arena) {
+  packetArena = arena;
+}
 
-void disconnectDB() {
+uint32_t dbFields() {
 #if USE_MONGODB == 1
-  bson_t reply;
-  bson_error_t error;
-  bool retval;
-  if (currentDocIndex != 0) {
-    retval = mongoc_bulk_operation_execute(bulk, &reply, &error);
-    if (!retval) {
-      fprintf(stderr, "[Error] MongoDB bulk operation: %s\n", error.message);
+  return MONGODB_FIELDS;
+#else
+  return 0;
+#endif
+}
+
+void insertIntoDB(dns_t *dns) {
+#if USE_MONGODB == 1
+  if (!pipeline) {
+    // Parsing only.
+    if (packetArena) {
+      arenaReset(packetArena);
     }
+    return;
+  }
+
+  if (!pipeline->current) {
+    // Batches are handed out fresh until they have all been used once, and
+    // then only as the encode stage gives them back.
+    if (pipeline->batchesUsed < pipeline->numBatches) {
+      pipeline->current = &pipeline->batches[pipeline->batchesUsed++];
+    } else {
+      pipeline->current = spscRingPop(&pipeline->freeBatches);
+    }
+  }
+
+  record_batch_t *batch = pipeline->current;
+  dns_t *record = &batch->records[batch->count];
+  *record = *dns;
+  record->question.name = copyString(batch,
+      dns->question.name ? dns->question.name : "");
+  if (batch->count &&
+      !strcmp(batch->records[batch->count - 1].replica, dns->replica)) {
+    record->replica = batch->records[batch->count - 1].replica;
+  } else {
+    record->replica = copyString(batch, dns->replica);
+  }
+
+  if (++batch->count == PIPELINE_BATCH_SIZE) {
+    handOnBatch();
+  }
+#else
+  UNUSED(dns);
+  if (packetArena) {
+    arenaReset(packetArena);
   }
-  mongoc_collection_destroy(collection);
-  mongoc_client_destroy(client);
-  mongoc_cleanup();
 #endif
 }
+
+
+#if USE_MONGODB == 1
+// Prints how full the pipeline's queues were on average and how long each
+// stage waited on the next, to show which one held the others up, along with
+// how the bulk operations went.
+static void printPipelineStats(const db_pipeline_t *stages) {
+  spsc_ring_stats_t toEncode, freeBatches;
+  spscRingStats(&stages->toEncode, &toEncode);
+  spscRingStats(&stages->freeBatches, &freeBatches);
+
+  uint64_t occupancySum = 0;
+  uint64_t pushes = 0;
+  double encodeWaited = 0;
+  double writeWaited = 0;
+  uint64_t numBulks = 0;
+  double sendSeconds = 0;
+  for (int i = 0; i < PIPELINE_WRITERS; i++) {
+    spsc_ring_stats_t toWrite;
+    spscRingStats(&stages->writers[i].toWrite, &toWrite);
+    occupancySum += toWrite.occupancySum;
+    pushes += toWrite.pushes;
+    encodeWaited += toWrite.pushWaitSeconds;
+    writeWaited += toWrite.popWaitSeconds;
+    numBulks += stages->writers[i].numBulks;
+    sendSeconds += stages->writers[i].sendSeconds;
+  }
+
+  printf("pipeline | encode queue: %.1f of %" PRIu32 " batches | "
+      "parse waited: %.3fs | write queue: %.1f of %" PRIu32 " bulk inserts | "
+      "encode waited: %.3fs | write waited: %.3fs\n",
+      toEncode.pushes ? (double)toEncode.occupancySum / toEncode.pushes : 0,
+      stages->numBatches,
+      toEncode.pushWaitSeconds + freeBatches.popWaitSeconds,
+      pushes ? (double)occupancySum / pushes : 0,
+      stages->writers[0].toWrite.capacity * PIPELINE_WRITERS, encodeWaited,
+      writeWaited);
+  printf("bulk inserts: %" PRIu64 " | writers: %d | average latency: %.3fs | "
+      "last size: %" PRIu32 " documents\n", numBulks, PIPELINE_WRITERS,
+      numBulks ? sendSeconds / numBulks : 0, stages->bulkSize);
+}
+#endif
+
+void disconnectDB() {
+#if USE_MONGODB == 1
+  if (!pipeline) {
+    return;
+  }
+
+  // Let the stages drain, then tear the pipeline down.
+  if (pipeline->current && pipeline->current->count) {
+    handOnBatch();
+  }
+  spscRingClose(&pipeline->toEncode);
+  pthread_join(pipeline->encodeThread, NULL);
+  for (int i = 0; i < PIPELINE_WRITERS; i++) {
+    pthread_join(pipeline->writers[i].thread, NULL);
+  }
+  printPipelineStats(pipeline);
+
+  for (uint32_t i = 0; i < pipeline->numBatches; i++) {
+    arenaFree(&pipeline->batches[i].strings);
+  }
+  spscRingFree(&pipeline->toEncode);
+  spscRingFree(&pipeline->freeBatches);
+  for (int i = 0; i < PIPELINE_WRITERS; i++) {
+    spscRingFree(&pipeline->writers[i].toWrite);
+  }
+  free(pipeline->batches);
+  free(pipeline);
+  pipeline = NULL;
+#endif
+  if (packetArena) {
+    arenaReset(packetArena);
+  }
+}
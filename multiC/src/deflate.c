@@ -0,0 +1,686 @@
+#include "deflate.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_CODE_BITS     15
+#define MAX_LITLEN_SYMS   288
+#define MAX_DIST_SYMS     32
+#define NUM_CODELEN_SYMS  19
+#define END_OF_BLOCK      256
+#define MAX_MATCH         258
+
+// Codes up to this long are decoded with one table lookup, longer ones bit by
+// bit.
+#define TABLE_BITS        10
+
+// Bit pattern of a block header with BFINAL = 0 and BTYPE = 2 (dynamic).
+#define DYNAMIC_BLOCK     4
+
+#define GZIP_TRAILER_SIZE 8
+
+// Bytes the copy loops may write past the end of a match.
+#define COPY_SLACK        16
+
+typedef struct {
+  const uint8_t *data;
+  size_t size;
+  size_t pos;       /* next byte to load, may run past size */
+  uint64_t bits;
+  unsigned count;
+} bit_reader_t;
+
+typedef struct {
+  uint16_t table[1 << TABLE_BITS];  /* symbol << 4 | length, 0 if longer */
+  uint16_t count[MAX_CODE_BITS + 1];
+  uint16_t symbol[MAX_LITLEN_SYMS];
+} huffman_t;
+
+struct deflate_decoder {
+  bit_reader_t br;
+  huffman_t litlen;
+  huffman_t dist;
+  huffman_t codelen;
+  huffman_t fixedLitlen;
+  huffman_t fixedDist;
+};
+
+static const uint16_t lengthBase[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+  67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t lengthExtra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5,
+  5, 5, 5, 0
+};
+static const uint16_t distBase[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+  769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t distExtra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+  11, 11, 12, 12, 13, 13
+};
+static const uint8_t codelenOrder[NUM_CODELEN_SYMS] = {
+  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static uint64_t bitOffset(const bit_reader_t *br) {
+  return (uint64_t)br->pos * 8 - br->count;
+}
+
+// Tops the bit buffer up to at least 56 bits. Past the end of the data zeros
+// are shifted in; callers check overrun() rather than every read.
+static inline void refill(bit_reader_t *br) {
+  if (br->pos + 8 <= br->size) {
+    uint64_t word;
+    memcpy(&word, br->data + br->pos, sizeof(word));
+    br->bits |= word << br->count;
+    br->pos += (63 - br->count) >> 3;
+    br->count |= 56;
+  } else {
+    while (br->count <= 56) {
+      if (br->pos < br->size) {
+        br->bits |= (uint64_t)br->data[br->pos] << br->count;
+      }
+      br->pos++;
+      br->count += 8;
+    }
+  }
+}
+
+static inline bool overrun(const bit_reader_t *br) {
+  return bitOffset(br) > (uint64_t)br->size * 8;
+}
+
+static inline uint32_t peekBits(const bit_reader_t *br, unsigned n) {
+  return br->bits & ((1ull << n) - 1);
+}
+
+static inline void dropBits(bit_reader_t *br, unsigned n) {
+  br->bits >>= n;
+  br->count -= n;
+}
+
+// Reads n (at most 32) bits, which must already be in the buffer.
+static inline uint32_t takeBits(bit_reader_t *br, unsigned n) {
+  uint32_t value = peekBits(br, n);
+  dropBits(br, n);
+  return value;
+}
+
+static void seekBits(bit_reader_t *br, uint64_t bit) {
+  br->pos = bit / 8;
+  br->bits = 0;
+  br->count = 0;
+  refill(br);
+  dropBits(br, bit % 8);
+}
+
+// Builds the decoding tables for a canonical code. Like zlib, an incomplete
+// code is only accepted for literal/length and distance codes made of a
+// single code of length one, and an empty code only for distances.
+static int buildHuffman(huffman_t *h, const uint8_t *lengths, int n,
+    bool isCodelen) {
+  memset(h->count, 0, sizeof(h->count));
+  for (int i = 0; i < n; i++) {
+    h->count[lengths[i]]++;
+  }
+  h->count[0] = 0;
+
+  int maxLen = 0;
+  int left = 1;
+  for (int len = 1; len <= MAX_CODE_BITS; len++) {
+    left = (left << 1) - h->count[len];
+    if (left < 0) {
+      return -1;  // over-subscribed
+    }
+    if (h->count[len]) {
+      maxLen = len;
+    }
+  }
+  if (left > 0 && maxLen != 0 && (isCodelen || maxLen != 1)) {
+    return -1;  // incomplete
+  }
+
+  uint16_t offsets[MAX_CODE_BITS + 2];
+  offsets[1] = 0;
+  for (int len = 1; len <= MAX_CODE_BITS; len++) {
+    offsets[len + 1] = offsets[len] + h->count[len];
+  }
+  for (int i = 0; i < n; i++) {
+    if (lengths[i]) {
+      h->symbol[offsets[lengths[i]]++] = i;
+    }
+  }
+
+  // Codes are sent most significant bit first, so the table is indexed by
+  // bit-reversed codes.
+  memset(h->table, 0, sizeof(h->table));
+  unsigned code = 0;
+  int index = 0;
+  for (int len = 1; len <= TABLE_BITS; len++) {
+    for (int k = 0; k < h->count[len]; k++, code++) {
+      unsigned reversed = 0;
+      for (int b = 0; b < len; b++) {
+        reversed |= ((code >> b) & 1) << (len - 1 - b);
+      }
+      uint16_t entry = (h->symbol[index++] << 4) | len;
+      for (unsigned j = reversed; j < (1u << TABLE_BITS); j += 1u << len) {
+        h->table[j] = entry;
+      }
+    }
+    code <<= 1;
+  }
+  return 0;
+}
+
+// Decodes codes longer than the table one bit at a time.
+static int decodeSlow(bit_reader_t *br, const huffman_t *h) {
+  int code = 0;
+  int first = 0;
+  int index = 0;
+  uint64_t bits = br->bits;
+
+  for (int len = 1; len <= MAX_CODE_BITS; len++) {
+    code |= bits & 1;
+    bits >>= 1;
+    int count = h->count[len];
+    if (code - count < first) {
+      dropBits(br, len);
+      return h->symbol[index + (code - first)];
+    }
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+// Needs at least MAX_CODE_BITS bits in the buffer.
+static inline int decodeSymbol(bit_reader_t *br, const huffman_t *h) {
+  uint16_t entry = h->table[peekBits(br, TABLE_BITS)];
+  if (entry & 15) {
+    dropBits(br, entry & 15);
+    return entry >> 4;
+  }
+  return decodeSlow(br, h);
+}
+
+static void buildFixed(deflate_decoder_t *d) {
+  uint8_t lengths[MAX_LITLEN_SYMS];
+  int i = 0;
+  for (; i < 144; i++) {
+    lengths[i] = 8;
+  }
+  for (; i < 256; i++) {
+    lengths[i] = 9;
+  }
+  for (; i < 280; i++) {
+    lengths[i] = 7;
+  }
+  for (; i < MAX_LITLEN_SYMS; i++) {
+    lengths[i] = 8;
+  }
+  buildHuffman(&d->fixedLitlen, lengths, MAX_LITLEN_SYMS, false);
+
+  // All 32 distance codes are built to keep the code complete; 30 and 31 are
+  // rejected when decoded.
+  memset(lengths, 5, MAX_DIST_SYMS);
+  buildHuffman(&d->fixedDist, lengths, MAX_DIST_SYMS, false);
+}
+
+static int readDynamicHeader(deflate_decoder_t *d) {
+  bit_reader_t *br = &d->br;
+
+  refill(br);
+  int numLitlen = takeBits(br, 5) + 257;
+  int numDist = takeBits(br, 5) + 1;
+  int numCodelen = takeBits(br, 4) + 4;
+  if (numLitlen > 286 || numDist > 30) {
+    return -1;
+  }
+
+  uint8_t lengths[MAX_LITLEN_SYMS + MAX_DIST_SYMS];
+  memset(lengths, 0, NUM_CODELEN_SYMS);
+  for (int i = 0; i < numCodelen; i++) {
+    refill(br);
+    lengths[codelenOrder[i]] = takeBits(br, 3);
+  }
+  if (buildHuffman(&d->codelen, lengths, NUM_CODELEN_SYMS, true) < 0) {
+    return -1;
+  }
+
+  int i = 0;
+  while (i < numLitlen + numDist) {
+    refill(br);
+    int sym = decodeSymbol(br, &d->codelen);
+    int repeat;
+    uint8_t value = 0;
+    if (sym < 0) {
+      return -1;
+    } else if (sym < 16) {
+      lengths[i++] = sym;
+      continue;
+    } else if (sym == 16) {
+      if (i == 0) {
+        return -1;
+      }
+      value = lengths[i - 1];
+      repeat = 3 + takeBits(br, 2);
+    } else if (sym == 17) {
+      repeat = 3 + takeBits(br, 3);
+    } else {
+      repeat = 11 + takeBits(br, 7);
+    }
+    if (i + repeat > numLitlen + numDist) {
+      return -1;
+    }
+    memset(lengths + i, value, repeat);
+    i += repeat;
+  }
+
+  if (lengths[END_OF_BLOCK] == 0 || overrun(br)) {
+    return -1;
+  }
+  if (buildHuffman(&d->litlen, lengths, numLitlen, false) < 0 ||
+      buildHuffman(&d->dist, lengths + numLitlen, numDist, false) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+static bool reserve(void **buf, size_t *cap, size_t need, size_t elemSize) {
+  if (need <= *cap) {
+    return true;
+  }
+  size_t newCap = *cap ? *cap : 16;
+  while (newCap < need) {
+    newCap *= 2;
+  }
+  void *newBuf = realloc(*buf, newCap * elemSize);
+  if (!newBuf) {
+    return false;
+  }
+  *buf = newBuf;
+  *cap = newCap;
+  return true;
+}
+
+// Output state while decoding a chunk. Lengths include the window prefix at
+// the start of each buffer.
+typedef struct {
+  deflate_chunk_t *chunk;
+  size_t markedLen;
+  size_t lastMarker;  /* index of the last marker in the marked buffer */
+  size_t byteLen;
+} output_t;
+
+// Decodes the symbols of one block. Always inlined so that the marked and
+// plain byte loops are each compiled without the other's branches.
+static inline __attribute__((always_inline)) int inflateBlock(
+    deflate_decoder_t *d, const huffman_t *litlen, const huffman_t *dist,
+    output_t *out, const bool marked) {
+  bit_reader_t *br = &d->br;
+  deflate_chunk_t *chunk = out->chunk;
+  size_t len = marked ? out->markedLen : out->byteLen;
+  size_t lastMarker = out->lastMarker;
+
+  for (;;) {
+    if (marked) {
+      if (!reserve((void **)&chunk->markedBuf, &chunk->markedCap,
+            len + MAX_MATCH + COPY_SLACK, sizeof(uint16_t))) {
+        return -1;
+      }
+    } else if (!reserve((void **)&chunk->byteBuf, &chunk->byteCap,
+          len + MAX_MATCH + COPY_SLACK, sizeof(uint8_t))) {
+      return -1;
+    }
+    if (overrun(br)) {
+      return -1;
+    }
+
+    // A literal/length code, length extra bits, distance code and distance
+    // extra bits take at most 48 bits, so one refill covers the lot.
+    refill(br);
+    int sym = decodeSymbol(br, litlen);
+    if (sym < END_OF_BLOCK) {
+      if (sym < 0) {
+        return -1;
+      }
+      if (marked) {
+        chunk->markedBuf[len++] = sym;
+      } else {
+        chunk->byteBuf[len++] = sym;
+      }
+      continue;
+    }
+    if (sym == END_OF_BLOCK) {
+      break;
+    }
+
+    sym -= END_OF_BLOCK + 1;
+    if (sym >= 29) {
+      return -1;
+    }
+    size_t length = lengthBase[sym] + takeBits(br, lengthExtra[sym]);
+    int distSym = decodeSymbol(br, dist);
+    if (distSym < 0 || distSym >= 30) {
+      return -1;
+    }
+    size_t distance = distBase[distSym] + takeBits(br, distExtra[distSym]);
+    if (distance > len) {
+      return -1;
+    }
+
+    if (marked) {
+      uint16_t *dst = chunk->markedBuf + len;
+      const uint16_t *src = dst - distance;
+      for (size_t i = 0; i < length; i++) {
+        dst[i] = src[i];
+        if (dst[i] >= DEFLATE_MARKER) {
+          lastMarker = len + i;
+        }
+      }
+    } else {
+      uint8_t *dst = chunk->byteBuf + len;
+      const uint8_t *src = dst - distance;
+      if (distance >= 8) {
+        // Copy whole words, writing up to 7 bytes of slack past the match.
+        for (size_t i = 0; i < length; i += 8) {
+          memcpy(dst + i, src + i, 8);
+        }
+      } else {
+        for (size_t i = 0; i < length; i++) {
+          dst[i] = src[i];
+        }
+      }
+    }
+    len += length;
+  }
+
+  if (marked) {
+    out->markedLen = len;
+    out->lastMarker = lastMarker;
+  } else {
+    out->byteLen = len;
+  }
+  return 0;
+}
+
+static int copyStored(deflate_decoder_t *d, output_t *out, bool marked) {
+  bit_reader_t *br = &d->br;
+  deflate_chunk_t *chunk = out->chunk;
+
+  uint64_t bit = (bitOffset(br) + 7) & ~7ull;
+  size_t pos = bit / 8;
+  if (pos + 4 > br->size) {
+    return -1;
+  }
+  uint16_t length = br->data[pos] | (br->data[pos + 1] << 8);
+  uint16_t inverse = br->data[pos + 2] | (br->data[pos + 3] << 8);
+  if (length != (uint16_t)~inverse || pos + 4 + length > br->size) {
+    return -1;
+  }
+
+  const uint8_t *src = br->data + pos + 4;
+  if (marked) {
+    if (!reserve((void **)&chunk->markedBuf, &chunk->markedCap,
+          out->markedLen + length, sizeof(uint16_t))) {
+      return -1;
+    }
+    for (size_t i = 0; i < length; i++) {
+      chunk->markedBuf[out->markedLen++] = src[i];
+    }
+  } else {
+    if (!reserve((void **)&chunk->byteBuf, &chunk->byteCap,
+          out->byteLen + length, sizeof(uint8_t))) {
+      return -1;
+    }
+    memcpy(chunk->byteBuf + out->byteLen, src, length);
+    out->byteLen += length;
+  }
+
+  seekBits(br, (uint64_t)(pos + 4 + length) * 8);
+  return 0;
+}
+
+// Moves from marked to plain byte output once the last window's worth of
+// output holds no markers, since nothing after it can reach further back.
+static int switchToBytes(output_t *out) {
+  deflate_chunk_t *chunk = out->chunk;
+  if (!reserve((void **)&chunk->byteBuf, &chunk->byteCap,
+        DEFLATE_WINDOW_SIZE + MAX_MATCH + COPY_SLACK, sizeof(uint8_t))) {
+    return -1;
+  }
+
+  const uint16_t *window = chunk->markedBuf + out->markedLen -
+    DEFLATE_WINDOW_SIZE;
+  for (size_t i = 0; i < DEFLATE_WINDOW_SIZE; i++) {
+    chunk->byteBuf[i] = window[i];
+  }
+  out->byteLen = DEFLATE_WINDOW_SIZE;
+  return 0;
+}
+
+static uint32_t get32le(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int addMemberEnd(deflate_chunk_t *chunk, size_t offset,
+    const uint8_t *trailer) {
+  if (!reserve((void **)&chunk->memberEnds, &chunk->memberEndsCap,
+        chunk->numMemberEnds + 1, sizeof(deflate_member_end_t))) {
+    return -1;
+  }
+  deflate_member_end_t *end = &chunk->memberEnds[chunk->numMemberEnds++];
+  end->offset = offset;
+  end->crc = get32le(trailer);
+  end->size = get32le(trailer + 4);
+  return 0;
+}
+
+int deflateDecode(deflate_decoder_t *d, deflate_chunk_t *chunk,
+    const uint8_t *data, size_t size, uint64_t startBit, uint64_t stopBit,
+    const uint8_t *window, size_t windowLen) {
+  bit_reader_t *br = &d->br;
+  br->data = data;
+  br->size = size;
+  seekBits(br, startBit);
+
+  output_t out = { .chunk = chunk };
+  bool marked = (window == NULL);
+  size_t bytePrefix;
+  if (marked) {
+    // The unknown window is a run of markers, one per position.
+    if (!reserve((void **)&chunk->markedBuf, &chunk->markedCap,
+          DEFLATE_WINDOW_SIZE, sizeof(uint16_t))) {
+      return -1;
+    }
+    for (size_t i = 0; i < DEFLATE_WINDOW_SIZE; i++) {
+      chunk->markedBuf[i] = DEFLATE_MARKER + i;
+    }
+    out.markedLen = DEFLATE_WINDOW_SIZE;
+    out.lastMarker = DEFLATE_WINDOW_SIZE - 1;
+    bytePrefix = DEFLATE_WINDOW_SIZE;
+  } else {
+    if (!reserve((void **)&chunk->byteBuf, &chunk->byteCap, windowLen + 1,
+          sizeof(uint8_t))) {
+      return -1;
+    }
+    memcpy(chunk->byteBuf, window, windowLen);
+    out.byteLen = windowLen;
+    bytePrefix = windowLen;
+  }
+
+  chunk->startBit = startBit;
+  chunk->streamEnd = false;
+  chunk->numMemberEnds = 0;
+  size_t markedEnd = 0;
+
+  for (;;) {
+    refill(br);
+    if (overrun(br)) {
+      return -1;
+    }
+    if (bitOffset(br) >= stopBit && peekBits(br, 3) == DYNAMIC_BLOCK) {
+      chunk->endBit = bitOffset(br);
+      break;
+    }
+
+    if (marked && out.markedLen - 1 - out.lastMarker >= DEFLATE_WINDOW_SIZE) {
+      if (switchToBytes(&out) < 0) {
+        return -1;
+      }
+      marked = false;
+      markedEnd = out.markedLen;
+    }
+
+    bool final = takeBits(br, 1);
+    int type = takeBits(br, 2);
+    int ret;
+    if (type == 0) {
+      ret = copyStored(d, &out, marked);
+    } else if (type == 1) {
+      ret = marked ? inflateBlock(d, &d->fixedLitlen, &d->fixedDist, &out, true)
+        : inflateBlock(d, &d->fixedLitlen, &d->fixedDist, &out, false);
+    } else if (type == 2) {
+      ret = readDynamicHeader(d);
+      if (ret == 0) {
+        ret = marked ? inflateBlock(d, &d->litlen, &d->dist, &out, true) :
+          inflateBlock(d, &d->litlen, &d->dist, &out, false);
+      }
+    } else {
+      ret = -1;
+    }
+    if (ret < 0 || overrun(br)) {
+      return -1;
+    }
+
+    if (final) {
+      // Skip the member trailer and carry on into the next member, if any.
+      size_t pos = (bitOffset(br) + 7) / 8 + GZIP_TRAILER_SIZE;
+      if (pos > size) {
+        return -1;
+      }
+      size_t offset = marked ? out.markedLen - DEFLATE_WINDOW_SIZE :
+        (window ? 0 : markedEnd - DEFLATE_WINDOW_SIZE) + out.byteLen -
+        bytePrefix;
+      if (addMemberEnd(chunk, offset, data + pos - GZIP_TRAILER_SIZE) < 0) {
+        return -1;
+      }
+      size_t header = 0;
+      if (pos + 2 <= size && data[pos] == 0x1f && data[pos + 1] == 0x8b) {
+        if ((header = gzipHeaderSize(data + pos, size - pos)) == 0) {
+          return -1;
+        }
+      }
+      if (header == 0) {
+        chunk->endBit = (uint64_t)pos * 8;
+        chunk->streamEnd = true;
+        break;
+      }
+      seekBits(br, (uint64_t)(pos + header) * 8);
+    }
+  }
+
+  if (window) {
+    chunk->marked = NULL;
+    chunk->markedLen = 0;
+  } else {
+    if (marked) {
+      markedEnd = out.markedLen;
+    }
+    chunk->marked = chunk->markedBuf + DEFLATE_WINDOW_SIZE;
+    chunk->markedLen = markedEnd - DEFLATE_WINDOW_SIZE;
+  }
+  if (marked) {
+    chunk->bytes = NULL;
+    chunk->bytesLen = 0;
+  } else {
+    chunk->bytes = chunk->byteBuf + bytePrefix;
+    chunk->bytesLen = out.byteLen - bytePrefix;
+  }
+  return 0;
+}
+
+int deflateFindBlock(deflate_decoder_t *d, deflate_chunk_t *chunk,
+    const uint8_t *data, size_t size, uint64_t fromBit, uint64_t toBit,
+    uint64_t stopBit) {
+  bit_reader_t *br = &d->br;
+  br->data = data;
+  br->size = size;
+  if (toBit > (uint64_t)size * 8) {
+    toBit = (uint64_t)size * 8;
+  }
+
+  // Most candidates fail on the block type or the dynamic header well before
+  // the expensive trial decode.
+  for (uint64_t bit = fromBit; bit < toBit; bit++) {
+    seekBits(br, bit);
+    if (peekBits(br, 3) != DYNAMIC_BLOCK) {
+      continue;
+    }
+    dropBits(br, 3);
+    if (readDynamicHeader(d) < 0) {
+      continue;
+    }
+    if (deflateDecode(d, chunk, data, size, bit, stopBit, NULL, 0) == 0) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+deflate_decoder_t *deflateDecoderNew(void) {
+  deflate_decoder_t *d = calloc(1, sizeof(*d));
+  if (d) {
+    buildFixed(d);
+  }
+  return d;
+}
+
+void deflateDecoderFree(deflate_decoder_t *decoder) {
+  free(decoder);
+}
+
+void deflateChunkFree(deflate_chunk_t *chunk) {
+  free(chunk->markedBuf);
+  free(chunk->byteBuf);
+  free(chunk->memberEnds);
+  memset(chunk, 0, sizeof(*chunk));
+}
+
+size_t gzipHeaderSize(const uint8_t *data, size_t size) {
+  enum { FHCRC = 2, FEXTRA = 4, FNAME = 8, FCOMMENT = 16, FRESERVED = 0xe0 };
+
+  if (size < 10 || data[0] != 0x1f || data[1] != 0x8b || data[2] != 8 ||
+      (data[3] & FRESERVED)) {
+    return 0;
+  }
+  uint8_t flags = data[3];
+  size_t pos = 10;
+
+  if (flags & FEXTRA) {
+    if (pos + 2 > size) {
+      return 0;
+    }
+    pos += 2 + (data[pos] | (data[pos + 1] << 8));
+  }
+  if (flags & FNAME) {
+    while (pos < size && data[pos] != 0) {
+      pos++;
+    }
+    pos++;
+  }
+  if (flags & FCOMMENT) {
+    while (pos < size && data[pos] != 0) {
+      pos++;
+    }
+    pos++;
+  }
+  if (flags & FHCRC) {
+    pos += 2;
+  }
+  return (pos < size) ? pos : 0;
+}
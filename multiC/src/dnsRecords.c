@@ -0,0 +1,215 @@
+#include "dnsRecords.h"
+
+#include <string.h>
+
+#define DNS_HEADER_SIZE 12
+#define DNS_QUESTION_FIXED_SIZE 4
+#define DNS_RR_FIXED_SIZE 10
+#define DNS_MAX_NAME 255
+#define DNS_POINTER_MASK 0xC0
+
+static inline uint16_t get16(const uint8_t *p) {
+  return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t get32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// Returns the number of bytes the name at cur takes on the wire, up to and
+// including its root label or compression pointer, or -1 if it is malformed.
+static int skipName(const uint8_t *cur, const uint8_t *end) {
+  const uint8_t *start = cur;
+  while (cur < end) {
+    uint8_t length = *cur;
+    if ((length & DNS_POINTER_MASK) == DNS_POINTER_MASK) {
+      return (end - cur >= 2) ? (cur + 2) - start : -1;
+    } else if (length & DNS_POINTER_MASK) {
+      // Extended label types are obsolete.
+      return -1;
+    }
+
+    cur += length + 1;
+    if (length == 0) {
+      return cur - start;
+    } else if (cur - start > DNS_MAX_NAME) {
+      return -1;
+    }
+  }
+  return -1;
+}
+
+void dnsWalkerInit(dns_walker_t *walker, const uint8_t *packet,
+    uint16_t size) {
+  memset(walker, 0, sizeof(*walker));
+  walker->packet = packet;
+  walker->end = packet + size;
+  walker->cur = walker->end;
+  walker->section = DNS_SECTION_QUESTION;
+
+  if (!packet || size < DNS_HEADER_SIZE) {
+    walker->error = true;
+    return;
+  }
+
+  walker->cur = packet + DNS_HEADER_SIZE;
+  for (int i = 0; i < 4; i++) {
+    walker->counts[i] = get16(packet + 4 + i * 2);
+  }
+  walker->left = walker->counts[DNS_SECTION_QUESTION];
+}
+
+bool dnsWalkerNext(dns_walker_t *walker, dns_rr_t *rr) {
+  if (walker->error) {
+    return false;
+  }
+
+  while (!walker->left) {
+    if (walker->section == DNS_SECTION_ADDITIONAL) {
+      return false;
+    }
+    walker->left = walker->counts[++walker->section];
+  }
+
+  int nameLength = skipName(walker->cur, walker->end);
+  if (nameLength < 0) {
+    walker->error = true;
+    return false;
+  }
+
+  const uint8_t *cur = walker->cur + nameLength;
+  const uint8_t *end = walker->end;
+  rr->section = walker->section;
+  rr->name = walker->cur;
+  if (walker->section == DNS_SECTION_QUESTION) {
+    if (end - cur < DNS_QUESTION_FIXED_SIZE) {
+      walker->error = true;
+      return false;
+    }
+
+    rr->type = get16(cur);
+    rr->class = get16(cur + 2);
+    rr->ttl = 0;
+    rr->rdlength = 0;
+    rr->rdata = NULL;
+    walker->cur = cur + DNS_QUESTION_FIXED_SIZE;
+  } else {
+    if (end - cur < DNS_RR_FIXED_SIZE ||
+        end - (cur + DNS_RR_FIXED_SIZE) < get16(cur + 8)) {
+      walker->error = true;
+      return false;
+    }
+
+    rr->type = get16(cur);
+    rr->class = get16(cur + 2);
+    rr->ttl = get32(cur + 4);
+    rr->rdlength = get16(cur + 8);
+    rr->rdata = cur + DNS_RR_FIXED_SIZE;
+    walker->cur = rr->rdata + rr->rdlength;
+
+    // The OPT record keeps the EDNS fields in its class and TTL, and its owner
+    // is the root.
+    dns_edns_t *edns = &walker->edns;
+    if (walker->section == DNS_SECTION_ADDITIONAL &&
+        rr->type == DNS_TYPE_OPT && !edns->present && nameLength == 1) {
+      edns->present = true;
+      edns->udpSize = rr->class;
+      edns->extRcode = cur[4];
+      edns->version = cur[5];
+      edns->dnssecOK = cur[6] >> 7 & 1;
+      edns->optionsLength = rr->rdlength;
+      edns->options = rr->rdata;
+    }
+  }
+
+  walker->left--;
+  return true;
+}
+
+const dns_edns_t *dnsWalkerEDNS(dns_walker_t *walker) {
+  dns_rr_t rr;
+  while (!walker->edns.present && dnsWalkerNext(walker, &rr)) {
+  }
+  return &walker->edns;
+}
+
+bool dnsNextOption(const dns_edns_t *edns, const uint8_t **cur,
+    uint16_t *code, uint16_t *length, const uint8_t **data) {
+  if (!edns->present) {
+    return false;
+  }
+
+  const uint8_t *end = edns->options + edns->optionsLength;
+  if (end - *cur < 4) {
+    return false;
+  }
+
+  uint16_t optionLength = get16(*cur + 2);
+  if (end - (*cur + 4) < optionLength) {
+    return false;
+  }
+
+  *code = get16(*cur);
+  *length = optionLength;
+  *data = *cur + 4;
+  *cur += 4 + optionLength;
+  return true;
+}
+
+int dnsExpandName(const dns_walker_t *walker, const uint8_t *name, char *out,
+    size_t outSize) {
+  const uint8_t *packet = walker->packet;
+  const uint8_t *end = walker->end;
+  const uint8_t *cur = name;
+  // Start of the labels being read; pointers have to point before it.
+  const uint8_t *run = name;
+  size_t length = 0;
+  size_t wireLength = 1;
+
+  if (!outSize || cur < packet || cur >= end) {
+    return -1;
+  }
+
+  while (cur < end && *cur) {
+    uint8_t labelLength = *cur;
+    if ((labelLength & DNS_POINTER_MASK) == DNS_POINTER_MASK) {
+      if (end - cur < 2) {
+        return -1;
+      }
+
+      const uint8_t *target = packet + ((labelLength & ~DNS_POINTER_MASK) << 8 |
+          cur[1]);
+      if (target >= run) {
+        return -1;
+      }
+      cur = run = target;
+      continue;
+    } else if (labelLength & DNS_POINTER_MASK) {
+      return -1;
+    }
+
+    wireLength += labelLength + 1;
+    if (wireLength > DNS_MAX_NAME || end - (cur + 1) < labelLength ||
+        length + labelLength + 1 >= outSize) {
+      return -1;
+    }
+
+    memcpy(out + length, cur + 1, labelLength);
+    length += labelLength;
+    out[length++] = '.';
+    cur += labelLength + 1;
+  }
+
+  if (cur >= end) {
+    return -1;
+  }
+
+  if (!length) {
+    if (outSize < 2) {
+      return -1;
+    }
+    out[length++] = '.';
+  }
+  out[length] = '\0';
+  return length;
+}
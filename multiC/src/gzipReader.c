@@ -0,0 +1,152 @@
+#include "gzipReader.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "config.h"
+
+// Window bits for zlib that only accept a gzip wrapper.
+#define GZIP_WINDOW_BITS (15 + 16)
+
+// Set for the whole process, before any file is opened.
+static int defaultThreads = 0;
+
+void gzipReaderSetThreads(int threads) {
+  defaultThreads = threads;
+}
+
+static int parallelThreads(void) {
+  if (PARALLEL_GZIP_THREADS > 0) {
+    return PARALLEL_GZIP_THREADS;
+  }
+  if (defaultThreads > 0) {
+    return defaultThreads;
+  }
+  return sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+// Maps a large file and starts decoding it on several threads. Returns false
+// to fall back to streaming through zlib.
+static bool openParallel(gzip_reader_t *reader) {
+  struct stat st;
+  int numThreads = parallelThreads();
+  if (numThreads < 2 || fstat(reader->fd, &st) < 0 ||
+      st.st_size < PARALLEL_GZIP_MIN_SIZE) {
+    return false;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  madvise(map, st.st_size, MADV_WILLNEED);
+
+  reader->parallel = parallelGzipOpen(map, st.st_size, numThreads,
+      PARALLEL_GZIP_CHUNK_SIZE);
+  if (!reader->parallel) {
+    munmap(map, st.st_size);
+    return false;
+  }
+  reader->map = map;
+  reader->mapSize = st.st_size;
+  return true;
+}
+
+int gzipReaderOpen(gzip_reader_t *reader, const char *filePath) {
+  memset(reader, 0, sizeof(*reader));
+  reader->fd = -1;
+
+  if ((reader->fd = open(filePath, O_RDONLY)) < 0) {
+    reader->error = "could not open file";
+    return -1;
+  }
+  if (openParallel(reader)) {
+    return 0;
+  }
+
+  if (posix_memalign((void **)&reader->in, 64, GZIP_READER_INPUT_SIZE)) {
+    reader->error = "could not allocate input buffer";
+    gzipReaderClose(reader);
+    return -1;
+  }
+  posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  if (inflateInit2(&reader->strm, GZIP_WINDOW_BITS) != Z_OK) {
+    reader->error = "could not initialize zlib";
+    gzipReaderClose(reader);
+    return -1;
+  }
+  return 0;
+}
+
+ssize_t gzipReaderRead(gzip_reader_t *reader, uint8_t *out, size_t len) {
+  double start = getTimeSeconds();
+  z_stream *strm = &reader->strm;
+
+  if (reader->parallel) {
+    ssize_t bytes = parallelGzipRead(reader->parallel, out, len,
+        &reader->error);
+    reader->done = (bytes >= 0 && (size_t)bytes < len);
+    reader->inflateTime += getTimeSeconds() - start;
+    return bytes;
+  }
+
+  strm->next_out = out;
+  strm->avail_out = len;
+
+  while (strm->avail_out > 0 && !reader->done) {
+    if (strm->avail_in == 0 && !reader->eof) {
+      ssize_t bytes = read(reader->fd, reader->in, GZIP_READER_INPUT_SIZE);
+      if (bytes < 0) {
+        reader->error = "could not read file";
+        return -1;
+      }
+      reader->eof = (bytes == 0);
+      strm->next_in = reader->in;
+      strm->avail_in = bytes;
+    }
+
+    if (strm->avail_in == 0) {
+      // The input may only run out between members.
+      if (reader->inMember) {
+        reader->error = "unexpected end of file";
+        return -1;
+      }
+      reader->done = true;
+      break;
+    }
+
+    int ret = inflate(strm, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END) {
+      // Another gzip member may follow this one.
+      inflateReset(strm);
+      reader->inMember = false;
+    } else if (ret == Z_OK || ret == Z_BUF_ERROR) {
+      reader->inMember = true;
+    } else {
+      reader->error = strm->msg ? strm->msg : "corrupt gzip data";
+      return -1;
+    }
+  }
+
+  reader->inflateTime += getTimeSeconds() - start;
+  return len - strm->avail_out;
+}
+
+void gzipReaderClose(gzip_reader_t *reader) {
+  if (reader->parallel) {
+    parallelGzipClose(reader->parallel);
+    munmap((void *)reader->map, reader->mapSize);
+  }
+  if (reader->fd >= 0) {
+    close(reader->fd);
+    inflateEnd(&reader->strm);
+  }
+  free(reader->in);
+  memset(reader, 0, sizeof(*reader));
+  reader->fd = -1;
+}
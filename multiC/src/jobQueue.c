@@ -0,0 +1,187 @@
+#include "jobQueue.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static size_t alignUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) & ~(alignment - 1);
+}
+
+int jobQueueInit(job_queue_t *queue, char **paths, int numPaths,
+    int numWorkers) {
+  memset(queue, 0, sizeof(*queue));
+  queue->numWorkers = numWorkers;
+
+  // Only regular files are queued, as the pipe protocol did.
+  uint64_t *sizes = calloc(numPaths ? numPaths : 1, sizeof(uint64_t));
+  bool *isFile = calloc(numPaths ? numPaths : 1, sizeof(bool));
+  if (!sizes || !isFile) {
+    free(sizes);
+    free(isFile);
+    return -1;
+  }
+
+  size_t pathBytes = 0;
+  for (int i = 0; i < numPaths; i++) {
+    struct stat pathStat;
+    if (stat(paths[i], &pathStat) == 0 && S_ISREG(pathStat.st_mode)) {
+      isFile[i] = true;
+      sizes[i] = pathStat.st_size;
+      pathBytes += strlen(paths[i]) + 1;
+      queue->numJobs++;
+    }
+  }
+
+  size_t dequesSize = alignUp(numWorkers * sizeof(job_deque_t), 64);
+  size_t jobsSize = alignUp(queue->numJobs * sizeof(job_t), 64);
+  size_t slotsSize = alignUp(queue->numJobs * sizeof(uint32_t), 64);
+  queue->mapSize = dequesSize + jobsSize + slotsSize + pathBytes + 1;
+  queue->map = mmap(NULL, queue->mapSize, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (queue->map == MAP_FAILED) {
+    queue->map = NULL;
+    free(sizes);
+    free(isFile);
+    return -1;
+  }
+
+  uint8_t *base = queue->map;
+  queue->deques = (job_deque_t *)base;
+  queue->jobs = (job_t *)(base + dequesSize);
+  queue->slots = (uint32_t *)(base + dequesSize + jobsSize);
+  queue->paths = (char *)(base + dequesSize + jobsSize + slotsSize);
+
+  uint32_t job = 0;
+  uint32_t pathOffset = 0;
+  for (int i = 0; i < numPaths; i++) {
+    if (!isFile[i]) {
+      continue;
+    }
+    size_t length = strlen(paths[i]) + 1;
+    memcpy(queue->paths + pathOffset, paths[i], length);
+    queue->jobs[job].size = sizes[i];
+    queue->jobs[job].pathOffset = pathOffset;
+    queue->jobs[job].worker = -1;
+    queue->jobs[job].state = JOB_QUEUED;
+    pathOffset += length;
+    job++;
+  }
+
+  jobQueueOrder(queue, NULL);
+  free(sizes);
+  free(isFile);
+  return 0;
+}
+
+void jobQueueOrder(job_queue_t *queue, const uint32_t *order) {
+  // The i-th job to run goes to deque i % numWorkers. Owners take from the
+  // bottom, so each deque holds its jobs in reverse to have them run in order.
+  uint32_t start = 0;
+  for (int worker = 0; worker < queue->numWorkers; worker++) {
+    job_deque_t *deque = &queue->deques[worker];
+    uint32_t count = 0;
+    for (uint32_t i = worker; i < queue->numJobs; i += queue->numWorkers) {
+      count++;
+    }
+
+    deque->start = start;
+    deque->top = 0;
+    deque->bottom = count;
+    uint32_t slot = start + count;
+    for (uint32_t i = worker; i < queue->numJobs; i += queue->numWorkers) {
+      queue->slots[--slot] = order ? order[i] : i;
+    }
+    start += count;
+  }
+}
+
+void jobQueueFree(job_queue_t *queue) {
+  if (queue->map) {
+    munmap(queue->map, queue->mapSize);
+  }
+  memset(queue, 0, sizeof(*queue));
+}
+
+// Takes from the bottom of the worker's own deque. Only the last job can be
+// contended, by a thief, and whoever moves top past it first wins it.
+static int64_t takeOwn(job_queue_t *queue, job_deque_t *deque) {
+  int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int64_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+  int64_t job = -1;
+  if (top <= bottom) {
+    job = queue->slots[deque->start + bottom];
+    if (top == bottom) {
+      if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        job = -1;
+      }
+      __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+  } else {
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+  }
+  return job;
+}
+
+// Steals from the top of another worker's deque. Returns -1 if it is empty,
+// and retries if another thief or the owner got there first.
+static int64_t steal(job_queue_t *queue, job_deque_t *deque) {
+  while (1) {
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom) {
+      return -1;
+    }
+
+    int64_t job = queue->slots[deque->start + top];
+    if (__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      return job;
+    }
+  }
+}
+
+int64_t jobQueueTake(job_queue_t *queue, int worker) {
+  job_deque_t *own = &queue->deques[worker];
+  int64_t job = takeOwn(queue, own);
+  bool stolen = false;
+
+  // Nothing is pushed once the workers start, so a pass over the others that
+  // finds them all empty means the work is all handed out.
+  for (int i = 1; job < 0 && i < queue->numWorkers; i++) {
+    job = steal(queue, &queue->deques[(worker + i) % queue->numWorkers]);
+    stolen = job >= 0;
+  }
+  if (job < 0) {
+    return -1;
+  }
+
+  if (stolen) {
+    own->jobsStolen++;
+  }
+  queue->jobs[job].worker = worker;
+  __atomic_store_n(&queue->jobs[job].state, JOB_RUNNING, __ATOMIC_RELEASE);
+  return job;
+}
+
+const char *jobQueuePath(const job_queue_t *queue, uint32_t job) {
+  return queue->paths + queue->jobs[job].pathOffset;
+}
+
+void jobQueueFinish(job_queue_t *queue, int worker, uint32_t job,
+    uint64_t packets, double seconds) {
+  job_deque_t *own = &queue->deques[worker];
+  own->jobsDone++;
+  own->bytesDone += queue->jobs[job].size;
+  own->packetsDone += packets;
+  own->busySeconds += seconds;
+  queue->jobs[job].packets = packets;
+  queue->jobs[job].seconds = seconds;
+  __atomic_store_n(&queue->jobs[job].state, JOB_DONE, __ATOMIC_RELEASE);
+}
@@ -1,17 +1,18 @@
-#include <dirent.h>
 #include <err.h>
 #include <inttypes.h>
 #include <pcap/pcap.h>
-#include <poll.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <sysexits.h>
 #include <unistd.h>
-#include <sys/stat.h>
+#include <sys/wait.h>
 
+#include "config.h"
+#include "db.h"
+#include "jobQueue.h"
 #include "packetHandle.h"
-#include "protocol.h"
+#include "schedule.h"
 #include "util.h"
 #include "worker.h"
 #include "optparser.h"
@@ -19,35 +20,81 @@
 int main(int argc, char *argv[]) {
   
   int workerCount = -1;
+  bool interleave = false;
+  bool noDB = false;
   char **files;
   int numEntries;
 
-  optparser(argc, argv, &workerCount, &files, &numEntries);
+  optparser(argc, argv, &workerCount, &interleave, &noDB, &files, &numEntries);
 
   // Set number of workers to number of cores by default.
   if (workerCount < 1) {
     workerCount = sysconf(_SC_NPROCESSORS_ONLN);
   }
 
-  worker_t *workers = calloc(workerCount, sizeof(worker_t));
-  struct pollfd *pollfds = calloc(workerCount, sizeof(struct pollfd));
+  // Large captures are split over the workers' share of the CPUs, so that
+  // all of them doing so at once does not run one thread per CPU each.
+  analyzeInit(workerCount);
 
-  // Initialize worker processes.
+  // Lay out every job in shared memory before the workers start, so they can
+  // take them without going through the parent.
+  job_queue_t queue;
+  if (jobQueueInit(&queue, files, numEntries, workerCount) < 0) {
+    err(EX_OSERR, "could not map the job queue");
+  }
+
+  // Run the captures expected to take longest first, from their sizes and how
+  // fast their replicas went before.
+  char (*replicas)[REPLICA_MAX_LEN + 1] = calloc(queue.numJobs + 1,
+      sizeof(*replicas));
+  const char **replicaNames = calloc(queue.numJobs + 1, sizeof(char *));
+  double *estimates = calloc(queue.numJobs + 1, sizeof(double));
+  uint32_t *order = calloc(queue.numJobs + 1, sizeof(uint32_t));
+  schedule_history_t history;
+  scheduleHistoryLoad(&history, SCHEDULE_HISTORY_FILE);
+
+  double totalEstimate = 0;
+  for (uint32_t i = 0; i < queue.numJobs; i++) {
+    pcapReplica(jobQueuePath(&queue, i), replicas[i]);
+    replicaNames[i] = replicas[i];
+    estimates[i] = scheduleEstimate(&history, replicas[i], queue.jobs[i].size);
+    totalEstimate += estimates[i];
+  }
+  scheduleOrder(order, estimates, replicaNames, queue.numJobs, interleave);
+  jobQueueOrder(&queue, order);
+
+  worker_t *workers = calloc(workerCount, sizeof(worker_t));
   for (int i = 0; i < workerCount; i++) {
-    // Open pipe between worker and mediator.
-    if (pipe(workers[i].parent_to_worker_fd) < 0) {
-      err(EX_OSERR, "pipe error");
-    }
-    if (pipe(workers[i].worker_to_parent_fd) < 0) {
-      err(EX_OSERR, "pipe error");
-    }
+    workers[i].queue = &queue;
     workers[i].index = i;
+  }
 
-    // Set worker sockets to polling list.
-    pollfds[i].fd = workers[i].worker_to_parent_fd[0];
-    pollfds[i].events = POLLIN;
-    pollfds[i].revents = 0;
+  double startTime = getTimeSeconds();
 
+#if WORKER_THREADS
+  // Threads share one pool of clients, which only ever needs as many as can
+  // send a batch at the same time.
+  int poolSize = MONGODB_POOL_SIZE;
+  if (poolSize < 1 || poolSize > workerCount * PIPELINE_WRITERS) {
+    poolSize = workerCount * PIPELINE_WRITERS;
+  }
+  dbInit(poolSize, !noDB);
+
+  for (int i = 0; i < workerCount; i++) {
+    if (pthread_create(&workers[i].thread, NULL, worker_thread,
+          &workers[i]) != 0) {
+      fprintf(stderr, "pthread_create() failed\n");
+      exit(1);
+    }
+  }
+  for (int i = 0; i < workerCount; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+  dbCleanup();
+#else
+  // Initialize worker processes.
+  fflush(stdout);
+  for (int i = 0; i < workerCount; i++) {
     // Spawn worker processes.
     if ((workers[i].pid = fork()) < 0) {
       perror("fork() failed");
@@ -55,114 +102,72 @@ int main(int argc, char *argv[]) {
     }
 
     if (workers[i].pid == 0) { // is child process
+      dbInit(PIPELINE_WRITERS, !noDB);
       worker_job(&workers[i]);
+      dbCleanup();
       exit(0); // once worker is done, exit immediately
     }
   }
 
-  // Dispatch all jobs.
-  for (int i = 0; i < numEntries; i++) {
-    struct stat path_stat;
-    stat(files[i], &path_stat);
-    if (!S_ISREG(path_stat.st_mode)) {
-      continue; // if not regular file, skip
-    }
-
-    // Poll for ready worker.
-    for (int i = 0; i < workerCount; i++) {
-      pollfds[i].events = POLLIN | POLLPRI;
-      pollfds[i].revents = 0;
-    }
-
-    if (poll(pollfds, workerCount, -1) == -1) {
-      err(EX_OSERR, "poll error");
-      exit(1);
-    }
-
-    int read_fd = -1;
-    int write_fd = -1;
-    for (int i = 0; i < workerCount; i++) {
-      if (pollfds[i].revents) {
-        read_fd = pollfds[i].fd;
-        write_fd = workers[i].parent_to_worker_fd[1];
-        break;
-      }
+  // Wait for the workers to run out of jobs.
+  for (int i = 0; i < workerCount; i++) {
+    int status;
+    if (waitpid(workers[i].pid, &status, 0) < 0) {
+      err(EX_OSERR, "waitpid error");
     }
-
-    if (read_fd == -1 || write_fd == -1) {
-      fprintf(stderr, "Polling found invalid file descriptors.\n");
-      exit(1);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "[Error] Worker %d did not exit cleanly\n", i);
     }
-
-    // Communicate with available worker.
-    uint8_t opcode = 0;
-    uint8_t jobCode = JOB_CODE;
-    ssize_t read_bytes = read(read_fd, &opcode, 1);
-
-    if (opcode != READY_CODE) {
-      fprintf(stderr, "Invalid opcode from worker.\n");
-      exit(1);
-    }
-
-    // Send job to worker.
-    ssize_t written_bytes = write(write_fd, &jobCode, 1);
-    ssize_t job_bytes_sent = send_job(write_fd,
-        strlen(files[i]) + 1, (uint8_t *)files[i]);
-
-    UNUSED(written_bytes);
-    UNUSED(read_bytes);
-    UNUSED(job_bytes_sent);
   }
+#endif
 
-  // Terminate worker processes.
-  int workersLeft = workerCount;
-  while (workersLeft > 0) {
-    // Poll for ready worker.
-    for (int i = 0; i < workerCount; i++) {
-      pollfds[i].events = POLLIN | POLLPRI;
-      pollfds[i].revents = 0;
-    }
-
-    if (poll(pollfds, workerCount, -1) == -1) {
-      err(EX_OSERR, "poll error");
-      exit(1);
-    }
-
-    int read_fd = -1;
-    int write_fd = -1;
-    for (int i = 0; i < workerCount; i++) {
-      if (pollfds[i].revents) {
-        read_fd = pollfds[i].fd;
-        write_fd = workers[i].parent_to_worker_fd[1];
-        break;
-      }
-    }
+  double makespan = getTimeSeconds() - startTime;
 
-    if (read_fd == -1 || write_fd == -1) {
-      fprintf(stderr, "Polling found invalid file descriptors.\n");
-      exit(1);
+  uint32_t jobsDone = 0;
+  uint64_t packetsDone = 0;
+  double busySeconds = 0;
+  for (int i = 0; i < workerCount; i++) {
+    job_deque_t *deque = &queue.deques[i];
+    printf("worker %d | jobs: %" PRIu32 " (%" PRIu32 " stolen) | "
+        "bytes: %" PRIu64 " | packets: %" PRIu64 " | busy: %.3fs\n", i,
+        deque->jobsDone, deque->jobsStolen, deque->bytesDone,
+        deque->packetsDone, deque->busySeconds);
+    jobsDone += deque->jobsDone;
+    packetsDone += deque->packetsDone;
+    busySeconds += deque->busySeconds;
+  }
+  printf("makespan: %.3fs | work per worker: %.3fs | estimated: %.3fs\n",
+      makespan, busySeconds / workerCount, totalEstimate / workerCount);
+  printf("packets: %" PRIu64 " | packets per second: %.0f%s\n", packetsDone,
+      makespan > 0 ? packetsDone / makespan : 0, noDB ? " (parsing only)" : "");
+
+  // Jobs a failed worker took but never finished.
+  for (uint32_t i = 0; i < queue.numJobs; i++) {
+    if (queue.jobs[i].state != JOB_DONE) {
+      fprintf(stderr, "[Error] %s was not finished\n", jobQueuePath(&queue, i));
     }
+  }
 
-    // Send opcode to mark that jobs are done and worker should terminate.
-    uint8_t opcode = 0;
-    uint8_t terminateCode = TERMINATE_CODE;
-    ssize_t read_bytes = read(read_fd, &opcode, 1);
-    ssize_t written_bytes = write(write_fd, &terminateCode, 1);
-
-    UNUSED(written_bytes);
-    UNUSED(read_bytes);
-
-    if (opcode != READY_CODE) {
-      fprintf(stderr, "Invalid opcode from worker.\n");
-      exit(1);
+  // Remember how fast each replica went for the next run.
+  for (uint32_t i = 0; i < queue.numJobs; i++) {
+    if (queue.jobs[i].state == JOB_DONE && replicas[i][0]) {
+      scheduleHistoryAdd(&history, replicas[i], queue.jobs[i].size,
+          queue.jobs[i].seconds);
     }
-
-    workersLeft--;
   }
+  scheduleHistoryCommit(&history);
+  if (scheduleHistorySave(&history, SCHEDULE_HISTORY_FILE) < 0) {
+    warn("could not save the schedule history");
+  }
+  scheduleHistoryFree(&history);
+  free(replicas);
+  free(replicaNames);
+  free(estimates);
+  free(order);
 
   free(workers);
-  free(pollfds);
-  printf("Finished processing %d job(s)\n", numEntries);
+  printf("Finished processing %" PRIu32 " of %" PRIu32 " job(s)\n", jobsDone,
+      queue.numJobs);
+  jobQueueFree(&queue);
   return 0;
 }
-
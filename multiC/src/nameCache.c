@@ -0,0 +1,130 @@
+#include "nameCache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Multiply and shift hash over 8 byte words, with the length mixed in first.
+static uint64_t hashWire(const uint8_t *wire, uint16_t length) {
+  uint64_t hash = 0x9E3779B97F4A7C15ull ^ length;
+  size_t i = 0;
+  for (; i + 8 <= length; i += 8) {
+    uint64_t word;
+    memcpy(&word, wire + i, 8);
+    hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 32;
+  }
+
+  uint64_t tail = 0;
+  memcpy(&tail, wire + i, length - i);
+  hash = (hash ^ tail) * 0xC4CEB9FE1A85EC53ull;
+  return hash ^ (hash >> 29);
+}
+
+int nameCacheInit(name_cache_t *cache, uint32_t numSets) {
+  uint32_t size = 1;
+  while (size < numSets) {
+    size <<= 1;
+  }
+
+  memset(cache, 0, sizeof(*cache));
+  cache->mask = size - 1;
+  cache->nextID = 1;
+
+  // Entries are left uninitialized, so their pages are only touched once used.
+  if (posix_memalign((void **)&cache->sets, 64,
+        size * sizeof(name_cache_set_t)) != 0) {
+    cache->sets = NULL;
+    return -1;
+  }
+  cache->entries = malloc((size_t)size * NAME_CACHE_WAYS *
+      sizeof(name_cache_entry_t));
+  if (!cache->entries) {
+    free(cache->sets);
+    cache->sets = NULL;
+    return -1;
+  }
+
+  memset(cache->sets, 0, size * sizeof(name_cache_set_t));
+  return 0;
+}
+
+void nameCacheFree(name_cache_t *cache) {
+  free(cache->sets);
+  free(cache->entries);
+  cache->sets = NULL;
+  cache->entries = NULL;
+}
+
+// Writes the wire name out as parseDNS always has: the label bytes as they
+// are, each followed by a dot, and "." for the root.
+static void convertName(name_cache_entry_t *entry) {
+  const uint8_t *wire = entry->wire;
+  int length = 0;
+  int index = 0;
+  while (wire[index]) {
+    int labelLength = wire[index++];
+    memcpy(entry->name + length, wire + index, labelLength);
+    length += labelLength;
+    index += labelLength;
+    entry->name[length++] = '.';
+  }
+
+  if (!length) {
+    entry->name[length++] = '.';
+  }
+  entry->name[length] = '\0';
+  entry->nameLength = length;
+}
+
+const name_cache_entry_t *nameCacheLookup(name_cache_t *cache,
+    const uint8_t *wire, uint16_t wireLength) {
+  if (wireLength > NAME_CACHE_MAX_WIRE) {
+    return NULL;
+  }
+
+  uint64_t hash = hashWire(wire, wireLength);
+  uint32_t index = hash & cache->mask;
+  uint32_t tag = (uint32_t)(hash >> 32) | 1;
+  name_cache_set_t *set = &cache->sets[index];
+  name_cache_entry_t *ways = &cache->entries[(size_t)index * NAME_CACHE_WAYS];
+
+  for (int way = 0; way < NAME_CACHE_WAYS; way++) {
+    if (set->tags[way] == tag && set->wireLengths[way] == wireLength &&
+        !memcmp(ways[way].wire, wire, wireLength)) {
+      set->referenced |= 1 << way;
+      cache->hits++;
+      return &ways[way];
+    }
+  }
+
+  // Sweep to the first way whose reference bit is clear. Empty ways never
+  // have it set.
+  while (set->referenced & (1 << set->hand)) {
+    set->referenced &= ~(1 << set->hand);
+    set->hand = (set->hand + 1) % NAME_CACHE_WAYS;
+  }
+  int way = set->hand;
+  set->hand = (set->hand + 1) % NAME_CACHE_WAYS;
+
+  cache->misses++;
+  if (set->tags[way]) {
+    cache->evictions++;
+  }
+
+  set->tags[way] = tag;
+  set->wireLengths[way] = wireLength;
+  name_cache_entry_t *entry = &ways[way];
+  entry->id = cache->nextID++;
+  if (!cache->nextID) {
+    cache->nextID = 1;
+  }
+  entry->wireLength = wireLength;
+  memcpy(entry->wire, wire, wireLength);
+  convertName(entry);
+  return entry;
+}
+
+double nameCacheHitRate(const name_cache_t *cache) {
+  uint64_t lookups = cache->hits + cache->misses;
+  return lookups ? (double)cache->hits / lookups : 0;
+}
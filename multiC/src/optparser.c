@@ -3,9 +3,12 @@
 #include <stdio.h>
 #include <unistd.h>
 
-void optparser(int argc, char *argv[], int *workers, char **inputFiles[], int *inputFilesLength) {
+#include "optparser.h"
+
+void optparser(int argc, char *argv[], int *workers, bool *interleave,
+    bool *noDB, char **inputFiles[], int *inputFilesLength) {
   if (argc < 3) {
-    fprintf(stderr, "Usage: %s -i <pcap.gz files> [-w <worker count>]\n", argv[0]);
+    fprintf(stderr, "Usage: %s -i <pcap.gz files> [-w <worker count>] [-r] [-n]\n", argv[0]);
     exit(1);
   }
   int index = 1;
@@ -24,6 +27,18 @@ void optparser(int argc, char *argv[], int *workers, char **inputFiles[], int *i
       }
       *workers = atoi(argv[index + 1]);
       index = index + 2;
+    } else if (strcmp("-r", argv[index]) == 0) {
+      if (inputEnd != 0) {
+        inputEnd = index - 1;
+      }
+      *interleave = true;
+      index++;
+    } else if (strcmp("-n", argv[index]) == 0) {
+      if (inputEnd != 0) {
+        inputEnd = index - 1;
+      }
+      *noDB = true;
+      index++;
     } else if (strncmp("-", argv[index], 1) == 0) {
       fprintf(stderr, "Invalid option %s specified\n", argv[index]);
       exit(1);
@@ -35,7 +50,7 @@ void optparser(int argc, char *argv[], int *workers, char **inputFiles[], int *i
     }
   }
   if (inputEnd == 0) {
-    fprintf(stderr, "Usage: %s -i <pcap.gz files> [-w <worker count>]\n", argv[0]);
+    fprintf(stderr, "Usage: %s -i <pcap.gz files> [-w <worker count>] [-r] [-n]\n", argv[0]);
     exit(1);
   }
 
@@ -5,30 +5,58 @@
 #include <arpa/inet.h>
 #include <netinet/udp.h>
 #include <netinet/ip.h>
+#include <string.h>
 #include <unistd.h>
 #include <sysexits.h>
-#include <sys/wait.h>
+#include <pthread.h>
 #include <regex.h>
+#include <sys/mman.h>
 
 #include "dns.h"
 #include "util.h"
 #include "db.h"
+#include "config.h"
+#include "gzipReader.h"
+#include "parallelParse.h"
+#include "prefilter.h"
+#include "seekable.h"
 #include "packetHandle.h"
 
-int packetCount = 0;
-char *currReplica;
+// Number of packets pulled from a mapped capture at a time.
+#define READ_BATCH_SIZE 256
 
-void handlePacketCB(uint8_t *arg, const struct pcap_pkthdr *header,
-    const uint8_t *packet) {
+// Size of the buffer gzipped captures are inflated into and parsed from. It
+// has to hold at least one whole record.
+#define INFLATE_BUFFER_SIZE (4 << 20)
+
+// State of the capture a worker is on. Workers may be threads of one process,
+// so each has its own.
+static __thread int packetCount = 0;
+static __thread char *currReplica;
+
+// Question names seen by this worker, set up with its first capture, and the
+// arena the packets' other allocations come from until they are stored.
+static __thread name_cache_t nameCache;
+static __thread arena_t packetArena;
+static __thread bool hasNameCache = false;
+
+// Parses one filtered packet and stores its DNS data. Inlined into the
+// pipelines below with datalinkOffset fixed, as well as into handlePacketCB.
+static inline void handleDNSPacket(const struct pcap_pkthdr *header,
+    const uint8_t *packet, int datalinkOffset) {
 
   // increment packet count
   packetCount++;
 
-  const int datalinkOffset = *((int *)arg);
+  // Mapped captures are read in place, and the prefilter passes packets cut
+  // short right after the UDP source port, so nothing is read before it is
+  // known to have been captured.
+  if (header->caplen < (uint32_t)datalinkOffset + sizeof(struct ip)) {
+    return;
+  }
 
   // Grab IP information, and apply any necessary rules.
   const struct ip *headerIP = (const struct ip *)(packet + datalinkOffset);
-  const uint8_t *payloadIP = (uint8_t *)headerIP + (headerIP->ip_hl * 4);
   const struct in_addr destIP = headerIP->ip_dst;
   const struct in_addr sourceIP = headerIP->ip_src;
 
@@ -38,16 +66,26 @@ void handlePacketCB(uint8_t *arg, const struct pcap_pkthdr *header,
   if (headerIP->ip_v != 4) {
     return;
   }
+  if (internetHeaderLength < (int)sizeof(struct ip) ||
+      header->caplen < (uint32_t)(datalinkOffset + internetHeaderLength + 8)) {
+    return;
+  }
 
   // Grab the UDP information, and apply any necessary rules.
+  const uint8_t *payloadIP = (uint8_t *)headerIP + internetHeaderLength;
   const struct udphdr *headerUDP = (const struct udphdr *)payloadIP;
   const uint8_t *payloadUDP = (uint8_t *)headerUDP + 8;
-  const uint16_t payloadUDPSize = ntohs(headerUDP->len);
+  const uint16_t lengthUDP = ntohs(headerUDP->len);
   uint16_t sourcePort = ntohs(headerUDP->source);
   uint16_t destPort = ntohs(headerUDP->dest);
+  if (lengthUDP < 8) {
+    return;
+  }
+  const uint16_t payloadUDPSize = lengthUDP - 8;
 
   // Check if UDP payload size agrees with remaining packet size
-  int remainingBytes = header->caplen - datalinkOffset - internetHeaderLength;
+  int remainingBytes = header->caplen - datalinkOffset - internetHeaderLength -
+      8;
   if (payloadUDPSize > remainingBytes) {
     // skip
     return;
@@ -66,7 +104,8 @@ void handlePacketCB(uint8_t *arg, const struct pcap_pkthdr *header,
 
   // TODO(aliu1): Parse DNS-specific data.
   dns_t dns_out = {0};
-  int dnsCode = parseDNS(&dns_out, payloadUDP, payloadUDPSize);
+  int dnsCode = parseDNSFields(&dns_out, payloadUDP, payloadUDPSize,
+      dbFields());
   dns_out.packetTime = header->ts; // set packet time
   dns_out.replica = currReplica;
   // only process response
@@ -79,126 +118,539 @@ void handlePacketCB(uint8_t *arg, const struct pcap_pkthdr *header,
 
 }
 
-void parsePCAPStream(void (*cb)(uint8_t *, const struct pcap_pkthdr *, const uint8_t *)) {
-  char pcapErrorMsg[PCAP_ERRBUF_SIZE] = { 0 };
-  pcap_t *pcap = pcap_open_offline("-", pcapErrorMsg); // open stdin for stream
+void handlePacketCB(uint8_t *arg, const struct pcap_pkthdr *header,
+    const uint8_t *packet) {
+  handleDNSPacket(header, packet, *((int *)arg));
+}
 
-  if (pcap == NULL) {
-    fprintf(stderr, "Could not open pcap - %s\n",
-        pcapErrorMsg);
-    exit(1);
+// Maps a libpcap datalink type to the size of its link layer header.
+static int getDatalinkOffset(int datalinkType) {
+  switch(datalinkType) {
+    case DLT_LINUX_SLL:
+      return 16;
+    case DLT_EN10MB:
+      return 14;
+    case DLT_IEEE802:
+      return 22;
+    case DLT_NULL:
+      return 4;
+    case DLT_SLIP:
+    case DLT_PPP:
+      return 24;
+    case DLT_RAW:
+      return 0;
+    default:
+      fprintf(stderr, "Unknown datalink type %d\n", datalinkType);
+      exit(1);
   }
+}
 
-  // Apply libpcap filter
-  struct bpf_program bpf;
-  if (pcap_compile(pcap, &bpf, "udp port 53", 1, 0) < 0) { // filter only DNS data
+// Only DNS data is kept. Link types with a native filter use dnsRule, and the
+// rest the same rule compiled by libpcap.
+#define CAPTURE_FILTER "udp port 53"
+static const prefilter_rule_t dnsRule = { PREFILTER_UDP, 53 };
+
+// pcap_compile is not thread safe before libpcap 1.8.
+static pthread_mutex_t compileLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void compileFilter(pcap_t *pcap, struct bpf_program *bpf) {
+  pthread_mutex_lock(&compileLock);
+  if (pcap_compile(pcap, bpf, CAPTURE_FILTER, 1, 0) < 0) {
     fprintf(stderr, "Could not compile filter - %s\n", pcap_geterr(pcap));
     exit(1);
   }
-  if (pcap_setfilter(pcap, &bpf) < 0) {
-    fprintf(stderr, "Could not set filter - %s\n", pcap_geterr(pcap));
+  pthread_mutex_unlock(&compileLock);
+}
+
+// Link layer state for filtering views from the native readers. The filter is
+// set up for the first link type seen, since pcapng files only describe their
+// interfaces as they go.
+typedef void (*pipeline_t)(const pcap_view_t *views, size_t numViews);
+
+typedef struct {
+  int datalinkType;
+  int datalinkOffset;
+  bool native;              /* prefilter, or BPF through pcap */
+  pcap_t *pcap;
+  struct bpf_program bpf;
+  pipeline_t pipeline;      /* specialized path for handlePacketCB, or NULL */
+} packet_filter_t;
+
+static void openFilter(packet_filter_t *filter, int datalinkType) {
+  filter->datalinkType = datalinkType;
+  filter->datalinkOffset = getDatalinkOffset(filter->datalinkType);
+  filter->native = prefilterSupports(datalinkType);
+  filter->pcap = NULL;
+  filter->pipeline = NULL;
+  if (filter->native) {
+    return;
+  }
+
+  if ((filter->pcap = pcap_open_dead(filter->datalinkType, 65535)) == NULL) {
+    fprintf(stderr, "Could not create pcap handle for filtering\n");
     exit(1);
   }
-  pcap_freecode(&bpf);
+  compileFilter(filter->pcap, &filter->bpf);
+}
 
-  int datalinkType = pcap_datalink(pcap);
-  int datalinkOffset;
+// Fills in the libpcap header for a view.
+static void viewHeader(const pcap_view_t *view, struct pcap_pkthdr *header) {
+  header->ts.tv_sec = view->time / 1000000000;
+  header->ts.tv_usec = (view->time % 1000000000) / 1000;
+  header->caplen = view->caplen;
+  header->len = view->len;
+}
 
-  // Set data link offset based on data type.
-  switch(datalinkType) {
-    case DLT_LINUX_SLL:
-      datalinkOffset = 16;
-      break;
+// Writes the indices of the views that pass the filter to passed, and returns
+// how many did. Other link types are not supported within a file.
+static size_t selectViews(const packet_filter_t *filter,
+    const pcap_view_t *views, size_t numViews, uint32_t *passed) {
+  if (filter->native) {
+    return prefilterBatch(&dnsRule, filter->datalinkType, views, numViews,
+        passed);
+  }
+
+  size_t numPassed = 0;
+  for (size_t i = 0; i < numViews; i++) {
+    struct pcap_pkthdr header;
+    viewHeader(&views[i], &header);
+    if (views[i].datalink == filter->datalinkType &&
+        pcap_offline_filter(&filter->bpf, &header, views[i].data)) {
+      passed[numPassed++] = i;
+    }
+  }
+  return numPassed;
+}
+
+// Defines the whole per-batch path, from filter to database, for one link type
+// with a native filter, so that the link type is only looked at once per file
+// and the header size is a constant in handleDNSPacket.
+#define DEFINE_PIPELINE(name, DATALINK, HEADER_SIZE)                          \
+static void name(const pcap_view_t *views, size_t numViews) {                \
+  uint32_t passed[READ_BATCH_SIZE];                                          \
+  size_t numPassed = prefilterBatch(&dnsRule, DATALINK, views, numViews,     \
+      passed);                                                               \
+  for (size_t i = 0; i < numPassed; i++) {                                   \
+    const pcap_view_t *view = &views[passed[i]];                             \
+    struct pcap_pkthdr header;                                               \
+    viewHeader(view, &header);                                               \
+    handleDNSPacket(&header, view->data, HEADER_SIZE);                       \
+  }                                                                          \
+}
+
+DEFINE_PIPELINE(pipelineEthernet, DLT_EN10MB, 14)
+DEFINE_PIPELINE(pipelineLinuxSll, DLT_LINUX_SLL, 16)
+DEFINE_PIPELINE(pipelineRaw, DLT_RAW, 0)
+
+// Returns the pipeline for a link type, or NULL if it has none.
+static pipeline_t selectPipeline(int datalinkType) {
+  switch (datalinkType) {
     case DLT_EN10MB:
-      datalinkOffset = 14;
-      break;
-    case DLT_IEEE802:
-      datalinkOffset = 22;
-      break;
-    case DLT_NULL:
-      datalinkOffset = 4;
-      break;
-    case DLT_SLIP:
-    case DLT_PPP:
-      datalinkOffset = 24;
-      break;
+      return pipelineEthernet;
+    case DLT_LINUX_SLL:
+      return pipelineLinuxSll;
     case DLT_RAW:
-      datalinkOffset = 0;
-      break;
+      return pipelineRaw;
     default:
-      fprintf(stderr, "Unknown datalink type %d\n", datalinkType);
-      exit(1);
+      return NULL;
+  }
+}
+
+static void filterBatch(packet_filter_t *filter, const pcap_view_t *views,
+    size_t numViews,
+    void (*cb)(uint8_t *, const struct pcap_pkthdr *, const uint8_t *)) {
+  if (filter->datalinkType == -1) {
+    openFilter(filter, views[0].datalink);
+    if (cb == handlePacketCB) {
+      filter->pipeline = selectPipeline(filter->datalinkType);
+    }
   }
+  if (filter->pipeline) {
+    filter->pipeline(views, numViews);
+    return;
+  }
+
+  uint32_t passed[READ_BATCH_SIZE];
+  size_t numPassed = selectViews(filter, views, numViews, passed);
+  for (size_t i = 0; i < numPassed; i++) {
+    const pcap_view_t *view = &views[passed[i]];
+    struct pcap_pkthdr header;
+    viewHeader(view, &header);
+    cb((uint8_t *)&filter->datalinkOffset, &header, view->data);
+  }
+}
 
-  // Loops as the pcap stream is being processed, cb will be called for every available packet
-  if (pcap_loop(pcap, -1, cb, (uint8_t *)&datalinkOffset) < 0) {
-    fprintf(stderr, "Call to pcap_loop() failed - %s\n", pcap_geterr(pcap));
+// Filters a batch of views into a parse unit. Returns false if out of memory.
+static bool filterUnit(const packet_filter_t *filter, const pcap_view_t *views,
+    size_t numViews, parse_unit_t *unit) {
+  uint32_t passed[READ_BATCH_SIZE];
+  size_t numPassed = selectViews(filter, views, numViews, passed);
+  for (size_t i = 0; i < numPassed; i++) {
+    const pcap_view_t *view = &views[passed[i]];
+    struct pcap_pkthdr header;
+    viewHeader(view, &header);
+    if (!parseUnitAdd(unit, &header, view->data, filter->datalinkOffset)) {
+      unit->error = "out of memory";
+      return false;
+    }
+  }
+  return true;
+}
+
+static void closeFilter(packet_filter_t *filter) {
+  if (filter->pcap) {
+    pcap_freecode(&filter->bpf);
+    pcap_close(filter->pcap);
+  }
+}
+
+// Each worker's share of the online CPUs, set by analyzeInit.
+static int fileThreads = 0;
+
+void analyzeInit(int workers) {
+  int numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+  fileThreads = workers > 0 ? numCPUs / workers : numCPUs;
+  if (fileThreads < 1) {
+    fileThreads = 1;
+  }
+  gzipReaderSetThreads(fileThreads);
+}
+
+static int parseThreads(void) {
+  if (PARALLEL_PARSE_THREADS > 0) {
+    return PARALLEL_PARSE_THREADS;
+  }
+  if (fileThreads > 0) {
+    return fileThreads;
+  }
+  return sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+// Shared, read only state for parsing a mapped classic capture in ranges of
+// PARALLEL_PARSE_CHUNK_SIZE bytes. The template reader is past the header.
+typedef struct {
+  const pcap_reader_t *template;
+  const packet_filter_t *filter;
+  int numRanges;
+} range_parse_t;
+
+// Parses the records that start within a range. Unless told where the first
+// one is, the range guesses by resyncing, which the engine checks against
+// where the previous range stopped.
+static int parseRange(void *ctx, int index, size_t start, parse_unit_t *unit) {
+  range_parse_t *parse = ctx;
+  pcap_reader_t reader = *parse->template;
+  const uint8_t *map = reader.map;
+  size_t first = reader.cur - map;
+  size_t to = (index == parse->numRanges - 1) ? reader.mapSize :
+    first + (size_t)(index + 1) * PARALLEL_PARSE_CHUNK_SIZE;
+
+  if (start != PARSE_START_UNKNOWN) {
+    reader.cur = map + start;
+  } else if (index > 0) {
+    reader.cur = pcapReaderResync(&reader,
+        map + first + (size_t)index * PARALLEL_PARSE_CHUNK_SIZE);
+  }
+  unit->start = unit->end = reader.cur - map;
+  if (unit->start >= to) {
+    return 0;
+  }
+
+  pcap_view_t views[READ_BATCH_SIZE];
+  size_t numViews;
+  while ((numViews = pcapReaderNextBatch(&reader, views,
+          READ_BATCH_SIZE)) > 0) {
+    size_t numInRange = 0;
+    while (numInRange < numViews &&
+        (size_t)(views[numInRange].data - PCAP_RECORD_SIZE - map) < to) {
+      numInRange++;
+    }
+    if (!filterUnit(parse->filter, views, numInRange, unit)) {
+      return -1;
+    }
+    if (numInRange < numViews) {
+      unit->end = views[numInRange].data - PCAP_RECORD_SIZE - map;
+      return 0;
+    }
+  }
+  unit->end = reader.cur - map;
+  if (reader.error) {
+    unit->error = reader.error;
+    return -1;
+  }
+  return 0;
+}
+
+// Splits a large classic capture into ranges parsed on several threads.
+// Returns false if the capture should be read in one go instead.
+static bool parsePCAPRanges(pcap_reader_t *reader, char *filePath,
+    void (*cb)(uint8_t *, const struct pcap_pkthdr *, const uint8_t *)) {
+  int numThreads = parseThreads();
+  if (reader->isNG || numThreads < 2 ||
+      reader->mapSize < PARALLEL_PARSE_MIN_SIZE) {
+    return false;
+  }
+  madvise((void *)reader->map, reader->mapSize, MADV_WILLNEED);
+
+  // Classic pcap files have a single link type, so one filter serves all the
+  // threads.
+  packet_filter_t filter;
+  openFilter(&filter, reader->ifaces[0].datalink);
+
+  size_t dataSize = reader->end - reader->cur;
+  range_parse_t parse = { reader, &filter,
+    (dataSize + PARALLEL_PARSE_CHUNK_SIZE - 1) / PARALLEL_PARSE_CHUNK_SIZE };
+  double waitTime;
+  const char *error;
+  if (parallelParse(parse.numRanges, numThreads, parseRange, &parse, cb,
+        &waitTime, &error) < 0) {
+    fprintf(stderr, "[Error] Could not read %s - %s\n", filePath, error);
+  }
+  closeFilter(&filter);
+  return true;
+}
+
+void parsePCAPMapped(pcap_reader_t *reader, char *filePath,
+    void (*cb)(uint8_t *, const struct pcap_pkthdr *, const uint8_t *)) {
+  if (parsePCAPRanges(reader, filePath, cb)) {
+    return;
+  }
+  packet_filter_t filter = { .datalinkType = -1 };
+
+  pcap_view_t views[READ_BATCH_SIZE];
+  size_t numViews;
+  while ((numViews = pcapReaderNextBatch(reader, views, READ_BATCH_SIZE)) > 0) {
+    filterBatch(&filter, views, numViews, cb);
+  }
+
+  if (reader->error) {
+    fprintf(stderr, "[Error] Could not read %s - %s\n", filePath,
+        reader->error);
+  }
+  closeFilter(&filter);
+}
+
+double parsePCAPGzip(char *filePath,
+    void (*cb)(uint8_t *, const struct pcap_pkthdr *, const uint8_t *)) {
+  gzip_reader_t gzip;
+  if (gzipReaderOpen(&gzip, filePath) < 0) {
+    fprintf(stderr, "[Error] Could not read %s - %s\n", filePath, gzip.error);
+    return 0;
+  }
+
+  uint8_t *buffer;
+  if (posix_memalign((void **)&buffer, 64, INFLATE_BUFFER_SIZE)) {
+    fprintf(stderr, "Could not allocate decompression buffer\n");
     exit(1);
   }
 
+  packet_filter_t filter = { .datalinkType = -1 };
+  pcap_reader_t reader;
+  memset(&reader, 0, sizeof(reader));
+
+  // Each pass tops the buffer up behind whatever partial record the last one
+  // left over, then parses every complete record in it.
+  size_t filled = 0;
+  bool final = false;
+  while (!final) {
+    ssize_t bytes = gzipReaderRead(&gzip, buffer + filled,
+        INFLATE_BUFFER_SIZE - filled);
+    if (bytes < 0) {
+      fprintf(stderr, "[Error] Could not decompress %s - %s\n", filePath,
+          gzip.error);
+      break;
+    }
+    filled += bytes;
+    final = gzip.done;
+
+    pcapReaderFeed(&reader, buffer, filled, final);
+    pcap_view_t views[READ_BATCH_SIZE];
+    size_t numViews;
+    while ((numViews = pcapReaderNextBatch(&reader, views,
+            READ_BATCH_SIZE)) > 0) {
+      filterBatch(&filter, views, numViews, cb);
+    }
+    if (reader.error) {
+      fprintf(stderr, "[Error] Could not read %s - %s\n", filePath,
+          reader.error);
+      break;
+    }
+
+    size_t leftover = reader.end - reader.cur;
+    if (leftover == INFLATE_BUFFER_SIZE) {
+      fprintf(stderr, "[Error] Could not read %s - record too large\n",
+          filePath);
+      break;
+    }
+    memmove(buffer, reader.cur, leftover);
+    filled = leftover;
+  }
+
+  double inflateTime = gzip.inflateTime;
+  closeFilter(&filter);
+  free(buffer);
+  gzipReaderClose(&gzip);
+  return inflateTime;
+}
+
+// Shared, read only state for parsing the frames of a seekable capture. The
+// template reader has been through the pcap header in the first frame.
+typedef struct {
+  const seekable_file_t *file;
+  const pcap_reader_t *template;
+  const packet_filter_t *filter;
+} seekable_parse_t;
+
+static int parseFrame(void *ctx, int index, size_t start,
+    parse_unit_t *unit) {
+  seekable_parse_t *parse = ctx;
+  size_t size = parse->file->frames[index].size;
+
+  if (!(unit->buffer = malloc(size ? size : 1))) {
+    unit->error = "out of memory";
+    return -1;
+  }
+  if (seekableDecodeFrame(parse->file, index, unit->buffer, size) < 0) {
+    unit->error = "corrupt frame";
+    return -1;
+  }
+
+  // Every frame but the first starts on a record, so its reader picks up
+  // where the header left the template.
+  pcap_reader_t reader;
+  if (index == 0) {
+    memset(&reader, 0, sizeof(reader));
+  } else {
+    reader = *parse->template;
+  }
+  pcapReaderFeed(&reader, unit->buffer, size, true);
+
+  pcap_view_t views[READ_BATCH_SIZE];
+  size_t numViews;
+  while ((numViews = pcapReaderNextBatch(&reader, views,
+          READ_BATCH_SIZE)) > 0) {
+    if (!filterUnit(parse->filter, views, numViews, unit)) {
+      return -1;
+    }
+  }
+  if (reader.error) {
+    unit->error = reader.error;
+    return -1;
+  }
+  return 0;
 }
 
-void analyzePCAP(char *filePath,
+double parsePCAPSeekable(seekable_file_t *file, char *filePath,
     void (*cb)(uint8_t *, const struct pcap_pkthdr *, const uint8_t *)) {
+  // Read the pcap header out of the first frame, to learn the byte order,
+  // timestamp resolution and link type that every other frame is parsed with.
+  uint8_t header[PCAP_HEADER_SIZE];
+  pcap_reader_t template;
+  memset(&template, 0, sizeof(template));
+  if (file->frames[0].size < PCAP_HEADER_SIZE ||
+      seekableDecodeFrame(file, 0, header, PCAP_HEADER_SIZE) < 0) {
+    fprintf(stderr, "[Error] Could not read %s - corrupt frame\n", filePath);
+    return 0;
+  }
+  pcapReaderFeed(&template, header, PCAP_HEADER_SIZE, false);
+  pcapReaderNextBatch(&template, NULL, 0);
+  if (!template.started || template.isNG) {
+    fprintf(stderr, "[Error] Could not read %s - %s\n", filePath,
+        template.error ? template.error :
+        "seekable captures have to be classic pcap");
+    return 0;
+  }
 
+  // Classic pcap files have a single link type, so one filter serves all the
+  // threads.
+  packet_filter_t filter;
+  openFilter(&filter, template.ifaces[0].datalink);
+
+  seekable_parse_t parse = { file, &template, &filter };
+  double waitTime;
+  const char *error;
+  if (parallelParse(file->numFrames, parseThreads(), parseFrame, &parse, cb,
+        &waitTime, &error) < 0) {
+    fprintf(stderr, "[Error] Could not read %s - %s\n", filePath, error);
+  }
+  closeFilter(&filter);
+  return waitTime;
+}
+
+bool pcapReplica(const char *filePath, char *replica) {
   // regex parse region
   regex_t regex;
   regmatch_t pmatch[2];
-  char replicaStr[REPLICA_MAX_LEN + 1] = {0};
 
   if (regcomp(&regex, FILEPATH_REGEX, REG_ICASE|REG_EXTENDED) != 0) {
     fprintf(stderr, "[Error] Filepath regular expression error\n");
     exit(1);
   }
-  if (regexec(&regex, filePath, 2, pmatch, 0) == 0) {
-    sprintf(replicaStr, "%.*s", pmatch[1].rm_eo - pmatch[1].rm_so, &filePath[pmatch[1].rm_so]);
+  bool matched = regexec(&regex, filePath, 2, pmatch, 0) == 0;
+  if (matched) {
+    sprintf(replica, "%.*s", pmatch[1].rm_eo - pmatch[1].rm_so, &filePath[pmatch[1].rm_so]);
   } else {
-    fprintf(stderr, "[Error] Invalid filepath, did not pass regex check\n");
-    exit(1);
+    replica[0] = '\0';
   }
   regfree(&regex);
-  currReplica = replicaStr;
-
-  // set up analysis
+  return matched;
+}
 
-  // set up forking
-  pid_t child_pid;
-  int fd[2];
-  pipe(fd);
+int analyzePCAP(char *filePath,
+    void (*cb)(uint8_t *, const struct pcap_pkthdr *, const uint8_t *)) {
 
-  if ((child_pid = fork()) < 0) {
-    perror("fork() failed");
+  char replicaStr[REPLICA_MAX_LEN + 1] = {0};
+  if (!pcapReplica(filePath, replicaStr)) {
+    fprintf(stderr, "[Error] Invalid filepath, did not pass regex check\n");
     exit(1);
   }
+  currReplica = replicaStr;
 
-  if (child_pid == 0) { // is child
-    // set up pipe back to parent
-    close(fd[0]);
-    dup2(fd[1], STDOUT_FILENO);
-
-    // exec zcat
-    char *cmd[3];
-    cmd[0] = "zcat";
-    cmd[1] = filePath;
-    cmd[2] = NULL;
-    int exec_stat = execvp("zcat", cmd);
-    if (exec_stat == -1) {
-      fprintf(stderr, "Failed to execute zcat\n");
+  if (!hasNameCache) {
+    if (nameCacheInit(&nameCache, NAME_CACHE_SETS) < 0) {
+      fprintf(stderr, "Could not allocate the name cache\n");
       exit(1);
     }
-
-    close(fd[1]);
-  } else { // is parent
-    close(fd[1]);
-    dup2(fd[0], STDIN_FILENO);
-
-    // call the streaming parser
-    parsePCAPStream(cb);
-    close(fd[0]);
-    wait(NULL);
-    printf("done %s | packets: %d\n", filePath, packetCount);
-    packetCount = 0; // reset
+    dnsUseNameCache(&nameCache);
+    arenaInit(&packetArena, ARENA_BLOCK_SIZE);
+    dnsUseArena(&packetArena);
+    dbSetArena(&packetArena);
+    hasNameCache = true;
   }
 
+  // Uncompressed captures are mapped and read in place, and seekable ones are
+  // split up by frame. Anything else is assumed to be gzipped and inflated as
+  // it is parsed.
+  double startTime = getTimeSeconds();
+  double inflateTime = 0;
+  pcap_reader_t reader;
+  seekable_file_t seekable;
+  if (pcapReaderOpen(&reader, filePath) == 0) {
+    parsePCAPMapped(&reader, filePath, cb);
+    pcapReaderClose(&reader);
+  } else if (seekableOpen(&seekable, filePath) == 0) {
+    inflateTime = parsePCAPSeekable(&seekable, filePath, cb);
+    seekableClose(&seekable);
+  } else {
+    inflateTime = parsePCAPGzip(filePath, cb);
+  }
+  double parseTime = getTimeSeconds() - startTime - inflateTime;
+
+  printf("done %s | packets: %d | inflate: %.3fs | parse: %.3fs | "
+      "name cache hits: %.1f%%\n", filePath, packetCount, inflateTime,
+      parseTime, nameCacheHitRate(&nameCache) * 100);
+  int packets = packetCount;
+  packetCount = 0; // reset
+  return packets;
 }
 
+void analyzeCleanup() {
+  if (hasNameCache) {
+    dnsUseNameCache(NULL);
+    dnsUseArena(NULL);
+    dbSetArena(NULL);
+    nameCacheFree(&nameCache);
+    arenaFree(&packetArena);
+    hasNameCache = false;
+  }
+}
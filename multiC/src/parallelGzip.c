@@ -0,0 +1,418 @@
+#include "parallelGzip.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "deflate.h"
+
+typedef enum {
+  CHUNK_PENDING,
+  CHUNK_DECODING,
+  CHUNK_DONE
+} chunk_state_t;
+
+typedef struct {
+  chunk_state_t state;
+  bool found;               /* a block start was found and decoded */
+  deflate_chunk_t out;
+  uint32_t *spanCrcs;       /* CRC-32s of the byte output between members */
+  size_t numSpans;
+} parallel_chunk_t;
+
+struct parallel_gzip {
+  const uint8_t *data;
+  size_t size;
+  uint64_t firstBit;        /* first block of the first member */
+  size_t chunkSize;
+  int numChunks;
+  parallel_chunk_t *chunks;
+
+  pthread_t *threads;
+  int numThreads;
+  pthread_mutex_t lock;
+  pthread_cond_t chunkDone;
+  pthread_cond_t slotFree;
+  int nextChunk;            /* next chunk a thread may take */
+  int maxAhead;             /* chunks decoded ahead of the reader */
+  bool stopping;
+
+  // Reader state. The window always holds DEFLATE_WINDOW_SIZE bytes, of
+  // which only the last windowLen are real output.
+  int readChunk;
+  uint64_t expectedBit;     /* where the next chunk has to start */
+  bool ended;
+  uint32_t memberCrc;       /* of the current member's output so far */
+  uint32_t memberSize;
+  uint8_t window[DEFLATE_WINDOW_SIZE];
+  size_t windowLen;
+  deflate_decoder_t *decoder;
+  parallel_chunk_t fallback;
+  uint8_t *resolved;
+  size_t resolvedCap;
+
+  // Output of the chunk being handed out: resolved markers, then bytes.
+  bool haveChunk;
+  const uint8_t *segments[2];
+  size_t segmentLens[2];
+  int segment;
+  size_t segmentPos;
+};
+
+// Nominal start of a chunk. The real start is the first dynamic block at or
+// after it, which is also where the previous chunk stops decoding.
+static uint64_t chunkStartBit(const parallel_gzip_t *gzip, int index) {
+  if (index >= gzip->numChunks) {
+    return UINT64_MAX;
+  }
+  return (uint64_t)index * gzip->chunkSize * 8;
+}
+
+// Checksums the byte part of a chunk's output on the decoding thread, in spans
+// split at member ends, so that the reader only has to combine them.
+static bool checksumSpans(parallel_chunk_t *chunk) {
+  const deflate_chunk_t *out = &chunk->out;
+  size_t total = out->markedLen + out->bytesLen;
+
+  uint32_t *spanCrcs = realloc(chunk->spanCrcs,
+      (out->numMemberEnds + 1) * sizeof(uint32_t));
+  if (!spanCrcs) {
+    return false;
+  }
+  chunk->spanCrcs = spanCrcs;
+  chunk->numSpans = 0;
+
+  size_t pos = out->markedLen;
+  for (size_t i = 0; i <= out->numMemberEnds; i++) {
+    size_t end = (i < out->numMemberEnds) ? out->memberEnds[i].offset : total;
+    if (end > pos) {
+      chunk->spanCrcs[chunk->numSpans++] = crc32_z(0,
+          out->bytes + (pos - out->markedLen), end - pos);
+      pos = end;
+    }
+  }
+  return true;
+}
+
+static void freeChunk(parallel_chunk_t *chunk) {
+  deflateChunkFree(&chunk->out);
+  free(chunk->spanCrcs);
+  chunk->spanCrcs = NULL;
+  chunk->numSpans = 0;
+}
+
+static void decodeChunk(parallel_gzip_t *gzip, deflate_decoder_t *decoder,
+    int index) {
+  parallel_chunk_t *chunk = &gzip->chunks[index];
+  uint64_t stopBit = chunkStartBit(gzip, index + 1);
+
+  if (index == 0) {
+    // The first chunk is the only one whose start and window are known.
+    chunk->found = deflateDecode(decoder, &chunk->out, gzip->data, gzip->size,
+        gzip->firstBit, stopBit, gzip->window, 0) == 0;
+  } else {
+    chunk->found = deflateFindBlock(decoder, &chunk->out, gzip->data,
+        gzip->size, chunkStartBit(gzip, index), stopBit, stopBit) == 0;
+  }
+  chunk->found = chunk->found && checksumSpans(chunk);
+}
+
+static void *runDecoder(void *arg) {
+  parallel_gzip_t *gzip = arg;
+  deflate_decoder_t *decoder = deflateDecoderNew();
+
+  pthread_mutex_lock(&gzip->lock);
+  for (;;) {
+    while (!gzip->stopping && gzip->nextChunk < gzip->numChunks &&
+        gzip->nextChunk >= gzip->readChunk + gzip->maxAhead) {
+      pthread_cond_wait(&gzip->slotFree, &gzip->lock);
+    }
+    if (gzip->stopping || gzip->nextChunk >= gzip->numChunks) {
+      break;
+    }
+
+    int index = gzip->nextChunk++;
+    gzip->chunks[index].state = CHUNK_DECODING;
+    pthread_mutex_unlock(&gzip->lock);
+
+    if (decoder) {
+      decodeChunk(gzip, decoder, index);
+    }
+
+    pthread_mutex_lock(&gzip->lock);
+    gzip->chunks[index].state = CHUNK_DONE;
+    pthread_cond_broadcast(&gzip->chunkDone);
+  }
+  pthread_mutex_unlock(&gzip->lock);
+
+  deflateDecoderFree(decoder);
+  return NULL;
+}
+
+static void pushWindow(parallel_gzip_t *gzip, const uint8_t *data,
+    size_t len) {
+  // A chunk can end without any byte output, and then data may be NULL.
+  if (len == 0) {
+    return;
+  }
+  if (len >= DEFLATE_WINDOW_SIZE) {
+    memcpy(gzip->window, data + len - DEFLATE_WINDOW_SIZE,
+        DEFLATE_WINDOW_SIZE);
+  } else {
+    memmove(gzip->window, gzip->window + len, DEFLATE_WINDOW_SIZE - len);
+    memcpy(gzip->window + DEFLATE_WINDOW_SIZE - len, data, len);
+  }
+  gzip->windowLen += len;
+  if (gzip->windowLen > DEFLATE_WINDOW_SIZE) {
+    gzip->windowLen = DEFLATE_WINDOW_SIZE;
+  }
+}
+
+// Replaces the markers in a chunk's output with bytes from the window.
+static int resolveMarkers(parallel_gzip_t *gzip, const deflate_chunk_t *out) {
+  if (out->markedLen > gzip->resolvedCap) {
+    uint8_t *resolved = realloc(gzip->resolved, out->markedLen);
+    if (!resolved) {
+      return -1;
+    }
+    gzip->resolved = resolved;
+    gzip->resolvedCap = out->markedLen;
+  }
+
+  uint16_t firstValid = DEFLATE_MARKER + DEFLATE_WINDOW_SIZE - gzip->windowLen;
+  for (size_t i = 0; i < out->markedLen; i++) {
+    uint16_t value = out->marked[i];
+    if (value < 256) {
+      gzip->resolved[i] = value;
+    } else if (value >= firstValid) {
+      gzip->resolved[i] = gzip->window[value - DEFLATE_MARKER];
+    } else {
+      return -1;  // refers back past the start of the stream
+    }
+  }
+  return 0;
+}
+
+// Follows the running member checksum through a chunk's output, checking it
+// against the trailer of every member that ends in it.
+static int verifyChunk(parallel_gzip_t *gzip, const parallel_chunk_t *chunk) {
+  const deflate_chunk_t *out = &chunk->out;
+  size_t total = out->markedLen + out->bytesLen;
+  size_t pos = 0;
+  size_t span = 0;
+
+  for (size_t i = 0; i <= out->numMemberEnds; i++) {
+    size_t end = (i < out->numMemberEnds) ? out->memberEnds[i].offset : total;
+    if (pos < out->markedLen) {
+      size_t markedEnd = (end < out->markedLen) ? end : out->markedLen;
+      gzip->memberCrc = crc32_z(gzip->memberCrc, gzip->resolved + pos,
+          markedEnd - pos);
+      gzip->memberSize += markedEnd - pos;
+      pos = markedEnd;
+    }
+    if (end > pos) {
+      gzip->memberCrc = crc32_combine(gzip->memberCrc, chunk->spanCrcs[span++],
+          end - pos);
+      gzip->memberSize += end - pos;
+      pos = end;
+    }
+
+    if (i < out->numMemberEnds) {
+      if (gzip->memberCrc != out->memberEnds[i].crc ||
+          gzip->memberSize != out->memberEnds[i].size) {
+        return -1;
+      }
+      gzip->memberCrc = 0;
+      gzip->memberSize = 0;
+    }
+  }
+  return 0;
+}
+
+// Picks the output for the next chunk in order: the thread's own if it
+// started where the previous chunk stopped, else the chunk decoded again here
+// from the right place with the now known window.
+static int takeChunk(parallel_gzip_t *gzip, const char **error) {
+  int index = gzip->readChunk;
+
+  pthread_mutex_lock(&gzip->lock);
+  while (gzip->chunks[index].state != CHUNK_DONE) {
+    pthread_cond_wait(&gzip->chunkDone, &gzip->lock);
+  }
+  pthread_mutex_unlock(&gzip->lock);
+
+  parallel_chunk_t *chunk = &gzip->chunks[index];
+  uint64_t stopBit = chunkStartBit(gzip, index + 1);
+  const parallel_chunk_t *taken = NULL;
+
+  if (gzip->expectedBit >= stopBit) {
+    // The previous chunk ran through all of this one.
+  } else if (chunk->found && chunk->out.startBit == gzip->expectedBit) {
+    taken = chunk;
+  } else {
+    if (!gzip->decoder && !(gzip->decoder = deflateDecoderNew())) {
+      *error = "out of memory";
+      return -1;
+    }
+    const uint8_t *window = gzip->window + DEFLATE_WINDOW_SIZE -
+      gzip->windowLen;
+    if (deflateDecode(gzip->decoder, &gzip->fallback.out, gzip->data,
+          gzip->size, gzip->expectedBit, stopBit, window,
+          gzip->windowLen) < 0) {
+      *error = "corrupt deflate data";
+      return -1;
+    }
+    if (!checksumSpans(&gzip->fallback)) {
+      *error = "out of memory";
+      return -1;
+    }
+    taken = &gzip->fallback;
+  }
+
+  gzip->haveChunk = true;
+  gzip->segmentLens[0] = 0;
+  gzip->segmentLens[1] = 0;
+  gzip->segment = 0;
+  gzip->segmentPos = 0;
+  if (!taken) {
+    return 0;
+  }
+
+  const deflate_chunk_t *out = &taken->out;
+  if (out->markedLen && resolveMarkers(gzip, out) < 0) {
+    *error = "corrupt deflate data";
+    return -1;
+  }
+  if (verifyChunk(gzip, taken) < 0) {
+    *error = "incorrect data check";
+    return -1;
+  }
+  if (out->markedLen) {
+    gzip->segments[0] = gzip->resolved;
+    gzip->segmentLens[0] = out->markedLen;
+    pushWindow(gzip, gzip->resolved, out->markedLen);
+  }
+  gzip->segments[1] = out->bytes;
+  gzip->segmentLens[1] = out->bytesLen;
+  pushWindow(gzip, out->bytes, out->bytesLen);
+
+  gzip->expectedBit = out->endBit;
+  gzip->ended = out->streamEnd;
+  return 0;
+}
+
+static void releaseChunk(parallel_gzip_t *gzip) {
+  freeChunk(&gzip->chunks[gzip->readChunk]);
+  gzip->haveChunk = false;
+
+  pthread_mutex_lock(&gzip->lock);
+  gzip->readChunk++;
+  if (gzip->ended) {
+    gzip->stopping = true;
+  }
+  pthread_cond_broadcast(&gzip->slotFree);
+  pthread_mutex_unlock(&gzip->lock);
+}
+
+parallel_gzip_t *parallelGzipOpen(const uint8_t *data, size_t size,
+    int numThreads, size_t chunkSize) {
+  size_t header = gzipHeaderSize(data, size);
+  if (header == 0 || numThreads < 1 || chunkSize == 0) {
+    return NULL;
+  }
+
+  parallel_gzip_t *gzip = calloc(1, sizeof(*gzip));
+  if (!gzip) {
+    return NULL;
+  }
+  gzip->data = data;
+  gzip->size = size;
+  gzip->firstBit = (uint64_t)header * 8;
+  gzip->expectedBit = gzip->firstBit;
+  gzip->chunkSize = chunkSize;
+  gzip->numChunks = (size + chunkSize - 1) / chunkSize;
+  gzip->maxAhead = numThreads + 1;
+  gzip->chunks = calloc(gzip->numChunks, sizeof(*gzip->chunks));
+  gzip->threads = calloc(numThreads, sizeof(*gzip->threads));
+  pthread_mutex_init(&gzip->lock, NULL);
+  pthread_cond_init(&gzip->chunkDone, NULL);
+  pthread_cond_init(&gzip->slotFree, NULL);
+  if (!gzip->chunks || !gzip->threads) {
+    parallelGzipClose(gzip);
+    return NULL;
+  }
+
+  for (int i = 0; i < numThreads; i++) {
+    if (pthread_create(&gzip->threads[i], NULL, runDecoder, gzip) != 0) {
+      parallelGzipClose(gzip);
+      return NULL;
+    }
+    gzip->numThreads++;
+  }
+  return gzip;
+}
+
+ssize_t parallelGzipRead(parallel_gzip_t *gzip, uint8_t *out, size_t len,
+    const char **error) {
+  size_t copied = 0;
+
+  while (copied < len) {
+    if (!gzip->haveChunk) {
+      if (gzip->ended || gzip->readChunk >= gzip->numChunks) {
+        break;
+      }
+      if (takeChunk(gzip, error) < 0) {
+        return -1;
+      }
+    }
+    if (gzip->segment == 2) {
+      releaseChunk(gzip);
+      continue;
+    }
+
+    size_t left = gzip->segmentLens[gzip->segment] - gzip->segmentPos;
+    if (left == 0) {
+      gzip->segment++;
+      gzip->segmentPos = 0;
+      continue;
+    }
+    if (left > len - copied) {
+      left = len - copied;
+    }
+    memcpy(out + copied, gzip->segments[gzip->segment] + gzip->segmentPos,
+        left);
+    gzip->segmentPos += left;
+    copied += left;
+  }
+
+  if (copied == 0 && !gzip->ended) {
+    *error = "unexpected end of file";
+    return -1;
+  }
+  return copied;
+}
+
+void parallelGzipClose(parallel_gzip_t *gzip) {
+  pthread_mutex_lock(&gzip->lock);
+  gzip->stopping = true;
+  pthread_cond_broadcast(&gzip->slotFree);
+  pthread_mutex_unlock(&gzip->lock);
+
+  for (int i = 0; i < gzip->numThreads; i++) {
+    pthread_join(gzip->threads[i], NULL);
+  }
+  for (int i = 0; gzip->chunks && i < gzip->numChunks; i++) {
+    freeChunk(&gzip->chunks[i]);
+  }
+
+  pthread_mutex_destroy(&gzip->lock);
+  pthread_cond_destroy(&gzip->chunkDone);
+  pthread_cond_destroy(&gzip->slotFree);
+  deflateDecoderFree(gzip->decoder);
+  freeChunk(&gzip->fallback);
+  free(gzip->resolved);
+  free(gzip->chunks);
+  free(gzip->threads);
+  free(gzip);
+}
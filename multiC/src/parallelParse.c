@@ -0,0 +1,163 @@
+#include "parallelParse.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  int numUnits;
+  parse_unit_t *units;
+  bool *done;
+  unit_parser_t parseUnit;
+  void *ctx;
+
+  pthread_mutex_t lock;
+  pthread_cond_t unitDone;
+  pthread_cond_t slotFree;
+  int nextUnit;             /* next unit a thread may take */
+  int readUnit;             /* next unit to hand to the callback */
+  int maxAhead;
+  bool stopping;
+} parallel_parse_t;
+
+static void freeUnit(parse_unit_t *unit) {
+  free(unit->packets);
+  free(unit->buffer);
+  memset(unit, 0, sizeof(*unit));
+}
+
+bool parseUnitAdd(parse_unit_t *unit, const struct pcap_pkthdr *header,
+    const uint8_t *data, int datalinkOffset) {
+  if (unit->numPackets == unit->packetsCap) {
+    size_t packetsCap = unit->packetsCap ? unit->packetsCap * 2 : 1024;
+    parsed_packet_t *packets = realloc(unit->packets,
+        packetsCap * sizeof(*packets));
+    if (!packets) {
+      return false;
+    }
+    unit->packets = packets;
+    unit->packetsCap = packetsCap;
+  }
+
+  parsed_packet_t *packet = &unit->packets[unit->numPackets++];
+  packet->header = *header;
+  packet->data = data;
+  packet->datalinkOffset = datalinkOffset;
+  return true;
+}
+
+static void *runParser(void *arg) {
+  parallel_parse_t *parse = arg;
+
+  pthread_mutex_lock(&parse->lock);
+  for (;;) {
+    while (!parse->stopping && parse->nextUnit < parse->numUnits &&
+        parse->nextUnit >= parse->readUnit + parse->maxAhead) {
+      pthread_cond_wait(&parse->slotFree, &parse->lock);
+    }
+    if (parse->stopping || parse->nextUnit >= parse->numUnits) {
+      break;
+    }
+
+    int index = parse->nextUnit++;
+    pthread_mutex_unlock(&parse->lock);
+
+    parse_unit_t *unit = &parse->units[index];
+    if (parse->parseUnit(parse->ctx, index, PARSE_START_UNKNOWN, unit) < 0 &&
+        !unit->error) {
+      unit->error = "could not parse capture";
+    }
+
+    pthread_mutex_lock(&parse->lock);
+    parse->done[index] = true;
+    pthread_cond_broadcast(&parse->unitDone);
+  }
+  pthread_mutex_unlock(&parse->lock);
+  return NULL;
+}
+
+int parallelParse(int numUnits, int numThreads, unit_parser_t parseUnit,
+    void *ctx, void (*cb)(uint8_t *, const struct pcap_pkthdr *,
+      const uint8_t *), double *waitTime, const char **error) {
+  parallel_parse_t parse;
+  memset(&parse, 0, sizeof(parse));
+  parse.numUnits = numUnits;
+  parse.parseUnit = parseUnit;
+  parse.ctx = ctx;
+  parse.maxAhead = numThreads + 1;
+  parse.units = calloc(numUnits, sizeof(*parse.units));
+  parse.done = calloc(numUnits, sizeof(*parse.done));
+  pthread_t *threads = calloc(numThreads, sizeof(*threads));
+  pthread_mutex_init(&parse.lock, NULL);
+  pthread_cond_init(&parse.unitDone, NULL);
+  pthread_cond_init(&parse.slotFree, NULL);
+
+  *waitTime = 0;
+  *error = NULL;
+  int numStarted = 0;
+  size_t prevEnd = 0;
+  if (!parse.units || !parse.done || !threads) {
+    *error = "out of memory";
+  }
+  while (!*error && numStarted < numThreads) {
+    if (pthread_create(&threads[numStarted], NULL, runParser, &parse) != 0) {
+      *error = "could not start parsing threads";
+      break;
+    }
+    numStarted++;
+  }
+
+  for (int i = 0; !*error && i < numUnits; i++) {
+    double start = getTimeSeconds();
+    pthread_mutex_lock(&parse.lock);
+    while (!parse.done[i]) {
+      pthread_cond_wait(&parse.unitDone, &parse.lock);
+    }
+    pthread_mutex_unlock(&parse.lock);
+    *waitTime += getTimeSeconds() - start;
+
+    parse_unit_t *unit = &parse.units[i];
+    if (i > 0 && unit->start != prevEnd) {
+      freeUnit(unit);
+      if (parseUnit(ctx, i, prevEnd, unit) < 0 && !unit->error) {
+        unit->error = "could not parse capture";
+      }
+    }
+    // Packets from before an error are still delivered, as a serial read
+    // would have.
+    for (size_t j = 0; j < unit->numPackets; j++) {
+      parsed_packet_t *packet = &unit->packets[j];
+      cb((uint8_t *)&packet->datalinkOffset, &packet->header, packet->data);
+    }
+    if (unit->error) {
+      *error = unit->error;
+      break;
+    }
+    prevEnd = unit->end;
+    freeUnit(unit);
+
+    pthread_mutex_lock(&parse.lock);
+    parse.readUnit++;
+    pthread_cond_broadcast(&parse.slotFree);
+    pthread_mutex_unlock(&parse.lock);
+  }
+
+  pthread_mutex_lock(&parse.lock);
+  parse.stopping = true;
+  pthread_cond_broadcast(&parse.slotFree);
+  pthread_mutex_unlock(&parse.lock);
+  for (int i = 0; i < numStarted; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  for (int i = 0; parse.units && i < numUnits; i++) {
+    freeUnit(&parse.units[i]);
+  }
+  pthread_mutex_destroy(&parse.lock);
+  pthread_cond_destroy(&parse.unitDone);
+  pthread_cond_destroy(&parse.slotFree);
+  free(parse.units);
+  free(parse.done);
+  free(threads);
+  return *error ? -1 : 0;
+}
@@ -0,0 +1,433 @@
+#include "pcapReader.h"
+
+#include <fcntl.h>
+#include <pcap/pcap.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PCAP_MAGIC_US         0xA1B2C3D4
+#define PCAP_MAGIC_US_SWAPPED 0xD4C3B2A1
+#define PCAP_MAGIC_NS         0xA1B23C4D
+#define PCAP_MAGIC_NS_SWAPPED 0x4D3CB2A1
+
+#define PCAPNG_SHB            0x0A0D0D0A
+#define PCAPNG_IDB            0x00000001
+#define PCAPNG_PB             0x00000002
+#define PCAPNG_SPB            0x00000003
+#define PCAPNG_EPB            0x00000006
+#define PCAPNG_BYTE_ORDER     0x1A2B3C4D
+#define PCAPNG_SHB_MIN_SIZE   28
+
+#define PCAPNG_OPT_END        0
+#define PCAPNG_OPT_TSRESOL    9
+#define PCAPNG_OPT_TSOFFSET   14
+
+#define LINKTYPE_RAW          101
+
+#define NS_PER_SECOND         1000000000ull
+
+// Consecutive plausible record headers needed to trust a resync point.
+#define RESYNC_RECORDS        8
+
+static uint16_t get16(const pcap_reader_t *reader, const uint8_t *p) {
+  uint16_t value;
+  memcpy(&value, p, sizeof(value));
+  return reader->swapped ? __builtin_bswap16(value) : value;
+}
+
+static uint32_t get32(const pcap_reader_t *reader, const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return reader->swapped ? __builtin_bswap32(value) : value;
+}
+
+static uint64_t get64(const pcap_reader_t *reader, const uint8_t *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return reader->swapped ? __builtin_bswap64(value) : value;
+}
+
+static size_t remaining(const pcap_reader_t *reader) {
+  return reader->end - reader->cur;
+}
+
+// Link types in files are LINKTYPE_* values, which only differ from libpcap's
+// DLT_* values for a few historical types.
+static int linktypeToDatalink(uint32_t linktype) {
+  linktype &= 0xFFFF;
+  return (linktype == LINKTYPE_RAW) ? DLT_RAW : (int)linktype;
+}
+
+static uint64_t toNanoseconds(uint64_t ts, const pcap_iface_t *iface) {
+  uint64_t seconds = ts / iface->unitsPerSecond + iface->offset;
+  uint64_t fraction = ts % iface->unitsPerSecond;
+
+  if (iface->unitsPerSecond == 1000000) {
+    return seconds * NS_PER_SECOND + fraction * 1000;
+  } else if (iface->unitsPerSecond == NS_PER_SECOND) {
+    return seconds * NS_PER_SECOND + fraction;
+  }
+  return seconds * NS_PER_SECOND + (uint64_t)(((unsigned __int128)fraction *
+        NS_PER_SECOND) / iface->unitsPerSecond);
+}
+
+static bool fail(pcap_reader_t *reader, const char *msg) {
+  reader->error = msg;
+  reader->cur = reader->end;
+  return false;
+}
+
+// Called when the buffer ends part way through a header or record. That is
+// only an error if nothing more is coming.
+static bool needMore(pcap_reader_t *reader, const char *msg) {
+  if (reader->final) {
+    return fail(reader, msg);
+  }
+  return false;
+}
+
+static bool readClassicHeader(pcap_reader_t *reader, uint32_t magic) {
+  uint64_t unitsPerSecond;
+  switch (magic) {
+    case PCAP_MAGIC_US:
+      reader->swapped = false;
+      unitsPerSecond = 1000000;
+      break;
+    case PCAP_MAGIC_US_SWAPPED:
+      reader->swapped = true;
+      unitsPerSecond = 1000000;
+      break;
+    case PCAP_MAGIC_NS:
+      reader->swapped = false;
+      unitsPerSecond = NS_PER_SECOND;
+      break;
+    case PCAP_MAGIC_NS_SWAPPED:
+      reader->swapped = true;
+      unitsPerSecond = NS_PER_SECOND;
+      break;
+    default:
+      return fail(reader, "not an uncompressed pcap or pcapng file");
+  }
+
+  if (remaining(reader) < PCAP_HEADER_SIZE) {
+    return needMore(reader, "truncated pcap header");
+  }
+
+  reader->ifaces[0].datalink = linktypeToDatalink(get32(reader,
+        reader->cur + 20));
+  reader->ifaces[0].unitsPerSecond = unitsPerSecond;
+  reader->ifaces[0].offset = 0;
+  reader->numIfaces = 1;
+  reader->snaplen = get32(reader, reader->cur + 16);
+  reader->isNG = false;
+  reader->cur += PCAP_HEADER_SIZE;
+  return true;
+}
+
+static bool readSectionHeader(pcap_reader_t *reader) {
+  // The byte order magic decides how the rest of the section is read,
+  // including this block's own length.
+  if (remaining(reader) < PCAPNG_SHB_MIN_SIZE) {
+    return needMore(reader, "truncated section header");
+  }
+
+  uint32_t byteOrder;
+  memcpy(&byteOrder, reader->cur + 8, sizeof(byteOrder));
+  if (byteOrder == PCAPNG_BYTE_ORDER) {
+    reader->swapped = false;
+  } else if (byteOrder == __builtin_bswap32(PCAPNG_BYTE_ORDER)) {
+    reader->swapped = true;
+  } else {
+    return fail(reader, "bad section byte order magic");
+  }
+
+  uint32_t blockLen = get32(reader, reader->cur + 4);
+  if (blockLen < PCAPNG_SHB_MIN_SIZE || blockLen % 4) {
+    return fail(reader, "bad section header length");
+  }
+  if (blockLen > remaining(reader)) {
+    return needMore(reader, "truncated section header");
+  }
+
+  // Interface ids are numbered per section.
+  reader->numIfaces = 0;
+  reader->isNG = true;
+  reader->cur += blockLen;
+  return true;
+}
+
+static bool readHeader(pcap_reader_t *reader) {
+  if (remaining(reader) < 4) {
+    return needMore(reader, "truncated file header");
+  }
+
+  uint32_t magic;
+  memcpy(&magic, reader->cur, sizeof(magic));
+  if (magic == PCAPNG_SHB ? !readSectionHeader(reader) :
+      !readClassicHeader(reader, magic)) {
+    return false;
+  }
+
+  reader->started = true;
+  return true;
+}
+
+static bool readInterface(pcap_reader_t *reader, const uint8_t *body,
+    size_t size) {
+  if (size < 8) {
+    return fail(reader, "truncated interface description");
+  }
+  if (reader->numIfaces == PCAP_READER_MAX_IFACES) {
+    return fail(reader, "too many interfaces");
+  }
+
+  pcap_iface_t *iface = &reader->ifaces[reader->numIfaces];
+  iface->datalink = linktypeToDatalink(get16(reader, body));
+  iface->unitsPerSecond = 1000000;
+  iface->offset = 0;
+
+  const uint8_t *opt = body + 8;
+  const uint8_t *optEnd = body + size;
+  while (opt + 4 <= optEnd) {
+    uint16_t code = get16(reader, opt);
+    uint16_t len = get16(reader, opt + 2);
+    const uint8_t *value = opt + 4;
+    if (code == PCAPNG_OPT_END || value + len > optEnd) {
+      break;
+    }
+
+    if (code == PCAPNG_OPT_TSRESOL && len >= 1) {
+      // High bit set means a power of two, otherwise a power of ten.
+      uint8_t resol = value[0];
+      uint64_t units = 1;
+      if (resol & 0x80) {
+        if ((resol & 0x7F) > 63) {
+          return fail(reader, "bad timestamp resolution");
+        }
+        units = 1ull << (resol & 0x7F);
+      } else {
+        if (resol > 19) {
+          return fail(reader, "bad timestamp resolution");
+        }
+        for (int i = 0; i < resol; i++) {
+          units *= 10;
+        }
+      }
+      iface->unitsPerSecond = units;
+    } else if (code == PCAPNG_OPT_TSOFFSET && len >= 8) {
+      iface->offset = get64(reader, value);
+    }
+
+    opt = value + ((len + 3) & ~3);
+  }
+
+  reader->numIfaces++;
+  return true;
+}
+
+static bool nextClassic(pcap_reader_t *reader, pcap_view_t *view) {
+  if (reader->cur >= reader->end) {
+    return false;
+  }
+  if (remaining(reader) < PCAP_RECORD_SIZE) {
+    return needMore(reader, "truncated record header");
+  }
+
+  const uint8_t *cur = reader->cur;
+  uint32_t caplen = get32(reader, cur + 8);
+  if (caplen > remaining(reader) - PCAP_RECORD_SIZE) {
+    return needMore(reader, "truncated record");
+  }
+
+  const pcap_iface_t *iface = &reader->ifaces[0];
+  view->time = toNanoseconds((uint64_t)get32(reader, cur) *
+      iface->unitsPerSecond + get32(reader, cur + 4), iface);
+  view->caplen = caplen;
+  view->len = get32(reader, cur + 12);
+  view->datalink = iface->datalink;
+  view->data = cur + PCAP_RECORD_SIZE;
+
+  reader->cur += PCAP_RECORD_SIZE + caplen;
+  return true;
+}
+
+static bool nextNG(pcap_reader_t *reader, pcap_view_t *view) {
+  while (reader->cur < reader->end) {
+    if (remaining(reader) < 12) {
+      return needMore(reader, "truncated block header");
+    }
+
+    uint32_t type;
+    memcpy(&type, reader->cur, sizeof(type));
+    if (type == PCAPNG_SHB) {
+      if (!readSectionHeader(reader)) {
+        return false;
+      }
+      continue;
+    }
+
+    type = get32(reader, reader->cur);
+    uint32_t blockLen = get32(reader, reader->cur + 4);
+    if (blockLen < 12 || blockLen % 4) {
+      return fail(reader, "bad block length");
+    }
+    if (blockLen > remaining(reader)) {
+      return needMore(reader, "truncated block");
+    }
+
+    const uint8_t *body = reader->cur + 8;
+    size_t bodyLen = blockLen - 12;
+    reader->cur += blockLen;
+
+    if (type == PCAPNG_IDB) {
+      if (!readInterface(reader, body, bodyLen)) {
+        return false;
+      }
+    } else if (type == PCAPNG_EPB || type == PCAPNG_PB) {
+      if (bodyLen < 20) {
+        return fail(reader, "truncated packet block");
+      }
+
+      uint32_t ifaceId = (type == PCAPNG_EPB) ? get32(reader, body) :
+        get16(reader, body);
+      uint32_t caplen = get32(reader, body + 12);
+      if (ifaceId >= (uint32_t)reader->numIfaces) {
+        return fail(reader, "packet for unknown interface");
+      }
+      if (caplen > bodyLen - 20) {
+        return fail(reader, "truncated packet data");
+      }
+
+      const pcap_iface_t *iface = &reader->ifaces[ifaceId];
+      uint64_t ts = ((uint64_t)get32(reader, body + 4) << 32) |
+        get32(reader, body + 8);
+      view->time = toNanoseconds(ts, iface);
+      view->caplen = caplen;
+      view->len = get32(reader, body + 16);
+      view->datalink = iface->datalink;
+      view->data = body + 20;
+      return true;
+    } else if (type == PCAPNG_SPB) {
+      if (bodyLen < 4 || reader->numIfaces == 0) {
+        return fail(reader, "bad simple packet block");
+      }
+
+      // Simple packet blocks carry no timestamp or captured length.
+      uint32_t len = get32(reader, body);
+      view->time = 0;
+      view->caplen = (len < bodyLen - 4) ? len : (uint32_t)(bodyLen - 4);
+      view->len = len;
+      view->datalink = reader->ifaces[0].datalink;
+      view->data = body + 4;
+      return true;
+    }
+    // Anything else (statistics, name resolution, ...) is skipped.
+  }
+
+  return false;
+}
+
+int pcapReaderOpen(pcap_reader_t *reader, const char *filePath) {
+  memset(reader, 0, sizeof(*reader));
+
+  int fd = open(filePath, O_RDONLY);
+  if (fd < 0) {
+    reader->error = "could not open file";
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    close(fd);
+    reader->error = "file is empty or unreadable";
+    return -1;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    reader->error = "could not map file";
+    return -1;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  reader->map = map;
+  reader->mapSize = st.st_size;
+  reader->cur = map;
+  reader->end = reader->cur + st.st_size;
+  reader->final = true;
+
+  if (!readHeader(reader)) {
+    const char *error = reader->error;
+    pcapReaderClose(reader);
+    reader->error = error;
+    return -1;
+  }
+  return 0;
+}
+
+void pcapReaderFeed(pcap_reader_t *reader, const uint8_t *data, size_t size,
+    bool final) {
+  reader->cur = data;
+  reader->end = data + size;
+  reader->final = final;
+}
+
+size_t pcapReaderNextBatch(pcap_reader_t *reader, pcap_view_t *views,
+    size_t max) {
+  if (!reader->started && !readHeader(reader)) {
+    return 0;
+  }
+
+  size_t n = 0;
+  if (reader->isNG) {
+    while (n < max && nextNG(reader, &views[n])) {
+      n++;
+    }
+  } else {
+    while (n < max && nextClassic(reader, &views[n])) {
+      n++;
+    }
+  }
+  return n;
+}
+
+// Whether a classic record header could start at p: the timestamp fraction
+// is in range, and the captured length fits the snapshot length, the wire
+// length and the data.
+static bool plausibleRecord(const pcap_reader_t *reader, const uint8_t *p) {
+  if (reader->end - p < PCAP_RECORD_SIZE) {
+    return false;
+  }
+  uint32_t caplen = get32(reader, p + 8);
+  return get32(reader, p + 4) < reader->ifaces[0].unitsPerSecond &&
+    caplen <= get32(reader, p + 12) &&
+    (reader->snaplen == 0 || caplen <= reader->snaplen) &&
+    caplen <= (size_t)(reader->end - p) - PCAP_RECORD_SIZE;
+}
+
+const uint8_t *pcapReaderResync(const pcap_reader_t *reader,
+    const uint8_t *from) {
+  for (const uint8_t *p = from; p < reader->end; p++) {
+    const uint8_t *next = p;
+    int n = 0;
+    while (n < RESYNC_RECORDS && next < reader->end &&
+        plausibleRecord(reader, next)) {
+      next += PCAP_RECORD_SIZE + get32(reader, next + 8);
+      n++;
+    }
+    if (n == RESYNC_RECORDS || (n > 0 && next == reader->end)) {
+      return p;
+    }
+  }
+  return reader->end;
+}
+
+void pcapReaderClose(pcap_reader_t *reader) {
+  if (reader->map) {
+    munmap((void *)reader->map, reader->mapSize);
+  }
+  memset(reader, 0, sizeof(*reader));
+}
@@ -0,0 +1,179 @@
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+
+#include "config.h"
+#include "gzipReader.h"
+#include "pcapReader.h"
+#include "seekable.h"
+
+// Number of packets pulled from the input at a time.
+#define READ_BATCH_SIZE 256
+
+// Size of the buffer gzipped input is inflated into.
+#define INFLATE_BUFFER_SIZE (4 << 20)
+
+// Collects whole records into frames of about SEEKABLE_FRAME_SIZE bytes.
+typedef struct {
+  seekable_writer_t writer;
+  uint8_t *frame;
+  size_t frameLen;
+  size_t frameCap;
+  bool started;             /* the pcap header is in the first frame */
+} recompressor_t;
+
+static void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-zstd|-lz4] [-l <level>] <input pcap[.gz]> "
+      "<output>\n", name);
+  exit(EX_USAGE);
+}
+
+static void flushFrame(recompressor_t *rc) {
+  if (rc->frameLen == 0) {
+    return;
+  }
+  if (seekableWriteFrame(&rc->writer, rc->frame, rc->frameLen) < 0) {
+    errx(EX_IOERR, "could not write frame");
+  }
+  rc->frameLen = 0;
+}
+
+static void appendFrame(recompressor_t *rc, const uint8_t *data, size_t size) {
+  if (rc->frameLen + size > SEEKABLE_FRAME_SIZE) {
+    flushFrame(rc);
+  }
+  if (rc->frameLen + size > rc->frameCap) {
+    size_t frameCap = rc->frameLen + size > SEEKABLE_FRAME_SIZE ?
+      rc->frameLen + size : SEEKABLE_FRAME_SIZE;
+    if (!(rc->frame = realloc(rc->frame, frameCap))) {
+      errx(EX_OSERR, "out of memory");
+    }
+    rc->frameCap = frameCap;
+  }
+  memcpy(rc->frame + rc->frameLen, data, size);
+  rc->frameLen += size;
+}
+
+// Copies every complete record in the reader's buffer into frames, along with
+// the pcap header at fileStart once the reader has been through it.
+static void recompressBuffer(recompressor_t *rc, pcap_reader_t *reader,
+    const uint8_t *fileStart) {
+  pcap_view_t views[READ_BATCH_SIZE];
+  size_t numViews;
+  do {
+    numViews = pcapReaderNextBatch(reader, views, READ_BATCH_SIZE);
+    if (reader->started && !rc->started) {
+      if (reader->isNG) {
+        errx(EX_DATAERR, "pcapng input is not supported");
+      }
+      appendFrame(rc, fileStart, PCAP_HEADER_SIZE);
+      rc->started = true;
+    }
+
+    // A classic record is its header followed by the captured bytes.
+    for (size_t i = 0; i < numViews; i++) {
+      appendFrame(rc, views[i].data - PCAP_RECORD_SIZE,
+          PCAP_RECORD_SIZE + views[i].caplen);
+    }
+  } while (numViews > 0);
+
+  if (reader->error) {
+    errx(EX_DATAERR, "could not read input - %s", reader->error);
+  }
+}
+
+static void recompressGzip(recompressor_t *rc, const char *inPath) {
+  gzip_reader_t gzip;
+  if (gzipReaderOpen(&gzip, inPath) < 0) {
+    errx(EX_NOINPUT, "could not read %s - %s", inPath, gzip.error);
+  }
+
+  uint8_t *buffer = malloc(INFLATE_BUFFER_SIZE);
+  if (!buffer) {
+    errx(EX_OSERR, "out of memory");
+  }
+
+  pcap_reader_t reader;
+  memset(&reader, 0, sizeof(reader));
+  size_t filled = 0;
+  bool final = false;
+  while (!final) {
+    ssize_t bytes = gzipReaderRead(&gzip, buffer + filled,
+        INFLATE_BUFFER_SIZE - filled);
+    if (bytes < 0) {
+      errx(EX_DATAERR, "could not decompress %s - %s", inPath, gzip.error);
+    }
+    filled += bytes;
+    final = gzip.done;
+
+    pcapReaderFeed(&reader, buffer, filled, final);
+    recompressBuffer(rc, &reader, buffer);
+
+    size_t leftover = reader.end - reader.cur;
+    if (leftover == INFLATE_BUFFER_SIZE) {
+      errx(EX_DATAERR, "could not read %s - record too large", inPath);
+    }
+    memmove(buffer, reader.cur, leftover);
+    filled = leftover;
+  }
+
+  free(buffer);
+  gzipReaderClose(&gzip);
+}
+
+int main(int argc, char *argv[]) {
+  seekable_codec_t codec = SEEKABLE_ZSTD;
+  int level = -1;
+  int index = 1;
+  while (index < argc && argv[index][0] == '-') {
+    if (strcmp("-zstd", argv[index]) == 0) {
+      codec = SEEKABLE_ZSTD;
+    } else if (strcmp("-lz4", argv[index]) == 0) {
+      codec = SEEKABLE_LZ4;
+    } else if (strcmp("-l", argv[index]) == 0 && index + 1 < argc) {
+      level = atoi(argv[++index]);
+    } else {
+      usage(argv[0]);
+    }
+    index++;
+  }
+  if (argc - index != 2) {
+    usage(argv[0]);
+  }
+  const char *inPath = argv[index];
+  const char *outPath = argv[index + 1];
+  if (level < 0) {
+    level = (codec == SEEKABLE_ZSTD) ? 3 : 0;
+  }
+
+  FILE *out = fopen(outPath, "wb");
+  if (!out) {
+    err(EX_CANTCREAT, "could not create %s", outPath);
+  }
+  recompressor_t rc;
+  memset(&rc, 0, sizeof(rc));
+  seekableWriterOpen(&rc.writer, out, codec, level);
+
+  // Uncompressed input is read straight from its mapping.
+  pcap_reader_t reader;
+  if (pcapReaderOpen(&reader, inPath) == 0) {
+    recompressBuffer(&rc, &reader, reader.map);
+    pcapReaderClose(&reader);
+  } else {
+    recompressGzip(&rc, inPath);
+  }
+  if (!rc.started) {
+    errx(EX_DATAERR, "%s holds no pcap header", inPath);
+  }
+
+  flushFrame(&rc);
+  int numFrames = rc.writer.numFrames;
+  if (seekableWriterClose(&rc.writer) < 0 || fclose(out) != 0) {
+    errx(EX_IOERR, "could not write %s", outPath);
+  }
+  free(rc.frame);
+  printf("%s: %d frames\n", outPath, numFrames);
+  return 0;
+}
@@ -0,0 +1,140 @@
+#include "prefilter.h"
+
+#include <netinet/in.h>
+#include <pcap/pcap.h>
+#include <string.h>
+
+// Views are filtered this many at a time, first pulling out the fields the
+// rule tests and then evaluating it over them without branching.
+#define PREFILTER_CHUNK 256
+
+enum {
+  NETWORK_OTHER,
+  NETWORK_IPV4,
+  NETWORK_IPV6
+};
+
+// What the rule tests, pulled out of one packet. A protocol of 0 stands for
+// anything that cannot pass.
+typedef struct {
+  uint8_t protocol;
+  uint8_t hasDstPort;
+  uint16_t srcPort;
+  uint16_t dstPort;
+} prefilter_fields_t;
+
+static inline uint16_t get16(const uint8_t *p) {
+  return (p[0] << 8) | p[1];
+}
+
+static inline uint8_t protocolBit(uint8_t ipProtocol) {
+  return (ipProtocol == IPPROTO_UDP) ? PREFILTER_UDP :
+    (ipProtocol == IPPROTO_TCP) ? PREFILTER_TCP : 0;
+}
+
+static inline int etherNetwork(uint16_t type) {
+  return (type == 0x0800) ? NETWORK_IPV4 :
+    (type == 0x86DD) ? NETWORK_IPV6 : NETWORK_OTHER;
+}
+
+// Link layers: the network protocol of a packet with at least the link header
+// and one more byte.
+static inline int ethernetNetwork(const uint8_t *p) {
+  return etherNetwork(get16(p + 12));
+}
+
+static inline int linuxSllNetwork(const uint8_t *p) {
+  return etherNetwork(get16(p + 14));
+}
+
+static inline int rawNetwork(const uint8_t *p) {
+  uint8_t version = p[0] >> 4;
+  return (version == 4) ? NETWORK_IPV4 :
+    (version == 6) ? NETWORK_IPV6 : NETWORK_OTHER;
+}
+
+static inline void extractIP(const uint8_t *ip, uint32_t ipLen, int network,
+    prefilter_fields_t *fields) {
+  memset(fields, 0, sizeof(*fields));
+
+  if (network == NETWORK_IPV4) {
+    // Ports sit after the header, whatever length it claims to be.
+    uint32_t headerLen = (ip[0] & 0x0F) * 4;
+    if (ipLen < 10 || ipLen < headerLen + 2 ||
+        (get16(ip + 6) & 0x1FFF) != 0) {
+      return;
+    }
+    fields->protocol = protocolBit(ip[9]);
+    fields->srcPort = get16(ip + headerLen);
+    if (ipLen >= headerLen + 4) {
+      fields->dstPort = get16(ip + headerLen + 2);
+      fields->hasDstPort = 1;
+    }
+  } else if (network == NETWORK_IPV6) {
+    if (ipLen < 40 + 2) {
+      return;
+    }
+    fields->protocol = protocolBit(ip[6]);
+    fields->srcPort = get16(ip + 40);
+    if (ipLen >= 40 + 4) {
+      fields->dstPort = get16(ip + 42);
+      fields->hasDstPort = 1;
+    }
+  }
+}
+
+// Defines the batch filter for one link type, with its header size and network
+// function fixed so that they are inlined into the loop.
+#define DEFINE_PREFILTER(name, DATALINK, HEADER_SIZE, network)               \
+static size_t name(const prefilter_rule_t *rule, const pcap_view_t *views,   \
+    size_t numViews, uint32_t *passed) {                                     \
+  size_t numPassed = 0;                                                      \
+  for (size_t start = 0; start < numViews; start += PREFILTER_CHUNK) {       \
+    size_t count = numViews - start;                                         \
+    if (count > PREFILTER_CHUNK) {                                           \
+      count = PREFILTER_CHUNK;                                               \
+    }                                                                        \
+                                                                             \
+    prefilter_fields_t fields[PREFILTER_CHUNK];                              \
+    for (size_t i = 0; i < count; i++) {                                     \
+      const pcap_view_t *view = &views[start + i];                           \
+      if (view->datalink == DATALINK && view->caplen > HEADER_SIZE) {        \
+        extractIP(view->data + HEADER_SIZE, view->caplen - HEADER_SIZE,      \
+            network(view->data), &fields[i]);                                \
+      } else {                                                               \
+        memset(&fields[i], 0, sizeof(fields[i]));                            \
+      }                                                                      \
+    }                                                                        \
+                                                                             \
+    for (size_t i = 0; i < count; i++) {                                     \
+      passed[numPassed] = start + i;                                         \
+      numPassed += ((fields[i].protocol & rule->protocols) != 0) &           \
+        ((fields[i].srcPort == rule->port) |                                 \
+         ((fields[i].dstPort == rule->port) & fields[i].hasDstPort));        \
+    }                                                                        \
+  }                                                                          \
+  return numPassed;                                                          \
+}
+
+DEFINE_PREFILTER(prefilterEthernet, DLT_EN10MB, 14, ethernetNetwork)
+DEFINE_PREFILTER(prefilterLinuxSll, DLT_LINUX_SLL, 16, linuxSllNetwork)
+DEFINE_PREFILTER(prefilterRaw, DLT_RAW, 0, rawNetwork)
+
+bool prefilterSupports(int datalink) {
+  return datalink == DLT_EN10MB || datalink == DLT_LINUX_SLL ||
+    datalink == DLT_RAW;
+}
+
+size_t prefilterBatch(const prefilter_rule_t *rule, int datalink,
+    const pcap_view_t *views, size_t numViews, uint32_t *passed) {
+  switch (datalink) {
+    case DLT_EN10MB:
+      return prefilterEthernet(rule, views, numViews, passed);
+    case DLT_LINUX_SLL:
+      return prefilterLinuxSll(rule, views, numViews, passed);
+    case DLT_RAW:
+      return prefilterRaw(rule, views, numViews, passed);
+    default:
+      return 0;
+  }
+}
@@ -0,0 +1,239 @@
+#include "schedule.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Longest replica name read back from a history file.
+#define HISTORY_REPLICA_MAX 63
+
+static replica_rate_t *findRate(const schedule_history_t *history,
+    const char *replica) {
+  for (int i = 0; i < history->numRates; i++) {
+    if (!strcmp(history->rates[i].replica, replica)) {
+      return &history->rates[i];
+    }
+  }
+  return NULL;
+}
+
+static replica_rate_t *addRate(schedule_history_t *history,
+    const char *replica, double bytesPerSecond) {
+  replica_rate_t *rates = realloc(history->rates,
+      (history->numRates + 1) * sizeof(replica_rate_t));
+  char *name = strdup(replica);
+  if (!rates || !name) {
+    if (rates) {
+      history->rates = rates;
+    }
+    free(name);
+    return NULL;
+  }
+
+  history->rates = rates;
+  replica_rate_t *rate = &rates[history->numRates++];
+  rate->replica = name;
+  rate->bytesPerSecond = bytesPerSecond;
+  rate->runBytes = 0;
+  rate->runSeconds = 0;
+  return rate;
+}
+
+void scheduleHistoryLoad(schedule_history_t *history, const char *path) {
+  history->rates = NULL;
+  history->numRates = 0;
+
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    return;
+  }
+
+  char replica[HISTORY_REPLICA_MAX + 1];
+  double bytesPerSecond;
+  while (fscanf(file, "%63s %lf", replica, &bytesPerSecond) == 2) {
+    if (bytesPerSecond > 0 && !findRate(history, replica)) {
+      addRate(history, replica, bytesPerSecond);
+    }
+  }
+  fclose(file);
+}
+
+int scheduleHistorySave(const schedule_history_t *history, const char *path) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    return -1;
+  }
+
+  for (int i = 0; i < history->numRates; i++) {
+    if (history->rates[i].bytesPerSecond <= 0) {
+      continue;
+    }
+    fprintf(file, "%s %.0f\n", history->rates[i].replica,
+        history->rates[i].bytesPerSecond);
+  }
+  return fclose(file) == 0 ? 0 : -1;
+}
+
+void scheduleHistoryFree(schedule_history_t *history) {
+  for (int i = 0; i < history->numRates; i++) {
+    free(history->rates[i].replica);
+  }
+  free(history->rates);
+  history->rates = NULL;
+  history->numRates = 0;
+}
+
+void scheduleHistoryAdd(schedule_history_t *history, const char *replica,
+    uint64_t bytes, double seconds) {
+  replica_rate_t *rate = findRate(history, replica);
+  if (!rate) {
+    rate = addRate(history, replica, 0);
+  }
+  if (rate) {
+    rate->runBytes += bytes;
+    rate->runSeconds += seconds;
+  }
+}
+
+void scheduleHistoryCommit(schedule_history_t *history) {
+  for (int i = 0; i < history->numRates; i++) {
+    replica_rate_t *rate = &history->rates[i];
+    if (rate->runBytes && rate->runSeconds > 0) {
+      double measured = rate->runBytes / rate->runSeconds;
+      rate->bytesPerSecond = rate->bytesPerSecond ?
+          (rate->bytesPerSecond + measured) / 2 : measured;
+    }
+    rate->runBytes = 0;
+    rate->runSeconds = 0;
+  }
+}
+
+double scheduleEstimate(const schedule_history_t *history,
+    const char *replica, uint64_t size) {
+  const replica_rate_t *rate = findRate(history, replica);
+  if (rate && rate->bytesPerSecond > 0) {
+    return size / rate->bytesPerSecond;
+  }
+
+  double total = 0;
+  int numKnown = 0;
+  for (int i = 0; i < history->numRates; i++) {
+    if (history->rates[i].bytesPerSecond > 0) {
+      total += history->rates[i].bytesPerSecond;
+      numKnown++;
+    }
+  }
+  return numKnown ? size / (total / numKnown) : size;
+}
+
+typedef struct {
+  double estimate;
+  uint32_t index;
+} scheduled_job_t;
+
+// Longest first, and in the order given between equal estimates.
+static int compareJobs(const void *a, const void *b) {
+  const scheduled_job_t *jobA = a;
+  const scheduled_job_t *jobB = b;
+  if (jobA->estimate != jobB->estimate) {
+    return jobA->estimate < jobB->estimate ? 1 : -1;
+  }
+  return jobA->index < jobB->index ? -1 : jobA->index > jobB->index;
+}
+
+void scheduleOrder(uint32_t *order, const double *estimates,
+    const char **replicas, uint32_t n, bool interleave) {
+  scheduled_job_t *jobs = malloc((n ? n : 1) * sizeof(scheduled_job_t));
+  if (!jobs) {
+    // Fall back to the order given.
+    for (uint32_t i = 0; i < n; i++) {
+      order[i] = i;
+    }
+    return;
+  }
+
+  for (uint32_t i = 0; i < n; i++) {
+    jobs[i].estimate = estimates[i];
+    jobs[i].index = i;
+  }
+  qsort(jobs, n, sizeof(scheduled_job_t), compareJobs);
+
+  if (!interleave) {
+    for (uint32_t i = 0; i < n; i++) {
+      order[i] = jobs[i].index;
+    }
+    free(jobs);
+    return;
+  }
+
+  // Group the sorted jobs by replica, numbering the replicas by their longest
+  // job. There are only ever a handful, so they are found by a linear search.
+  uint32_t *group = malloc((n ? n : 1) * sizeof(uint32_t));
+  const char **names = malloc((n ? n : 1) * sizeof(char *));
+  uint32_t *next = calloc(n ? n : 1, sizeof(uint32_t));
+  if (!group || !names || !next) {
+    for (uint32_t i = 0; i < n; i++) {
+      order[i] = jobs[i].index;
+    }
+    free(group);
+    free(names);
+    free(next);
+    free(jobs);
+    return;
+  }
+
+  uint32_t numGroups = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    const char *replica = replicas[jobs[i].index];
+    uint32_t g = 0;
+    while (g < numGroups && strcmp(names[g], replica)) {
+      g++;
+    }
+    if (g == numGroups) {
+      names[numGroups++] = replica;
+    }
+    group[i] = g;
+  }
+
+  // Each pass takes the longest job left of every replica. The replicas'
+  // next jobs are found by scanning forward through the sorted list.
+  uint32_t emitted = 0;
+  for (uint32_t g = 0; g < numGroups; g++) {
+    next[g] = 0;
+    while (group[next[g]] != g) {
+      next[g]++;
+    }
+  }
+  while (emitted < n) {
+    uint32_t start = emitted;
+    for (uint32_t g = 0; g < numGroups; g++) {
+      if (next[g] < n) {
+        order[emitted++] = next[g];
+        do {
+          next[g]++;
+        } while (next[g] < n && group[next[g]] != g);
+      }
+    }
+
+    // Within a pass, longest first.
+    for (uint32_t i = start + 1; i < emitted; i++) {
+      uint32_t position = order[i];
+      uint32_t j = i;
+      while (j > start && order[j - 1] > position) {
+        order[j] = order[j - 1];
+        j--;
+      }
+      order[j] = position;
+    }
+  }
+
+  // The passes hold positions in the sorted list, so map them to jobs.
+  for (uint32_t i = 0; i < n; i++) {
+    order[i] = jobs[order[i]].index;
+  }
+
+  free(group);
+  free(names);
+  free(next);
+  free(jobs);
+}
@@ -0,0 +1,295 @@
+#include "seekable.h"
+
+#include <fcntl.h>
+#include <lz4frame.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zstd.h>
+
+#define ZSTD_FRAME_MAGIC  0xFD2FB528
+#define LZ4_FRAME_MAGIC   0x184D2204
+
+// Bits of the seek table descriptor that have to be clear. The top bit says
+// whether entries carry checksums, which this reader does not use.
+#define SEEKABLE_DESCRIPTOR_RESERVED 0x7C
+#define SEEKABLE_CHECKSUM_FLAG       0x80
+
+static uint32_t get32le(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put32le(uint8_t *p, uint32_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+  p[2] = value >> 16;
+  p[3] = value >> 24;
+}
+
+static int fail(seekable_file_t *file, const char *msg) {
+  seekableClose(file);
+  file->error = msg;
+  return -1;
+}
+
+static int readSeekTable(seekable_file_t *file) {
+  const uint8_t *map = file->map;
+  size_t size = file->mapSize;
+
+  if (size < 4 + 8 + SEEKABLE_FOOTER_SIZE ||
+      get32le(map + size - 4) != SEEKABLE_MAGIC) {
+    return fail(file, "no seek table");
+  }
+
+  const uint8_t *footer = map + size - SEEKABLE_FOOTER_SIZE;
+  uint32_t numFrames = get32le(footer);
+  uint8_t descriptor = footer[4];
+  if (descriptor & SEEKABLE_DESCRIPTOR_RESERVED) {
+    return fail(file, "bad seek table descriptor");
+  }
+
+  size_t entrySize = SEEKABLE_ENTRY_SIZE +
+    ((descriptor & SEEKABLE_CHECKSUM_FLAG) ? 4 : 0);
+  size_t tableSize = (size_t)numFrames * entrySize + SEEKABLE_FOOTER_SIZE;
+  if (numFrames == 0 || tableSize + 8 > size) {
+    return fail(file, "bad seek table size");
+  }
+  const uint8_t *table = map + size - tableSize;
+  if (get32le(table - 8) != SEEKABLE_SKIPPABLE_MAGIC ||
+      get32le(table - 4) != tableSize) {
+    return fail(file, "bad seek table frame");
+  }
+
+  if (!(file->frames = calloc(numFrames, sizeof(*file->frames)))) {
+    return fail(file, "out of memory");
+  }
+  file->numFrames = numFrames;
+
+  size_t offset = 0;
+  size_t dataEnd = table - 8 - map;
+  for (uint32_t i = 0; i < numFrames; i++) {
+    seekable_frame_t *frame = &file->frames[i];
+    frame->offset = offset;
+    frame->compressedSize = get32le(table + i * entrySize);
+    frame->size = get32le(table + i * entrySize + 4);
+    offset += frame->compressedSize;
+    if (offset > dataEnd) {
+      return fail(file, "seek table runs past the data");
+    }
+  }
+  return 0;
+}
+
+int seekableOpen(seekable_file_t *file, const char *filePath) {
+  memset(file, 0, sizeof(*file));
+
+  int fd = open(filePath, O_RDONLY);
+  if (fd < 0) {
+    file->error = "could not open file";
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < 4) {
+    close(fd);
+    file->error = "file is empty or unreadable";
+    return -1;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    file->error = "could not map file";
+    return -1;
+  }
+  file->map = map;
+  file->mapSize = st.st_size;
+
+  uint32_t magic = get32le(file->map);
+  if (magic == ZSTD_FRAME_MAGIC) {
+    file->codec = SEEKABLE_ZSTD;
+  } else if (magic == LZ4_FRAME_MAGIC) {
+    file->codec = SEEKABLE_LZ4;
+  } else {
+    return fail(file, "not a zstd or lz4 file");
+  }
+  return readSeekTable(file);
+}
+
+static int decodeZstd(const uint8_t *src, size_t srcSize, uint8_t *out,
+    size_t len, size_t frameSize) {
+  if (len == frameSize) {
+    size_t ret = ZSTD_decompress(out, len, src, srcSize);
+    return (ZSTD_isError(ret) || ret != len) ? -1 : 0;
+  }
+
+  // Only part of the frame is wanted, so stream until out is full.
+  ZSTD_DStream *stream = ZSTD_createDStream();
+  if (!stream) {
+    return -1;
+  }
+  ZSTD_inBuffer in = { src, srcSize, 0 };
+  ZSTD_outBuffer outBuf = { out, len, 0 };
+  size_t ret = 1;
+  while (outBuf.pos < len && ret != 0) {
+    ret = ZSTD_decompressStream(stream, &outBuf, &in);
+    if (ZSTD_isError(ret) || (in.pos == srcSize && outBuf.pos < len)) {
+      break;
+    }
+  }
+  ZSTD_freeDStream(stream);
+  return (outBuf.pos == len) ? 0 : -1;
+}
+
+static int decodeLz4(const uint8_t *src, size_t srcSize, uint8_t *out,
+    size_t len, size_t frameSize) {
+  LZ4F_dctx *dctx;
+  if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) {
+    return -1;
+  }
+
+  // A whole frame is decoded to its end so that the checksum gets checked.
+  size_t done = 0;
+  size_t srcPos = 0;
+  size_t ret = 1;
+  while (ret != 0 && srcPos < srcSize && (done < len || len == frameSize)) {
+    size_t outSize = len - done;
+    size_t inSize = srcSize - srcPos;
+    ret = LZ4F_decompress(dctx, out + done, &outSize, src + srcPos, &inSize,
+        NULL);
+    if (LZ4F_isError(ret) || (outSize == 0 && inSize == 0)) {
+      break;
+    }
+    done += outSize;
+    srcPos += inSize;
+  }
+  LZ4F_freeDecompressionContext(dctx);
+  return (done == len && (len < frameSize || ret == 0)) ? 0 : -1;
+}
+
+int seekableDecodeFrame(const seekable_file_t *file, int index, uint8_t *out,
+    size_t len) {
+  const seekable_frame_t *frame = &file->frames[index];
+  if (len > frame->size) {
+    return -1;
+  }
+
+  const uint8_t *src = file->map + frame->offset;
+  if (file->codec == SEEKABLE_ZSTD) {
+    return decodeZstd(src, frame->compressedSize, out, len, frame->size);
+  }
+  return decodeLz4(src, frame->compressedSize, out, len, frame->size);
+}
+
+void seekableClose(seekable_file_t *file) {
+  if (file->map) {
+    munmap((void *)file->map, file->mapSize);
+  }
+  free(file->frames);
+  memset(file, 0, sizeof(*file));
+}
+
+void seekableWriterOpen(seekable_writer_t *writer, FILE *out,
+    seekable_codec_t codec, int level) {
+  memset(writer, 0, sizeof(*writer));
+  writer->out = out;
+  writer->codec = codec;
+  writer->level = level;
+}
+
+int seekableWriteFrame(seekable_writer_t *writer, const uint8_t *data,
+    size_t size) {
+  size_t bound;
+  LZ4F_preferences_t prefs;
+  if (writer->codec == SEEKABLE_ZSTD) {
+    bound = ZSTD_compressBound(size);
+  } else {
+    memset(&prefs, 0, sizeof(prefs));
+    prefs.frameInfo.contentSize = size;
+    prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+    prefs.compressionLevel = writer->level;
+    bound = LZ4F_compressFrameBound(size, &prefs);
+  }
+
+  if (bound > writer->bufferCap) {
+    void *buffer = realloc(writer->buffer, bound);
+    if (!buffer) {
+      return -1;
+    }
+    writer->buffer = buffer;
+    writer->bufferCap = bound;
+  }
+  if (writer->numFrames == writer->framesCap) {
+    int framesCap = writer->framesCap ? writer->framesCap * 2 : 64;
+    uint32_t *entries = realloc(writer->entries,
+        framesCap * 2 * sizeof(uint32_t));
+    if (!entries) {
+      return -1;
+    }
+    writer->entries = entries;
+    writer->framesCap = framesCap;
+  }
+
+  size_t compressed;
+  if (writer->codec == SEEKABLE_ZSTD) {
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    if (!cctx) {
+      return -1;
+    }
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, writer->level);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+    ZSTD_CCtx_setPledgedSrcSize(cctx, size);
+    compressed = ZSTD_compress2(cctx, writer->buffer, bound, data, size);
+    ZSTD_freeCCtx(cctx);
+    if (ZSTD_isError(compressed)) {
+      return -1;
+    }
+  } else {
+    compressed = LZ4F_compressFrame(writer->buffer, bound, data, size, &prefs);
+    if (LZ4F_isError(compressed)) {
+      return -1;
+    }
+  }
+
+  if (compressed > UINT32_MAX ||
+      fwrite(writer->buffer, 1, compressed, writer->out) != compressed) {
+    return -1;
+  }
+  writer->entries[writer->numFrames * 2] = compressed;
+  writer->entries[writer->numFrames * 2 + 1] = size;
+  writer->numFrames++;
+  return 0;
+}
+
+int seekableWriterClose(seekable_writer_t *writer) {
+  size_t tableSize = (size_t)writer->numFrames * SEEKABLE_ENTRY_SIZE +
+    SEEKABLE_FOOTER_SIZE;
+  uint8_t *table = malloc(8 + tableSize);
+  int ret = -1;
+
+  if (table) {
+    put32le(table, SEEKABLE_SKIPPABLE_MAGIC);
+    put32le(table + 4, tableSize);
+    uint8_t *entry = table + 8;
+    for (int i = 0; i < writer->numFrames; i++) {
+      put32le(entry, writer->entries[i * 2]);
+      put32le(entry + 4, writer->entries[i * 2 + 1]);
+      entry += SEEKABLE_ENTRY_SIZE;
+    }
+    put32le(entry, writer->numFrames);
+    entry[4] = 0;
+    put32le(entry + 5, SEEKABLE_MAGIC);
+
+    if (fwrite(table, 1, 8 + tableSize, writer->out) == 8 + tableSize) {
+      ret = 0;
+    }
+  }
+
+  free(table);
+  free(writer->entries);
+  free(writer->buffer);
+  memset(writer, 0, sizeof(*writer));
+  return ret;
+}
@@ -0,0 +1,133 @@
+#include "spscRing.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Times a waiting side yields before going to sleep.
+#define SPIN_YIELDS 64
+
+int spscRingInit(spsc_ring_t *ring, uint32_t capacity) {
+  uint32_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+
+  memset(ring, 0, sizeof(*ring));
+  ring->slots = calloc(size, sizeof(void *));
+  if (!ring->slots) {
+    return -1;
+  }
+  ring->capacity = size;
+  ring->mask = size - 1;
+  pthread_mutex_init(&ring->lock, NULL);
+  pthread_cond_init(&ring->notEmpty, NULL);
+  pthread_cond_init(&ring->notFull, NULL);
+  return 0;
+}
+
+void spscRingFree(spsc_ring_t *ring) {
+  free(ring->slots);
+  ring->slots = NULL;
+  pthread_mutex_destroy(&ring->lock);
+  pthread_cond_destroy(&ring->notEmpty);
+  pthread_cond_destroy(&ring->notFull);
+}
+
+static inline bool isFull(spsc_ring_t *ring, uint64_t tail) {
+  return tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) ==
+      ring->capacity;
+}
+
+static inline bool isEmpty(spsc_ring_t *ring, uint64_t head) {
+  return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head &&
+      !__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE);
+}
+
+// Wakes the other side if it went to sleep. The caller's update and the
+// waiter's flag are ordered by the fence, so either the waiter sees the update
+// before sleeping or the flag is seen here.
+static inline void wake(spsc_ring_t *ring, bool *waiting,
+    pthread_cond_t *cond) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(waiting, __ATOMIC_RELAXED)) {
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_signal(cond);
+    pthread_mutex_unlock(&ring->lock);
+  }
+}
+
+void spscRingPush(spsc_ring_t *ring, void *item) {
+  uint64_t tail = ring->tail;
+  if (isFull(ring, tail)) {
+    double startTime = getTimeSeconds();
+    for (int i = 0; i < SPIN_YIELDS && isFull(ring, tail); i++) {
+      sched_yield();
+    }
+    if (isFull(ring, tail)) {
+      pthread_mutex_lock(&ring->lock);
+      __atomic_store_n(&ring->producerWaiting, true, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      while (isFull(ring, tail)) {
+        pthread_cond_wait(&ring->notFull, &ring->lock);
+      }
+      __atomic_store_n(&ring->producerWaiting, false, __ATOMIC_RELAXED);
+      pthread_mutex_unlock(&ring->lock);
+    }
+    ring->pushWaitSeconds += getTimeSeconds() - startTime;
+  }
+
+  ring->pushes++;
+  ring->occupancySum += tail - __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  ring->slots[tail & ring->mask] = item;
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  wake(ring, &ring->consumerWaiting, &ring->notEmpty);
+}
+
+void *spscRingPop(spsc_ring_t *ring) {
+  uint64_t head = ring->head;
+  if (isEmpty(ring, head)) {
+    double startTime = getTimeSeconds();
+    for (int i = 0; i < SPIN_YIELDS && isEmpty(ring, head); i++) {
+      sched_yield();
+    }
+    if (isEmpty(ring, head)) {
+      pthread_mutex_lock(&ring->lock);
+      __atomic_store_n(&ring->consumerWaiting, true, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      while (isEmpty(ring, head)) {
+        pthread_cond_wait(&ring->notEmpty, &ring->lock);
+      }
+      __atomic_store_n(&ring->consumerWaiting, false, __ATOMIC_RELAXED);
+      pthread_mutex_unlock(&ring->lock);
+    }
+    ring->popWaitSeconds += getTimeSeconds() - startTime;
+  }
+
+  // Closed, and nothing was pushed before it was.
+  if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head) {
+    return NULL;
+  }
+
+  void *item = ring->slots[head & ring->mask];
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  wake(ring, &ring->producerWaiting, &ring->notFull);
+  return item;
+}
+
+void spscRingClose(spsc_ring_t *ring) {
+  __atomic_store_n(&ring->closed, true, __ATOMIC_RELEASE);
+  wake(ring, &ring->consumerWaiting, &ring->notEmpty);
+}
+
+uint32_t spscRingSize(spsc_ring_t *ring) {
+  return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) -
+      __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+}
+
+void spscRingStats(const spsc_ring_t *ring, spsc_ring_stats_t *stats) {
+  stats->pushes = ring->pushes;
+  stats->occupancySum = ring->occupancySum;
+  stats->pushWaitSeconds = ring->pushWaitSeconds;
+  stats->popWaitSeconds = ring->popWaitSeconds;
+}
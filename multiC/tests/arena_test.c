@@ -0,0 +1,51 @@
+#include "test.h"
+
+#include <string.h>
+
+#include "arena.h"
+#include "util.h"
+
+int main() {
+  print_section("Arena Test");
+
+  arena_t arena;
+  arenaInit(&arena, 64);
+  print_state("Nothing is allocated up front", arena.first == NULL);
+
+  char *a = arenaAlloc(&arena, 3);
+  char *b = arenaAlloc(&arena, 5);
+  print_state("Allocations are aligned", ((uintptr_t)a % ARENA_ALIGN) == 0 &&
+      ((uintptr_t)b % ARENA_ALIGN) == 0 && b == a + ARENA_ALIGN);
+
+  arenaAlloc(&arena, 60);
+  print_state("Full block moves on to a new one",
+      arena.first->next != NULL && arena.reserved == 128);
+
+  uint8_t *big = arenaAlloc(&arena, 1000);
+  print_state("Large allocation gets its own block",
+      big != NULL && arena.reserved == 1128);
+  memset(big, 0xFF, 1000);
+
+  arenaReset(&arena);
+  print_state("Reset starts over at the first block",
+      arenaAlloc(&arena, 8) == (void *)a && arena.used == 8);
+
+  // The kept blocks are used again before anything new is allocated.
+  arenaAlloc(&arena, 56);
+  arenaAlloc(&arena, 64);
+  uint8_t *zeroed = arenaCalloc(&arena, 100, 10);
+  bool isZero = zeroed == big;
+  for (int i = 0; i < 1000; i++) {
+    isZero = isZero && !zeroed[i];
+  }
+  print_state("Reset keeps the blocks", isZero && arena.reserved == 1128);
+
+  print_state("Overflowing calloc fails",
+      arenaCalloc(&arena, SIZE_MAX / 2, 4) == NULL);
+
+  arenaFree(&arena);
+  print_state("Free drops the blocks", arena.first == NULL &&
+      arena.reserved == 0 && arena.blockSize == 64);
+
+  return 0;
+}
@@ -325,6 +325,76 @@ int main() {
   print_state("Header 2 example has DNSSEC", payload2_DNSSEC);
   print_state("Response example does not have DNSSEC", !response_DNSSEC);
 
+  print_section("Test field selection");
+
+  memset(&dns, 0, sizeof(dns));
+  print_state("Packets are accepted with no fields",
+      parseDNSFields(&dns, payload1, sizeof(payload1), 0) == 0);
+  print_state("Queries are ignored with no fields",
+      parseDNSFields(&dns, dnsQuery, sizeof(dnsQuery), 0) == -1);
+
+  memset(&dns, 0, sizeof(dns));
+  parseDNSFields(&dns, payload1, sizeof(payload1), DNS_FIELD_QTYPE);
+  print_state("Type only has the type and class",
+      dns.question.type == 1 && dns.question.class == 1);
+  print_state("Type only has no name", dns.question.name == NULL);
+  print_state("Type only has no header", dns.header.id == 0);
+  print_state("Type only has no DNSSEC", !dns.isDNSSEC);
+
+  memset(&dns, 0, sizeof(dns));
+  parseDNSFields(&dns, payload1, sizeof(payload1),
+      DNS_FIELD_QNAME | DNS_FIELD_EDNS);
+  print_state("Name and DNSSEC",
+      !strcmp(dns.question.name, "a17-07.rsw.kr2.") && dns.isDNSSEC);
+  print_state("Name and DNSSEC has no type", dns.question.type == 0);
+  free(dns.question.name);
+
+  print_section("Test name cache");
+
+  name_cache_t cache;
+  nameCacheInit(&cache, 16);
+  dnsUseNameCache(&cache);
+
+  memset(&dns, 0, sizeof(dns));
+  parseDNS(&dns, payload1, sizeof(payload1));
+  uint32_t questionID = dns.questionID;
+  print_state("Cached name matches",
+      !strcmp(dns.question.name, "a17-07.rsw.kr2.") && questionID != 0);
+
+  memset(&dns, 0, sizeof(dns));
+  parseDNS(&dns, payload1, sizeof(payload1));
+  print_state("Repeated name has the same ID",
+      dns.questionID == questionID && cache.hits == 1);
+
+  memset(&dns, 0, sizeof(dns));
+  parseDNS(&dns, payload2, sizeof(payload2));
+  print_state("Cached root name", !strcmp(dns.question.name, ".") &&
+      dns.questionID != questionID);
+
+  dnsUseNameCache(NULL);
+  nameCacheFree(&cache);
+
+  print_section("Test arena names");
+
+  arena_t arena;
+  arenaInit(&arena, 64);
+  dnsUseArena(&arena);
+
+  memset(&dns, 0, sizeof(dns));
+  parseDNS(&dns, payload1, sizeof(payload1));
+  print_state("Name comes from the arena",
+      !strcmp(dns.question.name, "a17-07.rsw.kr2.") &&
+      (uint8_t *)dns.question.name == arena.first->data);
+
+  arenaReset(&arena);
+  memset(&dns, 0, sizeof(dns));
+  parseDNS(&dns, payload2, sizeof(payload2));
+  print_state("Reset arena is reused", !strcmp(dns.question.name, ".") &&
+      (uint8_t *)dns.question.name == arena.first->data);
+
+  dnsUseArena(NULL);
+  arenaFree(&arena);
+
   return 0;
 }
 
@@ -0,0 +1,132 @@
+#include "test.h"
+
+#include <string.h>
+
+#include "dnsRecords.h"
+#include "util.h"
+
+// Response for www.example.com with a CNAME, an A record for its target, an NS
+// record and, in the additional section, an A record before the OPT record.
+static const uint8_t response[] = {
+  0x12, 0x34, 0x81, 0x80, 0x00, 0x01, 0x00, 0x02,
+  0x00, 0x01, 0x00, 0x02,
+  // www.example.com IN A, at 12.
+  0x03, 'w', 'w', 'w', 0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e',
+  0x03, 'c', 'o', 'm', 0x00, 0x00, 0x01, 0x00, 0x01,
+  // www.example.com CNAME foo.example.com, the target at 45.
+  0xc0, 0x0c, 0x00, 0x05, 0x00, 0x01, 0x00, 0x00, 0x01, 0x2c, 0x00, 0x06,
+  0x03, 'f', 'o', 'o', 0xc0, 0x10,
+  // foo.example.com A 1.2.3.4
+  0xc0, 0x2d, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x04,
+  0x01, 0x02, 0x03, 0x04,
+  // example.com NS www.example.com
+  0xc0, 0x10, 0x00, 0x02, 0x00, 0x01, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x02,
+  0xc0, 0x0c,
+  // foo.example.com A 5.6.7.8
+  0xc0, 0x2d, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x04,
+  0x05, 0x06, 0x07, 0x08,
+  // OPT, 1232 byte payload, extended RCODE 1, version 0, DO, one option.
+  0x00, 0x00, 0x29, 0x04, 0xd0, 0x01, 0x00, 0x80, 0x00, 0x00, 0x08,
+  0x00, 0x0a, 0x00, 0x04, 0x09, 0x09, 0x09, 0x09
+};
+
+static int countRecords(const uint8_t *packet, uint16_t size, bool *error) {
+  dns_walker_t walker;
+  dns_rr_t rr;
+  int count = 0;
+
+  dnsWalkerInit(&walker, packet, size);
+  while (dnsWalkerNext(&walker, &rr)) {
+    count++;
+  }
+  *error = walker.error;
+  return count;
+}
+
+int main() {
+  print_section("DNS Record Walker Test");
+
+  dns_walker_t walker;
+  dns_rr_t rr[8];
+  int count = 0;
+  dnsWalkerInit(&walker, response, sizeof(response));
+  while (count < 8 && dnsWalkerNext(&walker, &rr[count])) {
+    count++;
+  }
+
+  print_state("Every record is walked", count == 6 && !walker.error);
+  print_state("Sections are in order",
+      rr[0].section == DNS_SECTION_QUESTION &&
+      rr[1].section == DNS_SECTION_ANSWER &&
+      rr[2].section == DNS_SECTION_ANSWER &&
+      rr[3].section == DNS_SECTION_AUTHORITY &&
+      rr[4].section == DNS_SECTION_ADDITIONAL &&
+      rr[5].section == DNS_SECTION_ADDITIONAL);
+  print_state("Question has no RDATA",
+      rr[0].type == 1 && rr[0].class == 1 && !rr[0].rdata);
+  print_state("CNAME fields", rr[1].type == 5 && rr[1].ttl == 300 &&
+      rr[1].rdlength == 6);
+  print_state("A record RDATA", rr[2].rdlength == 4 &&
+      !memcmp(rr[2].rdata, "\x01\x02\x03\x04", 4));
+
+  char name[256];
+  print_state("Question name is expanded",
+      dnsExpandName(&walker, rr[0].name, name, sizeof(name)) == 16 &&
+      !strcmp(name, "www.example.com."));
+  print_state("Compressed owner name is expanded",
+      dnsExpandName(&walker, rr[3].name, name, sizeof(name)) == 12 &&
+      !strcmp(name, "example.com."));
+  print_state("Pointers in RDATA are followed",
+      dnsExpandName(&walker, rr[1].rdata, name, sizeof(name)) == 16 &&
+      !strcmp(name, "foo.example.com."));
+  print_state("Names that do not fit fail",
+      dnsExpandName(&walker, rr[1].rdata, name, 16) == -1);
+
+  const dns_edns_t *edns = &walker.edns;
+  print_state("OPT record is found after other additional records",
+      edns->present);
+  print_state("OPT fields", edns->udpSize == 1232 && edns->extRcode == 1 &&
+      edns->version == 0 && edns->dnssecOK);
+
+  const uint8_t *option = edns->options;
+  uint16_t code, length;
+  const uint8_t *data;
+  bool hasOption = dnsNextOption(edns, &option, &code, &length, &data);
+  print_state("OPT option", hasOption && code == 10 && length == 4 &&
+      data[0] == 9);
+  print_state("OPT has one option",
+      !dnsNextOption(edns, &option, &code, &length, &data));
+
+  dnsWalkerInit(&walker, response, sizeof(response));
+  print_state("EDNS can be looked up without walking",
+      dnsWalkerEDNS(&walker)->dnssecOK);
+
+  bool allFail = true;
+  for (uint16_t size = 0; size < sizeof(response); size++) {
+    bool error;
+    int records = countRecords(response, size, &error);
+    allFail = allFail && error && records < 6;
+  }
+  print_state("Truncated messages stop with an error", allFail);
+
+  // A name pointing to itself, and one pointing forward into itself.
+  uint8_t loop[] = {
+    0x00, 0x00, 0x81, 0x80, 0x00, 0x01, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01
+  };
+  dnsWalkerInit(&walker, loop, sizeof(loop));
+  print_state("Pointer loops are walked past", dnsWalkerNext(&walker, &rr[0]));
+  print_state("Pointer loops are not expanded",
+      dnsExpandName(&walker, rr[0].name, name, sizeof(name)) == -1);
+
+  uint8_t forward[] = {
+    0x00, 0x00, 0x81, 0x80, 0x00, 0x01, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x01, 'a', 0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01
+  };
+  dnsWalkerInit(&walker, forward, sizeof(forward));
+  dnsWalkerNext(&walker, &rr[0]);
+  print_state("Pointers back into the same name are not expanded",
+      dnsExpandName(&walker, rr[0].name, name, sizeof(name)) == -1);
+
+  return 0;
+}
@@ -0,0 +1,102 @@
+#include "test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "jobQueue.h"
+#include "util.h"
+
+#define NUM_STRESS_JOBS 20000
+#define NUM_STRESS_WORKERS 8
+
+int main() {
+  print_section("Job Queue Test");
+
+  char *paths[] = { "test.c", ".", "test.h", "jobQueue_test.c", "Makefile",
+      "missing_file" };
+  job_queue_t queue;
+  print_state("Queue is mapped", jobQueueInit(&queue, paths, 6, 2) == 0);
+  print_state("Only regular files are queued", queue.numJobs == 4 &&
+      !strcmp(jobQueuePath(&queue, 1), "test.h"));
+  print_state("Jobs are dealt round robin",
+      queue.deques[0].bottom == 2 && queue.deques[1].bottom == 2);
+
+  int64_t first = jobQueueTake(&queue, 0);
+  int64_t second = jobQueueTake(&queue, 0);
+  print_state("Own jobs run in the order given", first == 0 && second == 2);
+
+  int64_t third = jobQueueTake(&queue, 0);
+  print_state("Empty deque steals from the top of another",
+      third == 3 && queue.deques[0].jobsStolen == 1);
+  print_state("Owner still gets the rest of its deque",
+      jobQueueTake(&queue, 1) == 1 && jobQueueTake(&queue, 1) == -1 &&
+      jobQueueTake(&queue, 0) == -1);
+
+  jobQueueFinish(&queue, 0, first, 10, 0.5);
+  print_state("Finished jobs are counted", queue.jobs[0].state == JOB_DONE &&
+      queue.jobs[0].packets == 10 && queue.jobs[0].seconds == 0.5 &&
+      queue.deques[0].jobsDone == 1 && queue.deques[0].busySeconds == 0.5 &&
+      queue.deques[0].bytesDone == queue.jobs[0].size);
+  print_state("Taken jobs are running", queue.jobs[2].state == JOB_RUNNING &&
+      queue.jobs[3].worker == 0 && queue.jobs[1].worker == 1);
+  jobQueueFree(&queue);
+
+  jobQueueInit(&queue, paths, 6, 2);
+  uint32_t order[] = { 3, 1, 0, 2 };
+  jobQueueOrder(&queue, order);
+  print_state("Jobs run in the order dealt", jobQueueTake(&queue, 0) == 3 &&
+      jobQueueTake(&queue, 1) == 1 && jobQueueTake(&queue, 0) == 0 &&
+      jobQueueTake(&queue, 1) == 2);
+  jobQueueFree(&queue);
+
+  // Processes racing over a small deque each, with most of the jobs taken by
+  // stealing, must run every job exactly once.
+  char **many = calloc(NUM_STRESS_JOBS, sizeof(char *));
+  for (int i = 0; i < NUM_STRESS_JOBS; i++) {
+    many[i] = "test.c";
+  }
+  jobQueueInit(&queue, many, NUM_STRESS_JOBS, NUM_STRESS_WORKERS);
+  uint32_t *runs = mmap(NULL, NUM_STRESS_JOBS * sizeof(uint32_t),
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  memset(runs, 0, NUM_STRESS_JOBS * sizeof(uint32_t));
+
+  fflush(stdout);
+  for (int worker = 0; worker < NUM_STRESS_WORKERS; worker++) {
+    if (fork() == 0) {
+      // Odd workers are slow to start, leaving their jobs to be stolen.
+      if (worker % 2) {
+        usleep(1000);
+      }
+      int64_t job;
+      while ((job = jobQueueTake(&queue, worker)) >= 0) {
+        __atomic_add_fetch(&runs[job], 1, __ATOMIC_RELAXED);
+        jobQueueFinish(&queue, worker, job, 1, 0);
+      }
+      exit(0);
+    }
+  }
+  for (int worker = 0; worker < NUM_STRESS_WORKERS; worker++) {
+    wait(NULL);
+  }
+
+  bool once = true;
+  for (int i = 0; i < NUM_STRESS_JOBS; i++) {
+    once = once && runs[i] == 1 && queue.jobs[i].state == JOB_DONE;
+  }
+  uint64_t packets = 0;
+  for (int worker = 0; worker < NUM_STRESS_WORKERS; worker++) {
+    packets += queue.deques[worker].packetsDone;
+  }
+  print_state("Every job runs exactly once across processes",
+      once && packets == NUM_STRESS_JOBS);
+
+  munmap(runs, NUM_STRESS_JOBS * sizeof(uint32_t));
+  jobQueueFree(&queue);
+  free(many);
+
+  return 0;
+}
@@ -0,0 +1,76 @@
+#include "test.h"
+
+#include <string.h>
+
+#include "nameCache.h"
+#include "util.h"
+
+int main() {
+  print_section("Name Cache Test");
+
+  name_cache_t cache;
+  print_state("Cache is allocated", nameCacheInit(&cache, 1000) == 0);
+  print_state("Sets are rounded up to a power of two", cache.mask == 1023);
+
+  const uint8_t name[] = { 3, 'w', 'w', 'w', 3, 'c', 'o', 'm', 0 };
+  const name_cache_entry_t *entry = nameCacheLookup(&cache, name,
+      sizeof(name));
+  uint32_t id = entry->id;
+  print_state("Names are converted", !strcmp(entry->name, "www.com.") &&
+      entry->nameLength == 8);
+  print_state("First lookup misses", cache.misses == 1 && cache.hits == 0);
+
+  entry = nameCacheLookup(&cache, name, sizeof(name));
+  print_state("Second lookup hits with the same ID",
+      cache.hits == 1 && entry->id == id);
+
+  const uint8_t upper[] = { 3, 'W', 'W', 'W', 3, 'c', 'o', 'm', 0 };
+  entry = nameCacheLookup(&cache, upper, sizeof(upper));
+  print_state("Names are keyed on their exact bytes",
+      entry->id != id && !strcmp(entry->name, "WWW.com."));
+
+  const uint8_t root[] = { 0 };
+  entry = nameCacheLookup(&cache, root, sizeof(root));
+  print_state("Root name", !strcmp(entry->name, "."));
+
+  uint8_t tooLong[NAME_CACHE_MAX_WIRE + 1] = {0};
+  print_state("Names that are too long are not cached",
+      nameCacheLookup(&cache, tooLong, sizeof(tooLong)) == NULL);
+  print_state("Hit rate", nameCacheHitRate(&cache) == 0.25);
+  nameCacheFree(&cache);
+
+  // With one set, every name competes for the same ways.
+  nameCacheInit(&cache, 1);
+  uint8_t names[NAME_CACHE_WAYS + 1][3];
+  uint32_t ids[NAME_CACHE_WAYS + 1];
+  for (int i = 0; i <= NAME_CACHE_WAYS; i++) {
+    names[i][0] = 1;
+    names[i][1] = 'a' + i;
+    names[i][2] = 0;
+  }
+  for (int i = 0; i < NAME_CACHE_WAYS; i++) {
+    ids[i] = nameCacheLookup(&cache, names[i], 3)->id;
+  }
+  print_state("Set fills without evicting", cache.evictions == 0);
+
+  // Everything but the second name is referenced, so the clock passes over
+  // the first and takes the second.
+  for (int i = 0; i < NAME_CACHE_WAYS; i++) {
+    if (i != 1) {
+      nameCacheLookup(&cache, names[i], 3);
+    }
+  }
+  ids[NAME_CACHE_WAYS] = nameCacheLookup(&cache, names[NAME_CACHE_WAYS], 3)->id;
+  print_state("A full set evicts", cache.evictions == 1);
+
+  uint64_t misses = cache.misses;
+  bool kept = nameCacheLookup(&cache, names[0], 3)->id == ids[0] &&
+      nameCacheLookup(&cache, names[2], 3)->id == ids[2];
+  print_state("Referenced names are kept", kept && cache.misses == misses);
+  print_state("The unreferenced name was evicted",
+      nameCacheLookup(&cache, names[1], 3)->id != ids[1] &&
+      cache.misses == misses + 1);
+  nameCacheFree(&cache);
+
+  return 0;
+}
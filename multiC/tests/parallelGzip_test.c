@@ -0,0 +1,103 @@
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "parallelGzip.h"
+#include "util.h"
+
+#define DATA_SIZE (4 << 20)
+
+// Pseudo pcap records: mostly repetitive, with enough noise to make the
+// compressor emit many blocks.
+static uint8_t *makeData(size_t size) {
+  uint8_t *data = malloc(size);
+  uint32_t seed = 12345;
+  for (size_t i = 0; i < size; i++) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = (i % 97 < 60) ? "www.example.com."[i % 16] : (seed >> 16);
+  }
+  return data;
+}
+
+static size_t gzip(const uint8_t *in, size_t inLen, uint8_t *out,
+    size_t outCap, int level, int strategy) {
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  deflateInit2(&strm, level, Z_DEFLATED, 15 + 16, 8, strategy);
+  strm.next_in = (uint8_t *)in;
+  strm.avail_in = inLen;
+  strm.next_out = out;
+  strm.avail_out = outCap;
+  deflate(&strm, Z_FINISH);
+  size_t outLen = strm.total_out;
+  deflateEnd(&strm);
+  return outLen;
+}
+
+// Decodes everything, reading in odd sized pieces. Returns false on an error.
+static bool decodeAll(const uint8_t *gz, size_t gzLen, int threads,
+    size_t chunkSize, uint8_t *out, size_t *outLen) {
+  parallel_gzip_t *gzip = parallelGzipOpen(gz, gzLen, threads, chunkSize);
+  if (!gzip) {
+    return false;
+  }
+
+  const char *error = NULL;
+  ssize_t bytes;
+  *outLen = 0;
+  while ((bytes = parallelGzipRead(gzip, out + *outLen, 12345, &error)) > 0) {
+    *outLen += bytes;
+  }
+  parallelGzipClose(gzip);
+  return bytes == 0;
+}
+
+int main() {
+  print_section("Parallel Gzip Test");
+
+  uint8_t *data = makeData(DATA_SIZE);
+  size_t gzCap = DATA_SIZE * 2;
+  uint8_t *gz = malloc(gzCap);
+  uint8_t *out = malloc(DATA_SIZE * 2);
+  size_t outLen;
+
+  size_t gzLen = gzip(data, DATA_SIZE, gz, gzCap, 6, Z_DEFAULT_STRATEGY);
+  print_state("Single chunk matches",
+      decodeAll(gz, gzLen, 1, gzLen, out, &outLen) &&
+      outLen == DATA_SIZE && !memcmp(out, data, DATA_SIZE));
+  print_state("Small chunks on several threads match",
+      decodeAll(gz, gzLen, 4, 32768, out, &outLen) &&
+      outLen == DATA_SIZE && !memcmp(out, data, DATA_SIZE));
+
+  // Chunks with no dynamic blocks in them are decoded from the previous one.
+  size_t storedLen = gzip(data, DATA_SIZE, gz, gzCap, 0, Z_DEFAULT_STRATEGY);
+  print_state("Stored blocks match",
+      decodeAll(gz, storedLen, 4, 65536, out, &outLen) &&
+      outLen == DATA_SIZE && !memcmp(out, data, DATA_SIZE));
+  size_t fixedLen = gzip(data, DATA_SIZE, gz, gzCap, 6, Z_FIXED);
+  print_state("Fixed Huffman blocks match",
+      decodeAll(gz, fixedLen, 4, 65536, out, &outLen) &&
+      outLen == DATA_SIZE && !memcmp(out, data, DATA_SIZE));
+
+  size_t firstLen = gzip(data, DATA_SIZE / 3, gz, gzCap, 6,
+      Z_DEFAULT_STRATEGY);
+  size_t secondLen = gzip(data + DATA_SIZE / 3, DATA_SIZE - DATA_SIZE / 3,
+      gz + firstLen, gzCap - firstLen, 9, Z_DEFAULT_STRATEGY);
+  print_state("Concatenated members match",
+      decodeAll(gz, firstLen + secondLen, 3, 50000, out, &outLen) &&
+      outLen == DATA_SIZE && !memcmp(out, data, DATA_SIZE));
+
+  gzLen = gzip(data, DATA_SIZE, gz, gzCap, 6, Z_DEFAULT_STRATEGY);
+  print_state("Truncated files fail",
+      !decodeAll(gz, gzLen / 2, 4, 32768, out, &outLen));
+  gz[gzLen - 6] ^= 1;
+  print_state("Bad checksums fail",
+      !decodeAll(gz, gzLen, 4, 32768, out, &outLen));
+
+  free(data);
+  free(gz);
+  free(out);
+  return 0;
+}
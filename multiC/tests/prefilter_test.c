@@ -0,0 +1,96 @@
+#include "test.h"
+
+#include <netinet/in.h>
+#include <pcap/pcap.h>
+#include <string.h>
+
+#include "prefilter.h"
+#include "util.h"
+
+static const prefilter_rule_t rule = { PREFILTER_UDP, 53 };
+
+// Builds an Ethernet frame holding an IPv4 or IPv6 packet with the given
+// transport protocol and ports, returning its length.
+static uint32_t makePacket(uint8_t *p, bool v6, uint8_t protocol,
+    uint16_t srcPort, uint16_t dstPort) {
+  memset(p, 0, 128);
+  p[12] = v6 ? 0x86 : 0x08;
+  p[13] = v6 ? 0xDD : 0x00;
+
+  uint8_t *ip = p + 14;
+  uint8_t *ports;
+  if (v6) {
+    ip[0] = 0x60;
+    ip[6] = protocol;
+    ports = ip + 40;
+  } else {
+    ip[0] = 0x45;
+    ip[9] = protocol;
+    ports = ip + 20;
+  }
+  ports[0] = srcPort >> 8;
+  ports[1] = srcPort;
+  ports[2] = dstPort >> 8;
+  ports[3] = dstPort;
+  return ports + 8 - p;
+}
+
+static bool passes(const uint8_t *p, uint32_t caplen, int datalink) {
+  pcap_view_t view = { 0, caplen, caplen, datalink, p };
+  uint32_t passed;
+  return prefilterBatch(&rule, DLT_EN10MB, &view, 1, &passed) == 1;
+}
+
+int main() {
+  print_section("Prefilter Test");
+
+  uint8_t p[128];
+  uint32_t len;
+
+  len = makePacket(p, false, IPPROTO_UDP, 1234, 53);
+  print_state("IPv4 query passes", passes(p, len, DLT_EN10MB));
+  print_state("Other link type fails", !passes(p, len, DLT_RAW));
+  len = makePacket(p, false, IPPROTO_UDP, 53, 1234);
+  print_state("IPv4 response passes", passes(p, len, DLT_EN10MB));
+  len = makePacket(p, false, IPPROTO_TCP, 53, 1234);
+  print_state("TCP fails", !passes(p, len, DLT_EN10MB));
+  len = makePacket(p, false, IPPROTO_UDP, 1234, 4321);
+  print_state("Other ports fail", !passes(p, len, DLT_EN10MB));
+
+  len = makePacket(p, false, IPPROTO_UDP, 1234, 53);
+  p[14 + 6] = 0x00;
+  p[14 + 7] = 0x10;
+  print_state("Trailing fragment fails", !passes(p, len, DLT_EN10MB));
+
+  len = makePacket(p, true, IPPROTO_UDP, 1234, 53);
+  print_state("IPv6 query passes", passes(p, len, DLT_EN10MB));
+
+  // BPF stops at the first field it cannot load.
+  len = makePacket(p, false, IPPROTO_UDP, 53, 1234);
+  print_state("Source match without destination port passes",
+      passes(p, 14 + 20 + 2, DLT_EN10MB));
+  len = makePacket(p, false, IPPROTO_UDP, 1234, 53);
+  print_state("Destination match cut off fails",
+      !passes(p, 14 + 20 + 3, DLT_EN10MB));
+
+  pcap_view_t views[300];
+  uint32_t passed[300];
+  uint8_t packets[2][128];
+  uint32_t lens[2] = {
+    makePacket(packets[0], false, IPPROTO_UDP, 53, 80),
+    makePacket(packets[1], true, IPPROTO_UDP, 80, 80)
+  };
+  for (int i = 0; i < 300; i++) {
+    pcap_view_t view = { 0, lens[i % 3 == 0], lens[i % 3 == 0], DLT_EN10MB,
+      packets[i % 3 == 0] };
+    views[i] = view;
+  }
+  size_t numPassed = prefilterBatch(&rule, DLT_EN10MB, views, 300, passed);
+  bool inOrder = numPassed == 200;
+  for (size_t i = 0; inOrder && i < numPassed; i++) {
+    inOrder = passed[i] % 3 != 0 && (i == 0 || passed[i] > passed[i - 1]);
+  }
+  print_state("Batch keeps passing views in order", inOrder);
+
+  return 0;
+}
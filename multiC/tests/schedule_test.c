@@ -0,0 +1,62 @@
+#include "test.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "schedule.h"
+#include "util.h"
+
+#define HISTORY_PATH "schedule_test.history"
+
+int main() {
+  print_section("Schedule Test");
+
+  schedule_history_t history;
+  unlink(HISTORY_PATH);
+  scheduleHistoryLoad(&history, HISTORY_PATH);
+  print_state("Missing history is empty", history.numRates == 0);
+  print_state("Without a history, size is the estimate",
+      scheduleEstimate(&history, "sekr", 1000) == 1000);
+
+  scheduleHistoryAdd(&history, "sekr", 1000, 1);
+  scheduleHistoryAdd(&history, "sekr", 3000, 1);
+  scheduleHistoryAdd(&history, "nlam", 1000, 1);
+  print_state("Uncommitted runs are not used",
+      scheduleEstimate(&history, "sekr", 1000) == 1000);
+  scheduleHistoryCommit(&history);
+  print_state("Committed run sets the rate",
+      scheduleEstimate(&history, "sekr", 4000) == 2);
+  print_state("Unknown replicas take the average rate",
+      scheduleEstimate(&history, "jpto", 1500) == 1);
+
+  scheduleHistoryAdd(&history, "nlam", 3000, 1);
+  scheduleHistoryCommit(&history);
+  print_state("Later runs are averaged in",
+      scheduleEstimate(&history, "nlam", 2000) == 1);
+
+  print_state("History is saved",
+      scheduleHistorySave(&history, HISTORY_PATH) == 0);
+  scheduleHistoryFree(&history);
+  scheduleHistoryLoad(&history, HISTORY_PATH);
+  print_state("History is read back", history.numRates == 2 &&
+      scheduleEstimate(&history, "sekr", 4000) == 2 &&
+      scheduleEstimate(&history, "nlam", 2000) == 1);
+  scheduleHistoryFree(&history);
+  unlink(HISTORY_PATH);
+
+  const double estimates[] = { 1, 5, 3, 5, 2, 4 };
+  const char *replicas[] = { "a", "a", "a", "a", "b", "b" };
+  uint32_t order[6];
+  scheduleOrder(order, estimates, replicas, 6, false);
+  const uint32_t longest[] = { 1, 3, 5, 2, 4, 0 };
+  print_state("Longest first, ties in the order given",
+      !memcmp(order, longest, sizeof(order)));
+
+  scheduleOrder(order, estimates, replicas, 6, true);
+  const uint32_t interleaved[] = { 1, 5, 3, 4, 2, 0 };
+  print_state("Interleaved replicas",
+      !memcmp(order, interleaved, sizeof(order)));
+
+  return 0;
+}
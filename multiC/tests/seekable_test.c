@@ -0,0 +1,156 @@
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "parallelParse.h"
+#include "seekable.h"
+#include "util.h"
+
+#define FRAME_SIZE 65536
+#define NUM_FRAMES 40
+
+static const char *path = "seekable_test.tmp";
+
+static void fillFrame(uint8_t *data, int index) {
+  for (size_t i = 0; i < FRAME_SIZE; i++) {
+    data[i] = (i % 7 < 4) ? "dns."[i % 4] : (uint8_t)(index * 31 + i);
+  }
+}
+
+// Writes NUM_FRAMES frames, the last one short.
+static bool writeFile(seekable_codec_t codec) {
+  FILE *out = fopen(path, "wb");
+  if (!out) {
+    return false;
+  }
+
+  seekable_writer_t writer;
+  seekableWriterOpen(&writer, out, codec, 1);
+  uint8_t data[FRAME_SIZE];
+  bool ok = true;
+  for (int i = 0; i < NUM_FRAMES; i++) {
+    fillFrame(data, i);
+    size_t size = (i == NUM_FRAMES - 1) ? FRAME_SIZE / 3 : FRAME_SIZE;
+    ok = ok && seekableWriteFrame(&writer, data, size) == 0;
+  }
+  ok = seekableWriterClose(&writer) == 0 && ok;
+  return fclose(out) == 0 && ok;
+}
+
+static bool framesMatch(const seekable_file_t *file) {
+  uint8_t expected[FRAME_SIZE];
+  uint8_t out[FRAME_SIZE];
+  if (file->numFrames != NUM_FRAMES) {
+    return false;
+  }
+  for (int i = 0; i < NUM_FRAMES; i++) {
+    fillFrame(expected, i);
+    size_t size = file->frames[i].size;
+    if (seekableDecodeFrame(file, i, out, size) < 0 ||
+        memcmp(out, expected, size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Each unit reports a single packet carrying its index.
+static int parseIndex(void *ctx, int index, size_t start, parse_unit_t *unit) {
+  struct pcap_pkthdr header;
+  memset(&header, 0, sizeof(header));
+  header.caplen = index;
+  return parseUnitAdd(unit, &header, NULL, 0) ? 0 : -1;
+}
+
+static int failAt(void *ctx, int index, size_t start, parse_unit_t *unit) {
+  parseIndex(ctx, index, start, unit);
+  if (index == *(int *)ctx) {
+    unit->error = "bad unit";
+    return -1;
+  }
+  return 0;
+}
+
+static int numReparsed;
+
+// Units cover ten bytes each, but every third one guesses its start wrong.
+static int guessStart(void *ctx, int index, size_t start, parse_unit_t *unit) {
+  if (start == PARSE_START_UNKNOWN) {
+    unit->start = index * 10 + (index % 3 == 1);
+  } else {
+    unit->start = start;
+    numReparsed++;
+  }
+  unit->end = (index + 1) * 10;
+  return parseIndex(ctx, index, start, unit);
+}
+
+static int nextIndex;
+static bool inOrder;
+
+static void checkOrder(uint8_t *arg, const struct pcap_pkthdr *header,
+    const uint8_t *packet) {
+  inOrder = inOrder && header->caplen == nextIndex;
+  nextIndex++;
+}
+
+int main() {
+  print_section("Seekable Capture Test");
+
+  seekable_file_t file;
+  print_state("zstd frames round trip",
+      writeFile(SEEKABLE_ZSTD) && seekableOpen(&file, path) == 0 &&
+      file.codec == SEEKABLE_ZSTD && framesMatch(&file));
+  uint8_t head[16];
+  print_state("Start of a frame decodes on its own",
+      seekableDecodeFrame(&file, 5, head, sizeof(head)) == 0 &&
+      head[0] == 'd' && head[4] == (uint8_t)(5 * 31 + 4));
+  seekableClose(&file);
+
+  print_state("lz4 frames round trip",
+      writeFile(SEEKABLE_LZ4) && seekableOpen(&file, path) == 0 &&
+      file.codec == SEEKABLE_LZ4 && framesMatch(&file));
+  seekableClose(&file);
+
+  // Damage the middle of the first frame.
+  FILE *f = fopen(path, "r+b");
+  fseek(f, 200, SEEK_SET);
+  fwrite("\xff\xff\xff\xff", 1, 4, f);
+  fclose(f);
+  print_state("Corrupt frame fails",
+      seekableOpen(&file, path) == 0 && !framesMatch(&file));
+  seekableClose(&file);
+
+  // Cut off the seek table.
+  if (truncate(path, 1000) == 0) {
+    print_state("File without seek table is rejected",
+        seekableOpen(&file, path) < 0);
+  }
+  remove(path);
+
+  double waitTime;
+  const char *error;
+  nextIndex = 0;
+  inOrder = true;
+  print_state("Units are delivered in order",
+      parallelParse(1000, 4, parseIndex, NULL, checkOrder, &waitTime,
+        &error) == 0 && inOrder && nextIndex == 1000);
+
+  nextIndex = 0;
+  inOrder = true;
+  print_state("Units with wrong starts are parsed again",
+      parallelParse(1000, 4, guessStart, NULL, checkOrder, &waitTime,
+        &error) == 0 && inOrder && nextIndex == 1000 && numReparsed == 333);
+
+  int badUnit = 500;
+  nextIndex = 0;
+  inOrder = true;
+  print_state("Failed unit stops delivery",
+      parallelParse(1000, 4, failAt, &badUnit, checkOrder, &waitTime,
+        &error) < 0 && inOrder && nextIndex == badUnit + 1 &&
+      !strcmp(error, "bad unit"));
+
+  return 0;
+}
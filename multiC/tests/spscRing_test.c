@@ -0,0 +1,68 @@
+#include "test.h"
+
+#include <stdint.h>
+
+#include "spscRing.h"
+#include "util.h"
+
+#define NUM_ITEMS 1000000
+
+static void *produce(void *arg) {
+  spsc_ring_t *ring = arg;
+  for (uintptr_t i = 1; i <= NUM_ITEMS; i++) {
+    spscRingPush(ring, (void *)i);
+  }
+  spscRingClose(ring);
+  return NULL;
+}
+
+int main() {
+  print_section("SPSC Ring Test");
+
+  spsc_ring_t ring;
+  print_state("Ring is allocated", spscRingInit(&ring, 3) == 0);
+  print_state("Capacity is rounded up to a power of two", ring.capacity == 4);
+
+  int items[4];
+  for (int i = 0; i < 4; i++) {
+    spscRingPush(&ring, &items[i]);
+  }
+  spsc_ring_stats_t stats;
+  spscRingStats(&ring, &stats);
+  print_state("Occupancy is counted at each push",
+      stats.pushes == 4 && stats.occupancySum == 0 + 1 + 2 + 3);
+
+  print_state("Size counts the items waiting", spscRingSize(&ring) == 4);
+
+  bool inOrder = true;
+  for (int i = 0; i < 4; i++) {
+    inOrder = inOrder && spscRingPop(&ring) == &items[i];
+  }
+  print_state("Items come out in order", inOrder);
+  print_state("Drained ring has size 0", spscRingSize(&ring) == 0);
+
+  spscRingPush(&ring, &items[0]);
+  spscRingClose(&ring);
+  print_state("Closed ring gives what is left, then NULL",
+      spscRingPop(&ring) == &items[0] && spscRingPop(&ring) == NULL &&
+      spscRingPop(&ring) == NULL);
+  spscRingFree(&ring);
+
+  // A small ring between two threads has both sides waiting on the other.
+  spscRingInit(&ring, 8);
+  pthread_t producer;
+  pthread_create(&producer, NULL, produce, &ring);
+  uintptr_t expected = 1;
+  bool ordered = true;
+  void *item;
+  while ((item = spscRingPop(&ring))) {
+    ordered = ordered && (uintptr_t)item == expected;
+    expected++;
+  }
+  pthread_join(producer, NULL);
+  print_state("Every item crosses threads in order",
+      ordered && expected == NUM_ITEMS + 1);
+  spscRingFree(&ring);
+
+  return 0;
+}